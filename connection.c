@@ -13,17 +13,55 @@
 #include "postgres.h"
 #include "sqlite_fdw.h"
 
+#if PG_VERSION_NUM >= 140000
+	#include "access/genam.h"
+	#include "access/htup_details.h"
+	#include "access/reloptions.h"
+	#include "catalog/pg_foreign_table.h"
+#endif
 #include "access/xact.h"
 #include "commands/defrem.h"
+#if PG_VERSION_NUM >= 130000
+	#include "common/hashfn.h"
+#endif
+#include "lib/ilist.h"
 #if (PG_VERSION_NUM >= 140000 && PG_VERSION_NUM < 150000)
 	#include "miscadmin.h"
 #endif
 #include "optimizer/cost.h"
 #include "utils/builtins.h"
+#if PG_VERSION_NUM >= 140000
+	#include "utils/fmgroids.h"
+#endif
 #include "utils/inval.h"
 #include "utils/syscache.h"
 
 
+/* Default value of the option stmt_cache_size */
+#define SQLITE_DEFAULT_STMT_CACHE_SIZE	100
+
+/*
+ * Prepared statement cache hash table entry
+ *
+ * The lookup key is the SQL text together with the connection the statement
+ * was prepared for, which is either the main or the snapshot connection of
+ * a server.  A statement is used by one executor node at a time.
+ */
+typedef struct StmtCacheKey
+{
+	sqlite3    *conn;			/* connection of the statement */
+	const char *sql;			/* SQL text, owned by the entry */
+} StmtCacheKey;
+
+typedef struct StmtCacheEntry
+{
+	StmtCacheKey key;			/* hash key (must be first) */
+	sqlite3_stmt *stmt;			/* prepared statement */
+	bool		in_use;			/* true if checked out by a caller */
+	int			nest_level;		/* transaction nesting level of the checkout */
+	dlist_node	lru_node;		/* position in the LRU list */
+} StmtCacheEntry;
+
 /*
  * Connection cache hash table entry
  *
@@ -43,8 +81,23 @@ typedef struct ConnCacheEntry
 	bool		truncatable;	/* check table can truncate or not */
 	bool		readonly;		/* option force_readonly, readonly SQLite file mode */
 	bool		invalidated;	/* true if reconnect is pending */
+	bool		serialized;		/* opened in serialized threading mode */
+	bool		check_async;	/* true if a foreign table has changed, see
+								 * sqlite_get_connection */
+	bool		snapshot_scan;	/* option snapshot_scan */
+	sqlite3    *snapshot_conn;	/* read-only connection for scans of UPDATE
+								 * and DELETE, or NULL */
 	Oid			serverid;		/* foreign server OID used to get server name */
 	List	   *stmtList;		/* list stmt associated with conn */
+	HTAB	   *stmt_cache;		/* statements kept across transactions, or
+								 * NULL */
+	dlist_head	stmt_lru;		/* cached statements, most recently used
+								 * first */
+	int			stmt_cache_size;	/* option stmt_cache_size */
+	uint64		stmt_cache_hits;	/* statements found in the cache */
+	uint64		stmt_cache_misses;	/* statements prepared for the cache */
+	int			busy_timeout;	/* option busy_timeout, in milliseconds */
+	SqliteConnStats stats;		/* counters of the FDW for the connection */
 	uint32		server_hashvalue;	/* hash value of foreign server OID */
 	uint32		mapping_hashvalue;	/* hash value of user mapping OID */
 } ConnCacheEntry;
@@ -60,9 +113,16 @@ static volatile bool xact_got_connection = false;
 PG_FUNCTION_INFO_V1(sqlite_fdw_get_connections);
 PG_FUNCTION_INFO_V1(sqlite_fdw_disconnect);
 PG_FUNCTION_INFO_V1(sqlite_fdw_disconnect_all);
+PG_FUNCTION_INFO_V1(sqlite_fdw_connection_stats);
 
-static sqlite3 *sqlite_open_db(const char *dbpath, int flags);
+static sqlite3 *sqlite_open_db(const char *dbpath, int flags, const char *pragmas, ConnCacheEntry *entry);
+static int	sqlite_busy_handler(void *arg, int count);
 static void sqlite_make_new_connection(ConnCacheEntry *entry, ForeignServer *server);
+static bool sqlite_is_wal_mode(sqlite3 * conn);
+static void sqlite_close_snapshot_connection(ConnCacheEntry *entry);
+#if PG_VERSION_NUM >= 140000
+static bool sqlite_server_has_async_tables(Oid serverid);
+#endif
 void		sqlite_do_sql_command(sqlite3 * conn, const char *sql, int level, List **busy_connection);
 static void sqlite_begin_remote_xact(ConnCacheEntry *entry);
 static void sqlitefdw_xact_callback(XactEvent event, void *arg);
@@ -77,6 +137,11 @@ static void sqlitefdw_abort_cleanup(ConnCacheEntry *entry, bool toplevel, List *
 static bool sqlite_disconnect_cached_connections(Oid serverid);
 #endif
 static void sqlite_finalize_list_stmt(List **list);
+static uint32 sqlite_stmt_cache_hash(const void *key, Size keysize);
+static int	sqlite_stmt_cache_match(const void *key1, const void *key2, Size keysize);
+static void sqlite_reset_stmt_cache(ConnCacheEntry *entry, int nestlevel);
+static void sqlite_pass_stmt_cache_to_parent(ConnCacheEntry *entry, int nestlevel);
+static void sqlite_clear_stmt_cache(ConnCacheEntry *entry);
 static List *sqlite_append_stmt_to_list(List *list, sqlite3_stmt * stmt);
 
 typedef struct BusyHandlerArg
@@ -126,6 +191,10 @@ sqlite_get_connection(ForeignServer *server, bool truncatable)
 		RegisterSubXactCallback(sqlitefdw_subxact_callback, NULL);
 		CacheRegisterSyscacheCallback(FOREIGNSERVEROID,
 									  sqlitefdw_inval_callback, (Datum) 0);
+#if PG_VERSION_NUM >= 140000
+		CacheRegisterSyscacheCallback(FOREIGNTABLEREL,
+									  sqlitefdw_inval_callback, (Datum) 0);
+#endif
 	}
 
 	/* Set flag that we did GetConnection during the current transaction */
@@ -141,7 +210,24 @@ sqlite_get_connection(ForeignServer *server, bool truncatable)
 	{
 		/* If can not find any cached entry => initialize new hashtable entry */
 		entry->conn = NULL;
+		entry->snapshot_conn = NULL;
+		entry->stmt_cache = NULL;
+	}
+
+#if PG_VERSION_NUM >= 140000
+
+	/*
+	 * A connection which is not in serialized mode has to be remade when the
+	 * option async_capable has been set for one of the tables of the server,
+	 * see sqlite_make_new_connection.
+	 */
+	if (entry->conn != NULL && entry->check_async)
+	{
+		entry->check_async = false;
+		if (sqlite_server_has_async_tables(server->serverid))
+			entry->invalidated = true;
 	}
+#endif
 
 	/*
 	 * If the connection needs to be remade due to invalidation, disconnect as
@@ -149,11 +235,15 @@ sqlite_get_connection(ForeignServer *server, bool truncatable)
 	 */
 	if (entry->conn != NULL && entry->invalidated && entry->xact_depth == 0)
 	{
-		int			rc = sqlite3_close(entry->conn);
+		int			rc;
+
+		sqlite_clear_stmt_cache(entry);
+		rc = sqlite3_close(entry->conn);
 
 		elog(DEBUG1, "closing connection %p for option changes to take effect. sqlite3_close=%d",
 			 entry->conn, rc);
 		entry->conn = NULL;
+		sqlite_close_snapshot_connection(entry);
 	}
 
 	/*
@@ -186,10 +276,11 @@ sqlite_get_connection(ForeignServer *server, bool truncatable)
 
 /*
  * Open remote sqlite database using specified database path
- * and flags of opened file descriptor mode.
+ * and flags of opened file descriptor mode, then run the PRAGMA
+ * statements configured for the server.
  */
 static sqlite3 *
-sqlite_open_db(const char *dbpath, int flags)
+sqlite_open_db(const char *dbpath, int flags, const char *pragmas, ConnCacheEntry *entry)
 {
 	sqlite3	   *conn = NULL;
 	int			rc;
@@ -200,9 +291,11 @@ sqlite_open_db(const char *dbpath, int flags)
 		ereport(ERROR,
 				(errcode(ERRCODE_FDW_UNABLE_TO_ESTABLISH_CONNECTION),
 				 errmsg("Failed to open SQLite DB, file '%s', result code %d", dbpath, rc)));
-	/* make 'LIKE' of SQLite case sensitive like PostgreSQL */
-	rc = sqlite3_exec(conn, "pragma case_sensitive_like=1",
-					  NULL, NULL, &err);
+	/* Set before the PRAGMAs, changing journal_mode can wait for a lock */
+	if (entry->busy_timeout > 0)
+		sqlite3_busy_handler(conn, sqlite_busy_handler, entry);
+	/* the PRAGMAs also make 'LIKE' of SQLite case sensitive like PostgreSQL */
+	rc = sqlite3_exec(conn, pragmas, NULL, NULL, &err);
 	if (rc != SQLITE_OK)
 	{
 		char	   *perr = pstrdup(err);
@@ -221,6 +314,94 @@ sqlite_open_db(const char *dbpath, int flags)
 	return conn;
 }
 
+/*
+ * Busy handler of the connections of a server.  It waits like the handler
+ * installed by sqlite3_busy_timeout(), and counts the retries.
+ */
+static int
+sqlite_busy_handler(void *arg, int count)
+{
+	static const uint8 delays[] = {1, 2, 5, 10, 15, 20, 25, 25, 25, 50, 50, 100};
+	static const uint8 totals[] = {0, 1, 3, 8, 18, 33, 53, 78, 103, 128, 178, 228};
+	ConnCacheEntry *entry = (ConnCacheEntry *) arg;
+	int			ndelays = lengthof(delays);
+	int			delay;
+	int			prior;
+
+	if (count < ndelays)
+	{
+		delay = delays[count];
+		prior = totals[count];
+	}
+	else
+	{
+		delay = delays[ndelays - 1];
+		prior = totals[ndelays - 1] + delay * (count - (ndelays - 1));
+	}
+
+	/* Give up when the timeout has passed */
+	if (prior + delay > entry->busy_timeout)
+	{
+		delay = entry->busy_timeout - prior;
+		if (delay <= 0)
+			return 0;
+	}
+
+	sqlite3_sleep(delay);
+	/* Background fetchers of asynchronous scans may get here too */
+	pg_atomic_fetch_add_u64(&entry->stats.busy_retries, 1);
+	return 1;
+}
+
+/*
+ * sqlite_get_connection_stats:
+ * 			Counters of the connection to a server, which must have been
+ * obtained by sqlite_get_connection().  They stay at the same address while
+ * the backend runs.
+ */
+SqliteConnStats *
+sqlite_get_connection_stats(ForeignServer *server)
+{
+	ConnCacheEntry *entry;
+	ConnCacheKey key = server->serverid;
+
+	if (ConnectionHash == NULL)
+		return NULL;
+
+	entry = hash_search(ConnectionHash, &key, HASH_FIND, NULL);
+	if (entry == NULL || entry->conn == NULL)
+		return NULL;
+
+	return &entry->stats;
+}
+
+/*
+ * sqlite_connection_has_writes:
+ * 			Check whether the cached connection to a server has modified the
+ * database in the current transaction.  Such changes are not visible to
+ * other connections, e.g. the ones of parallel workers.
+ */
+bool
+sqlite_connection_has_writes(ForeignServer *server)
+{
+	ConnCacheEntry *entry;
+	ConnCacheKey key = server->serverid;
+
+	if (ConnectionHash == NULL)
+		return false;
+
+	entry = hash_search(ConnectionHash, &key, HASH_FIND, NULL);
+	if (entry == NULL || entry->conn == NULL || entry->xact_depth <= 0)
+		return false;
+
+#if SQLITE_VERSION_NUMBER >= 3034000
+	return sqlite3_txn_state(entry->conn, "main") == SQLITE_TXN_WRITE;
+#else
+	/* Assume any open transaction might have written something */
+	return true;
+#endif
+}
+
 
 /*
  * Reset all transient state fields in the cached connection entry and
@@ -232,18 +413,32 @@ sqlite_make_new_connection(ConnCacheEntry *entry, ForeignServer *server)
 	const char *dbpath = NULL;
 	ListCell   *lc;
 	int flags = 0;
+	const char *page_size = NULL;
+	const char *journal_mode = NULL;
+	bool		async_capable = false;
+	StringInfoData other_pragmas;
+	StringInfoData pragmas;
 
 	Assert(entry->conn == NULL);
 
 	entry->serverid = server->serverid;
 	entry->xact_depth = 0;
 	entry->invalidated = false;
+	entry->check_async = false;
 	entry->stmtList = NULL;
+	entry->stmt_cache_size = SQLITE_DEFAULT_STMT_CACHE_SIZE;
+	entry->stmt_cache_hits = 0;
+	entry->stmt_cache_misses = 0;
+	entry->busy_timeout = 0;
+	MemSet(&entry->stats, 0, sizeof(entry->stats));
+	pg_atomic_init_u64(&entry->stats.busy_retries, 0);
 	entry->keep_connections = true;
 	entry->readonly = false;
+	entry->snapshot_scan = false;
 	entry->server_hashvalue =
 		GetSysCacheHashValue1(FOREIGNSERVEROID,
 							  ObjectIdGetDatum(server->serverid));
+	initStringInfo(&other_pragmas);
 	foreach(lc, server->options)
 	{
 		DefElem	   *def = (DefElem *) lfirst(lc);
@@ -254,11 +449,197 @@ sqlite_make_new_connection(ConnCacheEntry *entry, ForeignServer *server)
 			entry->keep_connections = defGetBoolean(def);
 		else if (strcmp(def->defname, "force_readonly") == 0)
 			entry->readonly = defGetBoolean(def);
+		else if (strcmp(def->defname, "snapshot_scan") == 0)
+			entry->snapshot_scan = defGetBoolean(def);
+		else if (strcmp(def->defname, "async_capable") == 0)
+			async_capable = defGetBoolean(def);
+		else if (strcmp(def->defname, "stmt_cache_size") == 0)
+			entry->stmt_cache_size = strtol(defGetString(def), NULL, 10);
+		else if (strcmp(def->defname, "busy_timeout") == 0)
+			entry->busy_timeout = strtol(defGetString(def), NULL, 10);
+		else if (strcmp(def->defname, "page_size_hint") == 0)
+			page_size = defGetString(def);
+		else if (strcmp(def->defname, "journal_mode") == 0)
+			journal_mode = defGetString(def);
+		else if (strcmp(def->defname, "synchronous") == 0 ||
+				 strcmp(def->defname, "temp_store") == 0 ||
+				 strcmp(def->defname, "cache_size") == 0 ||
+				 strcmp(def->defname, "mmap_size") == 0)
+		{
+			/* The values have been checked by sqlite_fdw_validator */
+			appendStringInfo(&other_pragmas, "pragma %s=%s;",
+							 def->defname, defGetString(def));
+		}
 	}
 
+	/*
+	 * The page size of a database can't be changed in WAL mode, so it is
+	 * set before the journal mode.  It only takes effect for a new database
+	 * or at the next VACUUM.
+	 */
+	initStringInfo(&pragmas);
+	appendStringInfoString(&pragmas, "pragma case_sensitive_like=1;");
+	if (page_size)
+		appendStringInfo(&pragmas, "pragma page_size=%s;", page_size);
+	if (journal_mode)
+		appendStringInfo(&pragmas, "pragma journal_mode=%s;", journal_mode);
+	appendStringInfoString(&pragmas, other_pragmas.data);
+
 	flags = flags | (entry->readonly ? SQLITE_OPEN_READONLY : SQLITE_OPEN_READWRITE);
+
+	/*
+	 * Background fetchers of asynchronous scans step statements of the
+	 * connection in a thread while the backend may use it, so they need a
+	 * connection in serialized mode.  Other connections are used by the
+	 * backend only and don't pay for the locking.  Such a connection is
+	 * remade if the option is set for a table later, see
+	 * sqlitefdw_inval_callback.
+	 */
+	entry->serialized = false;
+#if PG_VERSION_NUM >= 140000
+	if (async_capable || sqlite_server_has_async_tables(server->serverid))
+		entry->serialized = true;
+#endif
+	flags = flags | (entry->serialized ? SQLITE_OPEN_FULLMUTEX : SQLITE_OPEN_NOMUTEX);
 	/* Try to make the connection */
-	entry->conn = sqlite_open_db(dbpath, flags);
+	entry->conn = sqlite_open_db(dbpath, flags, pragmas.data, entry);
+
+	/*
+	 * Scans of UPDATE and DELETE read from a second connection, which sees
+	 * the database as it was before the modification.  This requires WAL
+	 * mode, otherwise the reader would block the commit of the writer.  The
+	 * page size and the journal mode are properties of the database file,
+	 * they have been set by the first connection.
+	 */
+	if (entry->snapshot_scan && !sqlite_is_wal_mode(entry->conn))
+		ereport(WARNING,
+				(errmsg("option \"snapshot_scan\" of server \"%s\" is ignored",
+						server->servername),
+				 errdetail("SQLite database \"%s\" is not in WAL journal mode.", dbpath),
+				 errhint("Set option \"journal_mode\" of the server to \"wal\".")));
+	else if (entry->snapshot_scan)
+	{
+		resetStringInfo(&pragmas);
+		appendStringInfoString(&pragmas, "pragma case_sensitive_like=1;");
+		appendStringInfoString(&pragmas, other_pragmas.data);
+		entry->snapshot_conn = sqlite_open_db(dbpath,
+											  SQLITE_OPEN_READONLY | SQLITE_OPEN_NOMUTEX,
+											  pragmas.data, entry);
+	}
+	pfree(pragmas.data);
+	pfree(other_pragmas.data);
+}
+
+#if PG_VERSION_NUM >= 140000
+/*
+ * Check whether some foreign table of a server has the option async_capable
+ * set, so that background fetchers may use the connection to the server.
+ */
+static bool
+sqlite_server_has_async_tables(Oid serverid)
+{
+	Relation	rel;
+	SysScanDesc scan;
+	ScanKeyData key;
+	HeapTuple	tuple;
+	bool		found = false;
+
+	rel = table_open(ForeignTableRelationId, AccessShareLock);
+	ScanKeyInit(&key,
+				Anum_pg_foreign_table_ftserver,
+				BTEqualStrategyNumber, F_OIDEQ,
+				ObjectIdGetDatum(serverid));
+	scan = systable_beginscan(rel, InvalidOid, false, NULL, 1, &key);
+	while (!found && HeapTupleIsValid(tuple = systable_getnext(scan)))
+	{
+		Datum		datum;
+		bool		isnull;
+		ListCell   *lc;
+
+		datum = heap_getattr(tuple, Anum_pg_foreign_table_ftoptions,
+							 RelationGetDescr(rel), &isnull);
+		if (isnull)
+			continue;
+
+		foreach(lc, untransformRelOptions(datum))
+		{
+			DefElem    *def = (DefElem *) lfirst(lc);
+
+			if (strcmp(def->defname, "async_capable") == 0 && defGetBoolean(def))
+				found = true;
+		}
+	}
+	systable_endscan(scan);
+	table_close(rel, AccessShareLock);
+
+	return found;
+}
+#endif
+
+/*
+ * Check whether the database of a connection is in WAL journal mode.
+ */
+static bool
+sqlite_is_wal_mode(sqlite3 * conn)
+{
+	sqlite3_stmt *stmt = NULL;
+	bool		result = false;
+
+	if (sqlite3_prepare_v2(conn, "PRAGMA journal_mode", -1, &stmt, NULL) == SQLITE_OK &&
+		sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		const char *mode = (const char *) sqlite3_column_text(stmt, 0);
+
+		result = (mode != NULL && pg_strcasecmp(mode, "wal") == 0);
+	}
+	sqlite3_finalize(stmt);
+	return result;
+}
+
+/*
+ * Close the snapshot connection of a cache entry, if any.  Its statements
+ * are finalized together with the ones of the main connection.
+ */
+static void
+sqlite_close_snapshot_connection(ConnCacheEntry *entry)
+{
+	if (entry->snapshot_conn == NULL)
+		return;
+
+	elog(DEBUG3, "discarding sqlite_fdw snapshot connection %p", entry->snapshot_conn);
+	sqlite3_close(entry->snapshot_conn);
+	entry->snapshot_conn = NULL;
+}
+
+/*
+ * sqlite_get_snapshot_connection:
+ * 			Get the read-only connection to scan the target table of UPDATE or
+ * DELETE, so that the rows can be modified while they are being fetched.
+ * Returns NULL if the option snapshot_scan is off, the database is not in
+ * WAL mode, or the current transaction has modified the database already,
+ * because the connection can't see uncommitted changes.  The connection is
+ * used in autocommit mode: its read transaction starts with the first step
+ * of a statement and ends when the statement is done or reset.
+ */
+sqlite3 *
+sqlite_get_snapshot_connection(ForeignServer *server)
+{
+	ConnCacheEntry *entry;
+	ConnCacheKey key = server->serverid;
+
+	/* sqlite_get_connection() must have been called for the server */
+	entry = hash_search(ConnectionHash, &key, HASH_FIND, NULL);
+	if (entry == NULL || entry->conn == NULL || entry->snapshot_conn == NULL)
+		return NULL;
+
+#if SQLITE_VERSION_NUMBER >= 3034000
+	if (sqlite3_txn_state(entry->conn, NULL) == SQLITE_TXN_WRITE)
+		return NULL;
+	return entry->snapshot_conn;
+#else
+	/* The write state of the transaction can't be checked */
+	return NULL;
+#endif
 }
 
 /*
@@ -282,6 +663,9 @@ sqlite_cleanup_connection(void)
 			continue;
 
 		sqlite_finalize_list_stmt(&entry->stmtList);
+		sqlite_clear_stmt_cache(entry);
+
+		sqlite_close_snapshot_connection(entry);
 
 		elog(DEBUG1, "disconnecting sqlite_fdw connection %p", entry->conn);
 		rc = sqlite3_close(entry->conn);
@@ -437,6 +821,12 @@ sqlitefdw_xact_callback(XactEvent event, void *arg)
 
 	elog(DEBUG1, "sqlite_fdw xact_callback %d", event);
 
+	/*
+	 * Background fetchers of asynchronous scans must not use the connections
+	 * any more once the remote transactions are closed.
+	 */
+	sqlite_async_stop_all();
+
 	/*
 	 * Scan all connection cache entries to find open remote transactions, and
 	 * close them.
@@ -459,6 +849,8 @@ sqlitefdw_xact_callback(XactEvent event, void *arg)
 				case XACT_EVENT_PARALLEL_PRE_COMMIT:
 				case XACT_EVENT_PRE_COMMIT:
 
+					/* Statements must not be running at COMMIT */
+					sqlite_reset_stmt_cache(entry, 1);
 					/* Commit all remote transactions during pre-commit */
 					if (!sqlite3_get_autocommit(entry->conn))
 						sqlite_do_sql_command(entry->conn, "COMMIT", ERROR, &busy_connection);
@@ -540,8 +932,10 @@ sqlitefdw_reset_xact_state(ConnCacheEntry *entry, bool toplevel) {
 			!entry->keep_connections)
 		{
 			elog(DEBUG3, "discarding sqlite_fdw connection %p", entry->conn);
+			sqlite_clear_stmt_cache(entry);
 			sqlite3_close(entry->conn);
 			entry->conn = NULL;
+			sqlite_close_snapshot_connection(entry);
 		}
 	} else {
 		/* Reset state to show we're out of a subtransaction */
@@ -570,16 +964,37 @@ sqlitefdw_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
 	if (!xact_got_connection)
 		return;
 
+	curlevel = GetCurrentTransactionNestLevel();
+
+	/*
+	 * Background fetchers of scans which failed in the subtransaction must
+	 * not use the connections any more once it is rolled back.
+	 */
+	if (event == SUBXACT_EVENT_ABORT_SUB)
+		sqlite_async_stop_subxact(curlevel);
+
 	/*
 	 * Scan all connection cache entries to find open remote subtransactions
 	 * of the current level, and close them.
 	 */
-	curlevel = GetCurrentTransactionNestLevel();
 	hash_seq_init(&scan, ConnectionHash);
 	while ((entry = (ConnCacheEntry *) hash_seq_search(&scan)))
 	{
 		char		sql[100];
 
+		/*
+		 * Statements checked out by scans of an aborted subtransaction are
+		 * never released by them.  Those of a committed one belong to the
+		 * parent from now on, e.g. for cursors which are still open.
+		 */
+		if (entry->conn != NULL)
+		{
+			if (event == SUBXACT_EVENT_ABORT_SUB)
+				sqlite_reset_stmt_cache(entry, curlevel);
+			else
+				sqlite_pass_stmt_cache_to_parent(entry, curlevel);
+		}
+
 		/*
 		 * We only care about connections with open remote subtransactions of
 		 * the current level.
@@ -647,6 +1062,10 @@ sqlitefdw_subxact_callback(SubXactEvent event, SubTransactionId mySubid,
  *
  * NB: We could avoid unnecessary disconnection more strictly by examining
  * individual option values, but it seems too much effort for the gain.
+ *
+ * A change of a foreign table can't be related to its server here, so the
+ * connections which are not in serialized mode only remember to check the
+ * option async_capable of their tables at the next sqlite_get_connection.
  */
 static void
 sqlitefdw_inval_callback(Datum arg, int cacheid, uint32 hashvalue)
@@ -654,7 +1073,23 @@ sqlitefdw_inval_callback(Datum arg, int cacheid, uint32 hashvalue)
 	HASH_SEQ_STATUS scan;
 	ConnCacheEntry *entry;
 
+#if PG_VERSION_NUM >= 140000
+	Assert(cacheid == FOREIGNSERVEROID || cacheid == FOREIGNTABLEREL);
+#else
 	Assert(cacheid == FOREIGNSERVEROID);
+#endif
+
+	/* A foreign table has changed */
+	if (cacheid != FOREIGNSERVEROID)
+	{
+		hash_seq_init(&scan, ConnectionHash);
+		while ((entry = (ConnCacheEntry *) hash_seq_search(&scan)))
+		{
+			if (entry->conn != NULL && !entry->serialized)
+				entry->check_async = true;
+		}
+		return;
+	}
 
 	/* ConnectionHash must exist already, if we're registered */
 	hash_seq_init(&scan, ConnectionHash);
@@ -678,8 +1113,10 @@ sqlitefdw_inval_callback(Datum arg, int cacheid, uint32 hashvalue)
 			if (entry->xact_depth == 0)
 			{
 				elog(DEBUG3, "discarding sqlite_fdw connection %p", entry->conn);
+				sqlite_clear_stmt_cache(entry);
 				sqlite3_close(entry->conn);
 				entry->conn = NULL;
+				sqlite_close_snapshot_connection(entry);
 			}
 			else
 				entry->invalidated = true;
@@ -835,6 +1272,175 @@ sqlite_fdw_get_connections(PG_FUNCTION_ARGS)
 #endif
 }
 
+/*
+ * Get a status counter of a SQLite connection, with NULL for a counter which
+ * is not supported by the SQLite library.
+ */
+static void
+sqlite_get_db_status(sqlite3 * conn, int op, bool highwater, Datum *value, bool *isnull)
+{
+	int			cur = 0;
+	int			hiwtr = 0;
+
+	if (sqlite3_db_status(conn, op, &cur, &hiwtr, 0) != SQLITE_OK)
+	{
+		*isnull = true;
+		return;
+	}
+	*value = Int64GetDatum(highwater ? hiwtr : cur);
+	*isnull = false;
+}
+
+/*
+ * List active foreign server connections with their runtime statistics.
+ *
+ * Besides the server name and the validity like sqlite_fdw_get_connections,
+ * the function returns the transaction nesting level of the connection, the
+ * state of its statement cache, the counters of the FDW since the connection
+ * was opened, and counters from sqlite3_db_status() about the page cache,
+ * the memory used for the schema and the statements, and the lookaside
+ * memory allocator.
+ *
+ * No records are returned when there are no cached connections at all.
+ */
+Datum
+sqlite_fdw_connection_stats(PG_FUNCTION_ARGS)
+{
+#define SQLITE_FDW_GET_CONNECTION_STATS_COLS	21
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	HASH_SEQ_STATUS scan;
+	ConnCacheEntry *entry;
+#if PG_VERSION_NUM < 150000
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+#endif
+
+#if PG_VERSION_NUM >= 160000
+	InitMaterializedSRF(fcinfo, 0);
+#elif PG_VERSION_NUM >= 150000
+	SetSingleFuncCall(fcinfo, 0);
+#else
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* Build tuplestore to hold the result rows */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+#endif
+
+	/* If cache doesn't exist, we return no records */
+	if (!ConnectionHash)
+	{
+#if PG_VERSION_NUM < 150000
+		/* clean up and return the tuplestore */
+		tuplestore_donestoring(tupstore);
+#endif
+
+		PG_RETURN_VOID();
+	}
+
+	hash_seq_init(&scan, ConnectionHash);
+	while ((entry = (ConnCacheEntry *) hash_seq_search(&scan)))
+	{
+		ForeignServer *server;
+		Datum		values[SQLITE_FDW_GET_CONNECTION_STATS_COLS] = {0};
+		bool		nulls[SQLITE_FDW_GET_CONNECTION_STATS_COLS] = {0};
+		int			i = 0;
+
+		/* We only look for open remote connections */
+		if (!entry->conn)
+			continue;
+
+		/* See sqlite_fdw_get_connections about dropped servers */
+		server = GetForeignServerExtended(entry->serverid, FSV_MISSING_OK);
+		if (!server)
+			nulls[i++] = true;
+		else
+			values[i++] = CStringGetTextDatum(server->servername);
+
+		values[i++] = BoolGetDatum(!entry->invalidated);
+		values[i++] = Int32GetDatum(entry->xact_depth);
+		values[i++] = Int32GetDatum(entry->stmt_cache ?
+									hash_get_num_entries(entry->stmt_cache) : 0);
+		values[i++] = Int64GetDatum((int64) entry->stmt_cache_hits);
+		values[i++] = Int64GetDatum((int64) entry->stmt_cache_misses);
+		values[i++] = Int64GetDatum((int64) entry->stats.stmts_prepared);
+		values[i++] = Int64GetDatum((int64) entry->stats.rows_fetched);
+#if SQLITE_VERSION_NUMBER >= 3037000
+		values[i++] = Int64GetDatum((int64) sqlite3_total_changes64(entry->conn));
+#else
+		values[i++] = Int64GetDatum((int64) sqlite3_total_changes(entry->conn));
+#endif
+		values[i++] = Int64GetDatum((int64) pg_atomic_read_u64(&entry->stats.busy_retries));
+
+		/* Counters of the page cache */
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_CACHE_HIT, false, &values[i], &nulls[i]);
+		i++;
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_CACHE_MISS, false, &values[i], &nulls[i]);
+		i++;
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_CACHE_WRITE, false, &values[i], &nulls[i]);
+		i++;
+#ifdef SQLITE_DBSTATUS_CACHE_SPILL
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_CACHE_SPILL, false, &values[i], &nulls[i]);
+#else
+		nulls[i] = true;
+#endif
+		i++;
+
+		/* Memory used by the connection */
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_CACHE_USED, false, &values[i], &nulls[i]);
+		i++;
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_SCHEMA_USED, false, &values[i], &nulls[i]);
+		i++;
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_STMT_USED, false, &values[i], &nulls[i]);
+		i++;
+
+		/* Lookaside memory allocator, the hit and miss counters are highwater */
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_LOOKASIDE_USED, false, &values[i], &nulls[i]);
+		i++;
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_LOOKASIDE_HIT, true, &values[i], &nulls[i]);
+		i++;
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_LOOKASIDE_MISS_SIZE, true, &values[i], &nulls[i]);
+		i++;
+		sqlite_get_db_status(entry->conn, SQLITE_DBSTATUS_LOOKASIDE_MISS_FULL, true, &values[i], &nulls[i]);
+		i++;
+
+		Assert(i == SQLITE_FDW_GET_CONNECTION_STATS_COLS);
+#if PG_VERSION_NUM >= 150000
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+#else
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+#endif
+	}
+
+#if PG_VERSION_NUM < 150000
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+#endif
+
+	PG_RETURN_VOID();
+}
+
 /*
  * Disconnect the specified cached connections.
  *
@@ -903,6 +1509,7 @@ sqlitefdw_abort_cleanup(ConnCacheEntry *entry, bool toplevel, List **busy_connec
 
 		/* Finalize all prepared statements */
 		sqlite_finalize_list_stmt(&entry->stmtList);
+		sqlite_reset_stmt_cache(entry, 1);
 
 		/*
 		* rollback if in transaction because SQLite may
@@ -1007,8 +1614,10 @@ sqlite_disconnect_cached_connections(Oid serverid)
 			{
 				elog(DEBUG3, "discarding sqlite_fdw connection %p", entry->conn);
 				sqlite_finalize_list_stmt(&entry->stmtList);
+				sqlite_clear_stmt_cache(entry);
 				sqlite3_close(entry->conn);
 				entry->conn = NULL;
+				sqlite_close_snapshot_connection(entry);
 				result = true;
 			}
 		}
@@ -1018,14 +1627,58 @@ sqlite_disconnect_cached_connections(Oid serverid)
 #endif
 
 /*
- * cache sqlite3 statement to finalize at the end of transaction
+ * sqlite_get_cached_stmt:
+ * 			Get a statement prepared for the SQL text on the connection from
+ * the statement cache of the server.  The statement is ready for new
+ * bindings, and is used only by the caller until sqlite_release_stmt() or
+ * the end of the transaction.  Returns NULL if it has to be prepared.
+ */
+sqlite3_stmt *
+sqlite_get_cached_stmt(ForeignServer *server, sqlite3 * conn, const char *sql)
+{
+	ConnCacheEntry *entry;
+	ConnCacheKey key = server->serverid;
+	StmtCacheKey stmt_key;
+	StmtCacheEntry *stmt_entry;
+
+	entry = hash_search(ConnectionHash, &key, HASH_FIND, NULL);
+	if (entry == NULL || entry->stmt_cache == NULL)
+		return NULL;
+
+	stmt_key.conn = conn;
+	stmt_key.sql = sql;
+	stmt_entry = hash_search(entry->stmt_cache, &stmt_key, HASH_FIND, NULL);
+
+	/* A statement can't be shared by two scans of the same query */
+	if (stmt_entry == NULL || stmt_entry->in_use)
+		return NULL;
+
+	sqlite3_reset(stmt_entry->stmt);
+	sqlite3_clear_bindings(stmt_entry->stmt);
+	stmt_entry->in_use = true;
+	stmt_entry->nest_level = GetCurrentTransactionNestLevel();
+	dlist_move_head(&entry->stmt_lru, &stmt_entry->lru_node);
+	entry->stmt_cache_hits++;
+
+	return stmt_entry->stmt;
+}
+
+/*
+ * sqlite_cache_stmt:
+ * 			Keep a statement which has just been prepared for the SQL text in
+ * the statement cache of the server, evicting the least recently used
+ * statement which is not in use if the cache is full.  If the statement
+ * can't be cached, it is finalized at the end of transaction.
  */
 void
-sqlite_cache_stmt(ForeignServer *server, sqlite3_stmt * *stmt)
+sqlite_cache_stmt(ForeignServer *server, sqlite3 * conn, const char *sql,
+				  sqlite3_stmt * *stmt)
 {
 	bool		found;
 	ConnCacheEntry *entry;
 	ConnCacheKey key = server->serverid;
+	StmtCacheKey stmt_key;
+	StmtCacheEntry *stmt_entry = NULL;
 
 	/*
 	 * Find cached entry for requested connection.
@@ -1035,7 +1688,198 @@ sqlite_cache_stmt(ForeignServer *server, sqlite3_stmt * *stmt)
 	/* We must always have found the entry */
 	Assert(found);
 
-	entry->stmtList = sqlite_append_stmt_to_list(entry->stmtList, *stmt);
+	if (entry->stmt_cache_size > 0 && entry->stmt_cache == NULL)
+	{
+		HASHCTL		ctl;
+
+		MemSet(&ctl, 0, sizeof(ctl));
+		ctl.keysize = sizeof(StmtCacheKey);
+		ctl.entrysize = sizeof(StmtCacheEntry);
+		ctl.hash = sqlite_stmt_cache_hash;
+		ctl.match = sqlite_stmt_cache_match;
+		ctl.hcxt = CacheMemoryContext;
+		entry->stmt_cache = hash_create("sqlite_fdw statements",
+										entry->stmt_cache_size, &ctl,
+										HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+		dlist_init(&entry->stmt_lru);
+	}
+
+	if (entry->stmt_cache != NULL)
+	{
+		entry->stmt_cache_misses++;
+		stmt_key.conn = conn;
+		stmt_key.sql = sql;
+
+		/* Evict the least recently used statement if the cache is full */
+		if (hash_get_num_entries(entry->stmt_cache) >= entry->stmt_cache_size)
+		{
+			dlist_reverse_iter iter;
+
+			dlist_reverse_foreach(iter, &entry->stmt_lru)
+			{
+				StmtCacheEntry *victim = dlist_container(StmtCacheEntry, lru_node, iter.cur);
+
+				if (!victim->in_use)
+				{
+					char	   *victim_sql = (char *) victim->key.sql;
+
+					dlist_delete(&victim->lru_node);
+					sqlite3_finalize(victim->stmt);
+					hash_search(entry->stmt_cache, &victim->key, HASH_REMOVE, NULL);
+					pfree(victim_sql);
+					break;
+				}
+			}
+		}
+
+		if (hash_get_num_entries(entry->stmt_cache) < entry->stmt_cache_size)
+		{
+			stmt_entry = hash_search(entry->stmt_cache, &stmt_key, HASH_ENTER, &found);
+
+			/*
+			 * The statement for the same SQL text is in use by someone else,
+			 * this one is finalized at the end of transaction.
+			 */
+			if (found)
+				stmt_entry = NULL;
+		}
+	}
+
+	if (stmt_entry == NULL)
+	{
+		entry->stmtList = sqlite_append_stmt_to_list(entry->stmtList, *stmt);
+		return;
+	}
+
+	stmt_entry->key.sql = MemoryContextStrdup(CacheMemoryContext, sql);
+	stmt_entry->stmt = *stmt;
+	stmt_entry->in_use = true;
+	stmt_entry->nest_level = GetCurrentTransactionNestLevel();
+	dlist_push_head(&entry->stmt_lru, &stmt_entry->lru_node);
+}
+
+/*
+ * sqlite_release_stmt:
+ * 			Give a statement obtained by sqlite_prepare_wrapper() back to the
+ * statement cache, so that it can be used by the next query with the same
+ * SQL text.  Resetting the statement ends its read transaction on a
+ * connection in autocommit mode.  Statements which are not in the cache are
+ * finalized at the end of transaction as before.
+ */
+void
+sqlite_release_stmt(ForeignServer *server, sqlite3_stmt * stmt)
+{
+	ConnCacheEntry *entry;
+	ConnCacheKey key = server->serverid;
+	StmtCacheKey stmt_key;
+	StmtCacheEntry *stmt_entry;
+
+	if (stmt == NULL || ConnectionHash == NULL)
+		return;
+
+	entry = hash_search(ConnectionHash, &key, HASH_FIND, NULL);
+	if (entry == NULL || entry->stmt_cache == NULL)
+		return;
+
+	stmt_key.conn = sqlite3_db_handle(stmt);
+	stmt_key.sql = sqlite3_sql(stmt);
+	stmt_entry = hash_search(entry->stmt_cache, &stmt_key, HASH_FIND, NULL);
+	if (stmt_entry == NULL || stmt_entry->stmt != stmt)
+		return;
+
+	sqlite3_reset(stmt);
+	stmt_entry->in_use = false;
+}
+
+/*
+ * Reset the cached statements of a connection which were checked out at
+ * nestlevel or deeper, at the end of the (sub)transaction of that level.
+ * Their users are gone, even if they failed to release them.
+ */
+static void
+sqlite_reset_stmt_cache(ConnCacheEntry *entry, int nestlevel)
+{
+	HASH_SEQ_STATUS scan;
+	StmtCacheEntry *stmt_entry;
+
+	if (entry->stmt_cache == NULL)
+		return;
+
+	hash_seq_init(&scan, entry->stmt_cache);
+	while ((stmt_entry = (StmtCacheEntry *) hash_seq_search(&scan)))
+	{
+		if (!stmt_entry->in_use || stmt_entry->nest_level < nestlevel)
+			continue;
+		sqlite3_reset(stmt_entry->stmt);
+		stmt_entry->in_use = false;
+	}
+}
+
+/*
+ * Move the cached statements which were checked out at nestlevel to the
+ * parent transaction when the subtransaction of that level commits.
+ */
+static void
+sqlite_pass_stmt_cache_to_parent(ConnCacheEntry *entry, int nestlevel)
+{
+	HASH_SEQ_STATUS scan;
+	StmtCacheEntry *stmt_entry;
+
+	if (entry->stmt_cache == NULL)
+		return;
+
+	hash_seq_init(&scan, entry->stmt_cache);
+	while ((stmt_entry = (StmtCacheEntry *) hash_seq_search(&scan)))
+	{
+		if (stmt_entry->in_use && stmt_entry->nest_level >= nestlevel)
+			stmt_entry->nest_level = nestlevel - 1;
+	}
+}
+
+/*
+ * Finalize all cached statements before their connections are closed.
+ */
+static void
+sqlite_clear_stmt_cache(ConnCacheEntry *entry)
+{
+	HASH_SEQ_STATUS scan;
+	StmtCacheEntry *stmt_entry;
+
+	if (entry->stmt_cache == NULL)
+		return;
+
+	hash_seq_init(&scan, entry->stmt_cache);
+	while ((stmt_entry = (StmtCacheEntry *) hash_seq_search(&scan)))
+	{
+		elog(DEBUG1, "sqlite_fdw: finalize %s", stmt_entry->key.sql);
+		sqlite3_finalize(stmt_entry->stmt);
+		pfree((char *) stmt_entry->key.sql);
+	}
+	hash_destroy(entry->stmt_cache);
+	entry->stmt_cache = NULL;
+}
+
+/*
+ * Hash function of the statement cache: SQL text and connection
+ */
+static uint32
+sqlite_stmt_cache_hash(const void *key, Size keysize)
+{
+	const StmtCacheKey *k = (const StmtCacheKey *) key;
+
+	return string_hash(k->sql, strlen(k->sql) + 1) ^
+		tag_hash(&k->conn, sizeof(k->conn));
+}
+
+static int
+sqlite_stmt_cache_match(const void *key1, const void *key2, Size keysize)
+{
+	const StmtCacheKey *k1 = (const StmtCacheKey *) key1;
+	const StmtCacheKey *k2 = (const StmtCacheKey *) key2;
+
+	if (k1->conn != k2->conn)
+		return 1;
+	return strcmp(k1->sql, k2->sql);
 }
 
 /*
@@ -129,17 +129,25 @@ static void sqlite_deparse_relation(StringInfo buf, Relation rel);
 static void sqlite_deparse_target_list(StringInfo buf, PlannerInfo *root, Index rtindex, Relation rel,
 									   Bitmapset *attrs_used, bool qualify_col, List **retrieved_attrs, bool is_concat, bool check_null);
 static void sqlite_deparse_column_ref(StringInfo buf, int varno, int varattno, PlannerInfo *root, bool qualify_col, bool dml_context);
+static void sqlite_deparse_column_name(StringInfo buf, Oid relid, int varno, int varattno, bool qualify_col, bool dml_context);
+static void sqlite_deparse_key_column(StringInfo buf, Oid relid, int varattno);
+static void sqlite_deparse_returning_list(StringInfo buf, Index rtindex, Relation rel,
+										  bool trig_after_row, List *withCheckOptionList,
+										  List *returningList, List **retrieved_attrs);
 static void sqlite_deparse_select(List *tlist, List **retrieved_attrs, deparse_expr_cxt *context);
 static void sqlite_deparse_case_expr(CaseExpr *node, deparse_expr_cxt *context);
 static void sqlite_deparse_null_if_expr(NullIfExpr *node, deparse_expr_cxt *context);
 static void sqlite_deparse_coalesce_expr(CoalesceExpr *node, deparse_expr_cxt *context);
 static void sqlite_deparse_from_expr_for_rel(StringInfo buf, PlannerInfo *root, RelOptInfo *foreignrel,
 											 bool use_alias, Index ignore_rel, List **ignore_conds,
-											 List **params_list);
+											 List **additional_conds, List **params_list);
 static void sqlite_deparse_range_tbl_ref(StringInfo buf, PlannerInfo *root,
 										 RelOptInfo *foreignrel, bool make_subquery,
-										 Index ignore_rel, List **ignore_conds, List **params_list);
+										 Index ignore_rel, List **ignore_conds,
+										 List **additional_conds, List **params_list);
 static void sqlite_deparse_from_expr(List *quals, deparse_expr_cxt *context);
+static void sqlite_append_where_clause(List *exprs, List *additional_conds,
+									   deparse_expr_cxt *context);
 static void sqlite_deparse_aggref(Aggref *node, deparse_expr_cxt *context);
 static void sqlite_append_limit_clause(deparse_expr_cxt *context);
 static void sqlite_append_conditions(List *exprs, deparse_expr_cxt *context);
@@ -169,12 +177,11 @@ static bool sqlite_deparsable_data_type(Param *p);
 static int preferred_sqlite_affinity (Oid relid, int varattno);
 
 /*
- * Append remote name of specified foreign table to buf.
- * Use value of table_name FDW option (if any) instead of relation's name.
- * Similarly, schema_name FDW option overrides schema name.
+ * Get remote name of specified foreign table.
+ * Use value of table FDW option (if any) instead of relation's name.
  */
-static void
-sqlite_deparse_relation(StringInfo buf, Relation rel)
+static const char *
+sqlite_get_remote_relname(Relation rel)
 {
 	ForeignTable *table;
 	const char *relname = NULL;
@@ -197,6 +204,19 @@ sqlite_deparse_relation(StringInfo buf, Relation rel)
 	if (relname == NULL)
 		relname = RelationGetRelationName(rel);
 
+	return relname;
+}
+
+/*
+ * Append remote name of specified foreign table to buf.
+ * Use value of table_name FDW option (if any) instead of relation's name.
+ * Similarly, schema_name FDW option overrides schema name.
+ */
+static void
+sqlite_deparse_relation(StringInfo buf, Relation rel)
+{
+	const char *relname = sqlite_get_remote_relname(rel);
+
 	/* always use main database for SQLite */
 	appendStringInfo(buf, "%s.%s", "main", sqlite_quote_identifier(relname, QUOTE));
 }
@@ -1382,6 +1402,7 @@ sqlite_deparse_from_expr(List *quals, deparse_expr_cxt *context)
 {
 	StringInfo	buf = context->buf;
 	RelOptInfo *scanrel = context->scanrel;
+	List	   *additional_conds = NIL;
 
 	/* For upper relations, scanrel must be either a joinrel or a baserel */
 	Assert(!IS_UPPER_REL(context->foreignrel) ||
@@ -1392,14 +1413,42 @@ sqlite_deparse_from_expr(List *quals, deparse_expr_cxt *context)
 	appendStringInfoString(buf, " FROM ");
 	sqlite_deparse_from_expr_for_rel(buf, context->root, scanrel,
 									 (bms_num_members(scanrel->relids) == BMS_MULTIPLE),
-									 (Index) 0, NULL,
+									 (Index) 0, NULL, &additional_conds,
 									 context->params_list);
 
 	/* Construct WHERE clause */
-	if (quals != NIL)
+	sqlite_append_where_clause(quals, additional_conds, context);
+	if (additional_conds != NIL)
+		list_free_deep(additional_conds);
+}
+
+/*
+ * Append WHERE clause, containing conditions from exprs and additional_conds,
+ * to context->buf.  additional_conds are the already deparsed EXISTS
+ * conditions of semi-joins and anti-joins.
+ */
+static void
+sqlite_append_where_clause(List *exprs, List *additional_conds, deparse_expr_cxt *context)
+{
+	StringInfo	buf = context->buf;
+	bool		need_and = false;
+	ListCell   *lc;
+
+	if (exprs != NIL || additional_conds != NIL)
+		appendStringInfoString(buf, " WHERE ");
+
+	if (exprs != NIL)
+	{
+		sqlite_append_conditions(exprs, context);
+		need_and = true;
+	}
+
+	foreach(lc, additional_conds)
 	{
-		appendStringInfo(buf, " WHERE ");
-		sqlite_append_conditions(quals, context);
+		if (need_and)
+			appendStringInfoString(buf, " AND ");
+		appendStringInfoString(buf, (char *) lfirst(lc));
+		need_and = true;
 	}
 }
 
@@ -1461,6 +1510,12 @@ sqlite_get_jointype_name(JoinType jointype)
 		case JOIN_FULL:
 			return "FULL";
 
+		case JOIN_SEMI:
+			return "SEMI";
+
+		case JOIN_ANTI:
+			return "ANTI";
+
 		default:
 			/* Shouldn't come here, but protect from buggy code. */
 			elog(ERROR, "unsupported join type %d", jointype);
@@ -1512,11 +1567,16 @@ sqlite_deparse_explicit_target_list(List *tlist, List **retrieved_attrs,
  * The function constructs ... JOIN ... ON ... for join relation. For a base
  * relation it just returns schema-qualified tablename, with the appropriate
  * alias if so requested.
+ *
+ * A semi-join or an anti-join contributes only its outer relation to the
+ * FROM clause.  Its inner relation and join clauses become an EXISTS or NOT
+ * EXISTS condition, which is appended to *additional_conds for the caller to
+ * put into the WHERE clause.
  */
 static void
 sqlite_deparse_from_expr_for_rel(StringInfo buf, PlannerInfo *root, RelOptInfo *foreignrel,
 								 bool use_alias, Index ignore_rel, List **ignore_conds,
-								 List **params_list)
+								 List **additional_conds, List **params_list)
 {
 	if (IS_JOIN_REL(foreignrel))
 	{
@@ -1527,6 +1587,14 @@ sqlite_deparse_from_expr_for_rel(StringInfo buf, PlannerInfo *root, RelOptInfo *
 		RelOptInfo *innerrel = fpinfo->innerrel;
 		bool		outerrel_is_target = false;
 		bool		innerrel_is_target = false;
+		List	   *additional_conds_i = NIL;
+
+		/*
+		 * Joins are deparsed only into SELECT statements, because
+		 * sqlitePlanDirectModify() doesn't push down UPDATE or DELETE of a
+		 * join.  So there is always a list to pass EXISTS conditions up in.
+		 */
+		Assert(additional_conds != NULL);
 
 		if (ignore_rel > 0 && bms_is_member(ignore_rel, foreignrel->relids))
 		{
@@ -1563,7 +1631,8 @@ sqlite_deparse_from_expr_for_rel(StringInfo buf, PlannerInfo *root, RelOptInfo *
 			initStringInfo(&join_sql_o);
 			sqlite_deparse_range_tbl_ref(&join_sql_o, root, outerrel,
 										 fpinfo->make_outerrel_subquery,
-										 ignore_rel, ignore_conds, params_list);
+										 ignore_rel, ignore_conds, additional_conds,
+										 params_list);
 
 			/*
 			 * If inner relation is the target relation, skip deparsing it.
@@ -1589,7 +1658,8 @@ sqlite_deparse_from_expr_for_rel(StringInfo buf, PlannerInfo *root, RelOptInfo *
 			initStringInfo(&join_sql_i);
 			sqlite_deparse_range_tbl_ref(&join_sql_i, root, innerrel,
 										 fpinfo->make_innerrel_subquery,
-										 ignore_rel, ignore_conds, params_list);
+										 ignore_rel, ignore_conds, &additional_conds_i,
+										 params_list);
 
 			/*
 			 * If outer relation is the target relation, skip deparsing it.
@@ -1607,6 +1677,43 @@ sqlite_deparse_from_expr_for_rel(StringInfo buf, PlannerInfo *root, RelOptInfo *
 		/* Neither of the relations is the target relation. */
 		Assert(!outerrel_is_target && !innerrel_is_target);
 
+		if (fpinfo->jointype == JOIN_SEMI || fpinfo->jointype == JOIN_ANTI)
+		{
+			deparse_expr_cxt context;
+			StringInfoData cond;
+
+			/*
+			 * The condition is [NOT] EXISTS (SELECT NULL FROM (inner
+			 * relation) WHERE (joinclauses)).  The conditions of semi-joins
+			 * and anti-joins within the inner relation belong to the
+			 * subquery.
+			 */
+			initStringInfo(&cond);
+			appendStringInfo(&cond, "%sEXISTS (SELECT NULL FROM %s",
+							 fpinfo->jointype == JOIN_ANTI ? "NOT " : "",
+							 join_sql_i.data);
+
+			context.buf = &cond;
+			context.foreignrel = foreignrel;
+			context.scanrel = foreignrel;
+			context.root = root;
+			context.params_list = params_list;
+
+			sqlite_append_where_clause(fpinfo->joinclauses, additional_conds_i, &context);
+			appendStringInfoChar(&cond, ')');
+
+			if (additional_conds_i != NIL)
+			{
+				list_free_deep(additional_conds_i);
+				additional_conds_i = NIL;
+			}
+			*additional_conds = lappend(*additional_conds, cond.data);
+
+			/* Only the outer relation is in the FROM clause */
+			appendBinaryStringInfo(buf, join_sql_o.data, join_sql_o.len);
+			return;
+		}
+
 		/*
 		 * For a join relation FROM clause entry is deparsed as ((outer
 		 * relation) <join type> (inner relation) ON (joinclauses))
@@ -1634,6 +1741,14 @@ sqlite_deparse_from_expr_for_rel(StringInfo buf, PlannerInfo *root, RelOptInfo *
 
 		/* End the FROM clause entry. */
 		appendStringInfo(buf, ")");
+
+		/*
+		 * The inner relation of an inner join can contain semi-joins, whose
+		 * conditions are passed up together with those of the outer
+		 * relation.  sqlite_foreign_join_ok() does not allow this for the
+		 * inner relation of an outer join.
+		 */
+		*additional_conds = list_concat(*additional_conds, additional_conds_i);
 	}
 	else
 	{
@@ -1665,7 +1780,7 @@ sqlite_deparse_from_expr_for_rel(StringInfo buf, PlannerInfo *root, RelOptInfo *
 static void
 sqlite_deparse_range_tbl_ref(StringInfo buf, PlannerInfo *root, RelOptInfo *foreignrel,
 							 bool make_subquery, Index ignore_rel, List **ignore_conds,
-							 List **params_list)
+							 List **additional_conds, List **params_list)
 {
 	SqliteFdwRelationInfo *fpinfo = (SqliteFdwRelationInfo *) foreignrel->fdw_private;
 
@@ -1723,7 +1838,7 @@ sqlite_deparse_range_tbl_ref(StringInfo buf, PlannerInfo *root, RelOptInfo *fore
 	}
 	else
 		sqlite_deparse_from_expr_for_rel(buf, root, foreignrel, true, ignore_rel,
-										 ignore_conds, params_list);
+										 ignore_conds, additional_conds, params_list);
 }
 
 /*
@@ -1731,13 +1846,15 @@ sqlite_deparse_range_tbl_ref(StringInfo buf, PlannerInfo *root, RelOptInfo *fore
  *
  * The statement text is appended to buf, and we also create an integer List
  * of the columns being retrieved by RETURNING (if any), which is returned
- * to *retrieved_attrs.
+ * to *retrieved_attrs.  root may be NULL when the statement is built at
+ * execution time for COPY or tuple routing.
  */
 void
 sqlite_deparse_insert(StringInfo buf, PlannerInfo *root,
 					  Index rtindex, Relation rel,
 					  List *targetAttrs, bool doNothing,
-					  int *values_end_len)
+					  List *withCheckOptionList, List *returningList,
+					  List **retrieved_attrs, int *values_end_len)
 {
 #if PG_VERSION_NUM >= 140000
 	TupleDesc	tupdesc = RelationGetDescr(rel);
@@ -1795,7 +1912,7 @@ sqlite_deparse_insert(StringInfo buf, PlannerInfo *root,
 					appendStringInfoString(buf, ", ");
 				first = false;
 
-				sqlite_deparse_column_ref(buf, rtindex, attnum, root, false, true);
+				sqlite_deparse_column_name(buf, RelationGetRelid(rel), rtindex, attnum, false, true);
 #if PG_VERSION_NUM >= 140000
 			}
 #endif
@@ -1829,6 +1946,10 @@ sqlite_deparse_insert(StringInfo buf, PlannerInfo *root,
 	else
 		appendStringInfoString(buf, " DEFAULT VALUES");
 	*values_end_len = buf->len;
+
+	sqlite_deparse_returning_list(buf, rtindex, rel,
+								  rel->trigdesc && rel->trigdesc->trig_insert_after_row,
+								  withCheckOptionList, returningList, retrieved_attrs);
 }
 
 #if PG_VERSION_NUM >= 140000
@@ -1886,13 +2007,105 @@ sqlite_rebuild_insert(StringInfo buf, Relation rel, char *orig_query,
 }
 #endif
 
+/*
+ * Construct SELECT statement to acquire sample rows of given relation.
+ *
+ * SELECT command is appended to buf, and list of columns retrieved
+ * is returned to *retrieved_attrs.  Columns are normalized the same way
+ * as for an ordinary foreign scan.
+ */
 void
-sqlite_deparse_analyze(StringInfo sql, char *dbname, char *relname)
+sqlite_deparse_analyze(StringInfo buf, Relation rel, List **retrieved_attrs)
 {
-	appendStringInfo(sql, "SELECT");
-	appendStringInfo(sql, " round(((data_length + index_length)), 2)");
-	appendStringInfo(sql, " FROM information_schema.TABLES");
-	appendStringInfo(sql, " WHERE table_schema = '%s' AND table_name = '%s'", dbname, relname);
+	Oid			relid = RelationGetRelid(rel);
+	TupleDesc	tupdesc = RelationGetDescr(rel);
+	bool		first = true;
+	int			i;
+
+	*retrieved_attrs = NIL;
+
+	appendStringInfoString(buf, "SELECT ");
+	for (i = 0; i < tupdesc->natts; i++)
+	{
+		/* Ignore dropped columns. */
+		if (TupleDescAttr(tupdesc, i)->attisdropped)
+			continue;
+
+		if (!first)
+			appendStringInfoString(buf, ", ");
+		first = false;
+
+		sqlite_deparse_column_name(buf, relid, 0, i + 1, false, false);
+
+		*retrieved_attrs = lappend_int(*retrieved_attrs, i + 1);
+	}
+
+	/* Don't generate bad syntax for zero-column relation. */
+	if (first)
+		appendStringInfoString(buf, "NULL");
+
+	appendStringInfoString(buf, " FROM ");
+	sqlite_deparse_relation(buf, rel);
+}
+
+/*
+ * Construct SELECT statement to count the rows of given relation.
+ */
+void
+sqlite_deparse_analyze_info_sql(StringInfo buf, Relation rel)
+{
+	appendStringInfoString(buf, "SELECT count(*) FROM ");
+	sqlite_deparse_relation(buf, rel);
+}
+
+/*
+ * Construct SELECT statement to get the number of rows of given relation
+ * from sqlite_stat1 table, which is filled by ANALYZE command of SQLite.
+ * The first integer of each statistics row is the number of rows in the
+ * table or in the index.
+ */
+void
+sqlite_deparse_remote_tuples_sql(StringInfo buf, Relation rel)
+{
+	appendStringInfoString(buf, "SELECT CAST(stat AS integer) FROM sqlite_stat1 WHERE tbl = ");
+	sqlite_deparse_string_literal(buf, sqlite_get_remote_relname(rel));
+	appendStringInfoString(buf, " ORDER BY idx IS NOT NULL LIMIT 1");
+}
+
+/*
+ * Construct SELECT statement to get the size in bytes of given relation
+ * from the SQLite dbstat virtual table, which is available only if SQLite
+ * was compiled with SQLITE_ENABLE_DBSTAT_VTAB.
+ */
+void
+sqlite_deparse_analyze_size_sql(StringInfo buf, Relation rel)
+{
+	appendStringInfoString(buf, "SELECT sum(pgsize) FROM dbstat WHERE name = ");
+	sqlite_deparse_string_literal(buf, sqlite_get_remote_relname(rel));
+}
+
+/*
+ * Construct SELECT statement to get the smallest or the largest rowid of
+ * given relation.  SQLite finds both of them from the table b-tree directly.
+ * Preparing this statement fails for WITHOUT ROWID tables and views.
+ */
+void
+sqlite_deparse_rowid_bound_sql(StringInfo buf, Relation rel, bool is_max)
+{
+	appendStringInfo(buf, "SELECT %s(rowid) FROM ", is_max ? "max" : "min");
+	sqlite_deparse_relation(buf, rel);
+}
+
+/*
+ * Append the rowid range condition of a parallel scan to the SELECT statement
+ * of a base relation.  Its bounds are bound as the last two parameters of the
+ * statement.
+ */
+void
+sqlite_append_rowid_range_cond(StringInfo buf, bool is_first)
+{
+	appendStringInfoString(buf, is_first ? " WHERE " : " AND ");
+	appendStringInfoString(buf, "(rowid BETWEEN ? AND ?)");
 }
 
 /*
@@ -1958,6 +2171,25 @@ sqlite_deparse_target_list(StringInfo buf,
 		}
 	}
 
+	/*
+	 * ctid is only fetched for the rows to be updated or deleted by their
+	 * SQLite rowid, see sqliteAddForeignUpdateTargets.
+	 */
+	if (!is_concat && !check_null &&
+		bms_is_member(SelfItemPointerAttributeNumber - FirstLowInvalidHeapAttributeNumber,
+					  attrs_used))
+	{
+		if (!first)
+			appendStringInfoString(buf, ", ");
+		first = false;
+
+		if (qualify_col)
+			ADD_REL_QUALIFIER(buf, rtindex);
+		appendStringInfoString(buf, "rowid");
+
+		*retrieved_attrs = lappend_int(*retrieved_attrs, SelfItemPointerAttributeNumber);
+	}
+
 	/* Don't generate bad syntax if no undropped columns */
 	if (first)
 		appendStringInfoString(buf, "NULL");
@@ -2101,82 +2333,110 @@ sqlite_deparse_column_ref(StringInfo buf, int varno, int varattno, PlannerInfo *
 	}
 	else
 	{
-		char	   *colname = NULL;
-		List	   *options;
-		ListCell   *lc;
-		Oid			pg_atttyp = 0;
-
 		/* varno must not be any of OUTER_VAR, INNER_VAR and INDEX_VAR. */
 		Assert(!IS_SPECIAL_VARNO(varno));
 
-		/*
-		 * If it's a column of a foreign table, and it has the column_name FDW
-		 * option, use that value.
-		 */
-		options = GetForeignColumnOptions(rte->relid, varattno);
-		foreach(lc, options)
-		{
-			DefElem	*def = (DefElem *) lfirst(lc);
+		sqlite_deparse_column_name(buf, rte->relid, varno, varattno, qualify_col, dml_context);
+	}
+}
 
-			if (strcmp(def->defname, "column_name") == 0)
-			{
-				colname = defGetString(def);
-				elog(DEBUG3, "sqlite_fdw : %s, column_name opt = %s\n", __func__, colname);
-				break;
-			}
+/*
+ * Emit the remote name of the column varattno of the foreign table relid,
+ * wrapped into a data normalization function if the column is read outside
+ * of a DML context and its values can have mixed affinity.  The relation is
+ * qualified by the varno alias if asked.
+ */
+static void
+sqlite_deparse_column_name(StringInfo buf, Oid relid, int varno, int varattno, bool qualify_col, bool dml_context)
+{
+	char	   *colname = NULL;
+	List	   *options;
+	ListCell   *lc;
+	Oid			pg_atttyp = 0;
+	bool		normalize;
+
+	/*
+	 * If it's a column of a foreign table, and it has the column_name FDW
+	 * option, use that value.
+	 */
+	options = GetForeignColumnOptions(relid, varattno);
+	foreach(lc, options)
+	{
+		DefElem	*def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "column_name") == 0)
+		{
+			colname = defGetString(def);
+			elog(DEBUG3, "sqlite_fdw : %s, column_name opt = %s\n", __func__, colname);
+			break;
 		}
+	}
 
-		/*
-		 * If it's a column of a regular table or it doesn't have column_name
-		 * FDW option, use attribute name.
-		 */
-		if (colname == NULL)
+	/*
+	 * If it's a column of a regular table or it doesn't have column_name
+	 * FDW option, use attribute name.
+	 */
+	if (colname == NULL)
 #if (PG_VERSION_NUM >= 110000)
-			colname = get_attname(rte->relid, varattno, false);
+		colname = get_attname(relid, varattno, false);
 #else
-			colname = get_attname(rte->relid, varattno);
+		colname = get_attname(relid, varattno);
 #endif
-		pg_atttyp = get_atttype(rte->relid, varattno);
+	pg_atttyp = get_atttype(relid, varattno);
 
-		/* PostgreSQL data types with possible mixed affinity SQLite base we should
-		 * normalize to preferred form in SQLite before transfer to PostgreSQL.
-		 * Recommended form for normalisation is someone from 1<->1 with PostgreSQL
-		 * internal storage, hence usually this will not original text data.
-		 */
-		if (!dml_context && ( pg_atttyp == FLOAT8OID || pg_atttyp == FLOAT4OID || pg_atttyp == NUMERICOID) )
-		{
-			elog(DEBUG2, "sqlite_fdw : %s, varattrno != 0, floatN unification for \"%s\"", __func__, colname);
-			appendStringInfoString(buf, "sqlite_fdw_float(");
-			if (qualify_col)
-				ADD_REL_QUALIFIER(buf, varno);
-			appendStringInfoString(buf, sqlite_quote_identifier(colname, '`'));
-			appendStringInfoString(buf, ")");
-		}
-		else if (!dml_context && pg_atttyp == BOOLOID)
-		{
-			elog(DEBUG2, "sqlite_fdw : %s, varattrno != 0, boolean unification for \"%s\"", __func__, colname);
-			appendStringInfoString(buf, "sqlite_fdw_bool(");
-			if (qualify_col)
-				ADD_REL_QUALIFIER(buf, varno);
-			appendStringInfoString(buf, sqlite_quote_identifier(colname, '`'));
-			appendStringInfoString(buf, ")");
-		}
-		else if (!dml_context && pg_atttyp == UUIDOID)
-		{
-			elog(DEBUG2, "sqlite_fdw : %s, varattrno != 0, UUID unification for \"%s\"", __func__, colname);
-			appendStringInfoString(buf, "sqlite_fdw_uuid_blob(");
-			if (qualify_col)
-				ADD_REL_QUALIFIER(buf, varno);
-			appendStringInfoString(buf, sqlite_quote_identifier(colname, '`'));
-			appendStringInfoString(buf, ")");
-		}
-		else
-		{
-			elog(DEBUG3, "sqlite_fdw : %s, varattrno != 0, not unificated column \"%s\"", __func__, colname);
-			if (qualify_col)
-				ADD_REL_QUALIFIER(buf, varno);
-			appendStringInfoString(buf, sqlite_quote_identifier(colname, '`'));
-		}
+	/*
+	 * Values of a strict column need no normalization, and a bare column
+	 * keeps conditions and sort keys sargable, so SQLite can use an index.
+	 */
+	normalize = !dml_context;
+	if (normalize &&
+		(pg_atttyp == FLOAT8OID || pg_atttyp == FLOAT4OID ||
+		 pg_atttyp == NUMERICOID || pg_atttyp == BOOLOID ||
+		 pg_atttyp == UUIDOID) &&
+		sqlite_column_is_strict(relid, varattno))
+	{
+		elog(DEBUG3, "sqlite_fdw : %s, varattrno != 0, strict column \"%s\"", __func__, colname);
+		normalize = false;
+	}
+
+	/* PostgreSQL data types with possible mixed affinity SQLite base we should
+	 * normalize to preferred form in SQLite before transfer to PostgreSQL.
+	 * Recommended form for normalisation is someone from 1<->1 with PostgreSQL
+	 * internal storage, hence usually this will not original text data.
+	 */
+	if (normalize && ( pg_atttyp == FLOAT8OID || pg_atttyp == FLOAT4OID || pg_atttyp == NUMERICOID) )
+	{
+		elog(DEBUG2, "sqlite_fdw : %s, varattrno != 0, floatN unification for \"%s\"", __func__, colname);
+		appendStringInfoString(buf, "sqlite_fdw_float(");
+		if (qualify_col)
+			ADD_REL_QUALIFIER(buf, varno);
+		appendStringInfoString(buf, sqlite_quote_identifier(colname, '`'));
+		appendStringInfoString(buf, ")");
+	}
+	else if (normalize && pg_atttyp == BOOLOID)
+	{
+		elog(DEBUG2, "sqlite_fdw : %s, varattrno != 0, boolean unification for \"%s\"", __func__, colname);
+		appendStringInfoString(buf, "sqlite_fdw_bool(");
+		if (qualify_col)
+			ADD_REL_QUALIFIER(buf, varno);
+		appendStringInfoString(buf, sqlite_quote_identifier(colname, '`'));
+		appendStringInfoString(buf, ")");
+	}
+	else if (normalize && pg_atttyp == UUIDOID)
+	{
+		elog(DEBUG2, "sqlite_fdw : %s, varattrno != 0, UUID unification for \"%s\"", __func__, colname);
+		appendStringInfoString(buf, "sqlite_fdw_uuid_blob(");
+		if (qualify_col)
+			ADD_REL_QUALIFIER(buf, varno);
+		appendStringInfoString(buf, sqlite_quote_identifier(colname, '`'));
+		appendStringInfoString(buf, ")");
+	}
+	else
+	{
+		elog(DEBUG3, "sqlite_fdw : %s, varattrno != 0, not unificated column \"%s\"", __func__, colname);
+		if (qualify_col)
+			ADD_REL_QUALIFIER(buf, varno);
+		appendStringInfoString(buf, sqlite_quote_identifier(colname, '`'));
 	}
 }
 
@@ -2325,7 +2585,9 @@ sqlite_deparse_expr(Expr *node, deparse_expr_cxt *context)
 void
 sqlite_deparse_update(StringInfo buf, PlannerInfo *root,
 					  Index rtindex, Relation rel,
-					  List *targetAttrs, List *attnums)
+					  List *targetAttrs, List *attnums,
+					  List *withCheckOptionList, List *returningList,
+					  List **retrieved_attrs)
 {
 #if PG_VERSION_NUM >= 140000
 	TupleDesc	tupdesc = RelationGetDescr(rel);
@@ -2366,10 +2628,14 @@ sqlite_deparse_update(StringInfo buf, PlannerInfo *root,
 		int			attnum = lfirst_int(lc);
 
 		appendStringInfo(buf, i == 0 ? " WHERE " : " AND ");
-		sqlite_deparse_column_ref(buf, rtindex, attnum, root, false, true);
+		sqlite_deparse_key_column(buf, RelationGetRelid(rel), attnum);
 		appendStringInfo(buf, "=?");
 		i++;
 	}
+
+	sqlite_deparse_returning_list(buf, rtindex, rel,
+								  rel->trigdesc && rel->trigdesc->trig_update_after_row,
+								  withCheckOptionList, returningList, retrieved_attrs);
 }
 
 /*
@@ -2423,6 +2689,7 @@ sqlite_deparse_direct_update_sql(StringInfo buf, PlannerInfo *root,
 								 List *targetAttrs,
 								 List *remote_conds,
 								 List **params_list,
+								 List *returningList,
 								 List **retrieved_attrs)
 {
 	deparse_expr_cxt context;
@@ -2505,7 +2772,7 @@ sqlite_deparse_direct_update_sql(StringInfo buf, PlannerInfo *root,
 
 		appendStringInfo(buf, " FROM ");
 		sqlite_deparse_from_expr_for_rel(buf, root, foreignrel, true, rtindex,
-										 &ignore_conds, params_list);
+										 &ignore_conds, NULL, params_list);
 		remote_conds = list_concat(remote_conds, ignore_conds);
 	}
 
@@ -2514,6 +2781,9 @@ sqlite_deparse_direct_update_sql(StringInfo buf, PlannerInfo *root,
 		appendStringInfoString(buf, " WHERE ");
 		sqlite_append_conditions(remote_conds, &context);
 	}
+
+	sqlite_deparse_returning_list(buf, rtindex, rel, false, NIL,
+								  returningList, retrieved_attrs);
 }
 
 /*
@@ -2526,7 +2796,8 @@ sqlite_deparse_direct_update_sql(StringInfo buf, PlannerInfo *root,
 void
 sqlite_deparse_delete(StringInfo buf, PlannerInfo *root,
 					  Index rtindex, Relation rel,
-					  List *attname)
+					  List *attname, List *returningList,
+					  List **retrieved_attrs)
 {
 	int			i = 0;
 	ListCell   *lc;
@@ -2538,10 +2809,68 @@ sqlite_deparse_delete(StringInfo buf, PlannerInfo *root,
 		int			attnum = lfirst_int(lc);
 
 		appendStringInfo(buf, i == 0 ? " WHERE " : " AND ");
-		sqlite_deparse_column_ref(buf, rtindex, attnum, root, false, true);
+		sqlite_deparse_key_column(buf, RelationGetRelid(rel), attnum);
 		appendStringInfo(buf, "=?");
 		i++;
 	}
+
+	sqlite_deparse_returning_list(buf, rtindex, rel,
+								  rel->trigdesc && rel->trigdesc->trig_delete_after_row,
+								  NIL, returningList, retrieved_attrs);
+}
+
+/*
+ * Emit a column which identifies the rows of UPDATE and DELETE: a key
+ * column, or the SQLite rowid if the row identity is ctid.
+ */
+static void
+sqlite_deparse_key_column(StringInfo buf, Oid relid, int varattno)
+{
+	if (varattno == SelfItemPointerAttributeNumber)
+		appendStringInfoString(buf, "rowid");
+	else
+		sqlite_deparse_column_name(buf, relid, 0, varattno, false, true);
+}
+
+/*
+ * Construct DELETE statement of num_rows rows identified by the values of
+ * the key columns key_attrs, used by batched foreign modification.
+ * Several key columns are compared as row values (SQLite 3.15.0 and later).
+ */
+void
+sqlite_deparse_batch_delete(StringInfo buf, Relation rel, List *key_attrs,
+							int num_rows)
+{
+	Oid			relid = RelationGetRelid(rel);
+	int			num_keys = list_length(key_attrs);
+	bool		first = true;
+	ListCell   *lc;
+	int			i;
+	int			j;
+
+	appendStringInfoString(buf, "DELETE FROM ");
+	sqlite_deparse_relation(buf, rel);
+	appendStringInfoString(buf, num_keys > 1 ? " WHERE (" : " WHERE ");
+	foreach(lc, key_attrs)
+	{
+		if (!first)
+			appendStringInfoString(buf, ", ");
+		first = false;
+		sqlite_deparse_key_column(buf, relid, lfirst_int(lc));
+	}
+	appendStringInfoString(buf, num_keys > 1 ? ") IN (VALUES " : " IN (");
+	for (i = 0; i < num_rows; i++)
+	{
+		if (i > 0)
+			appendStringInfoString(buf, ", ");
+		if (num_keys > 1)
+			appendStringInfoChar(buf, '(');
+		for (j = 0; j < num_keys; j++)
+			appendStringInfoString(buf, j == 0 ? "?" : ", ?");
+		if (num_keys > 1)
+			appendStringInfoChar(buf, ')');
+	}
+	appendStringInfoChar(buf, ')');
 }
 
 /*
@@ -2562,6 +2891,7 @@ sqlite_deparse_direct_delete_sql(StringInfo buf, PlannerInfo *root,
 								 RelOptInfo *foreignrel,
 								 List *remote_conds,
 								 List **params_list,
+								 List *returningList,
 								 List **retrieved_attrs)
 {
 	deparse_expr_cxt context;
@@ -2586,7 +2916,7 @@ sqlite_deparse_direct_delete_sql(StringInfo buf, PlannerInfo *root,
 
 		appendStringInfo(buf, " USING ");
 		sqlite_deparse_from_expr_for_rel(buf, root, foreignrel, true, rtindex,
-										 &ignore_conds, params_list);
+										 &ignore_conds, NULL, params_list);
 		remote_conds = list_concat(remote_conds, ignore_conds);
 	}
 
@@ -2595,6 +2925,82 @@ sqlite_deparse_direct_delete_sql(StringInfo buf, PlannerInfo *root,
 		appendStringInfoString(buf, " WHERE ");
 		sqlite_append_conditions(remote_conds, &context);
 	}
+
+	sqlite_deparse_returning_list(buf, rtindex, rel, false, NIL,
+								  returningList, retrieved_attrs);
+}
+
+/*
+ * Add a RETURNING clause, if needed, to an INSERT/UPDATE/DELETE.
+ *
+ * SQLite supports RETURNING since 3.35.0.  The clause is added only if the
+ * query has RETURNING; then the columns needed by AFTER ROW triggers and
+ * WITH CHECK OPTIONs are fetched as well, because the returned row replaces
+ * the one given to the executor.  The columns are normalized the same way
+ * as for a foreign scan, no table qualification is allowed here.
+ */
+static void
+sqlite_deparse_returning_list(StringInfo buf, Index rtindex, Relation rel,
+							  bool trig_after_row,
+							  List *withCheckOptionList,
+							  List *returningList,
+							  List **retrieved_attrs)
+{
+	TupleDesc	tupdesc = RelationGetDescr(rel);
+	Bitmapset  *attrs_used = NULL;
+	bool		have_wholerow;
+	bool		first;
+	int			i;
+
+	*retrieved_attrs = NIL;
+
+	if (returningList == NIL)
+		return;
+
+	if (trig_after_row)
+	{
+		/* whole-row reference acquires all non-system columns */
+		attrs_used =
+			bms_make_singleton(0 - FirstLowInvalidHeapAttributeNumber);
+	}
+
+	if (withCheckOptionList != NIL)
+		pull_varattnos((Node *) withCheckOptionList, rtindex,
+					   &attrs_used);
+
+	pull_varattnos((Node *) returningList, rtindex, &attrs_used);
+
+	have_wholerow = bms_is_member(0 - FirstLowInvalidHeapAttributeNumber,
+								  attrs_used);
+
+	first = true;
+	for (i = 1; i <= tupdesc->natts; i++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(tupdesc, i - 1);
+
+		/* Ignore dropped attributes. */
+		if (attr->attisdropped)
+			continue;
+
+		if (have_wholerow ||
+			bms_is_member(i - FirstLowInvalidHeapAttributeNumber,
+						  attrs_used))
+		{
+			appendStringInfoString(buf, first ? " RETURNING " : ", ");
+			first = false;
+			sqlite_deparse_column_name(buf, RelationGetRelid(rel), rtindex, i, false, false);
+			*retrieved_attrs = lappend_int(*retrieved_attrs, i);
+		}
+	}
+
+	/* ctid of the modified row is its SQLite rowid */
+	if (bms_is_member(SelfItemPointerAttributeNumber - FirstLowInvalidHeapAttributeNumber,
+					  attrs_used))
+	{
+		appendStringInfoString(buf, first ? " RETURNING " : ", ");
+		appendStringInfoString(buf, "rowid");
+		*retrieved_attrs = lappend_int(*retrieved_attrs, SelfItemPointerAttributeNumber);
+	}
 }
 
 /*
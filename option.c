@@ -44,10 +44,16 @@ static struct SqliteFdwOption valid_options[] =
 	{"database", ForeignServerRelationId},
 	{"keep_connections", ForeignServerRelationId},
 	{"force_readonly", ForeignServerRelationId},
+	{"snapshot_scan", ForeignServerRelationId},
+	{"stmt_cache_size", ForeignServerRelationId},
 	{"table", ForeignTableRelationId},
 	{"key", AttributeRelationId},
 	{"column_name", AttributeRelationId},
 	{"column_type", AttributeRelationId},
+	/* strict is available on table, strict_affinity on column */
+	{"strict", ForeignTableRelationId},
+	{"estimated_rows", ForeignTableRelationId},
+	{"strict_affinity", AttributeRelationId},
 	/* updatable is available on both server and table */
 	{"updatable", ForeignServerRelationId},
 	{"updatable", ForeignTableRelationId},
@@ -57,10 +63,40 @@ static struct SqliteFdwOption valid_options[] =
 	/* batch_size is available on both server and table */
 	{"batch_size", ForeignServerRelationId},
 	{"batch_size", ForeignTableRelationId},
+	/* use_remote_estimate is available on both server and table */
+	{"use_remote_estimate", ForeignServerRelationId},
+	{"use_remote_estimate", ForeignTableRelationId},
+	/* parallel_workers is available on both server and table */
+	{"parallel_workers", ForeignServerRelationId},
+	{"parallel_workers", ForeignTableRelationId},
+	/* async_capable is available on both server and table */
+	{"async_capable", ForeignServerRelationId},
+	{"async_capable", ForeignTableRelationId},
+	/* PRAGMAs applied when a connection to the server is opened */
+	{"journal_mode", ForeignServerRelationId},
+	{"synchronous", ForeignServerRelationId},
+	{"temp_store", ForeignServerRelationId},
+	{"cache_size", ForeignServerRelationId},
+	{"mmap_size", ForeignServerRelationId},
+	{"page_size_hint", ForeignServerRelationId},
+	{"busy_timeout", ForeignServerRelationId},
 	/* Sentinel */
 	{NULL, InvalidOid}
 };
 
+/*
+ * Values accepted by the PRAGMA options which take a keyword.
+ */
+static const char *const journal_mode_values[] =
+{"delete", "truncate", "persist", "memory", "wal", "off", NULL};
+static const char *const synchronous_values[] =
+{"off", "normal", "full", "extra", NULL};
+static const char *const temp_store_values[] =
+{"default", "file", "memory", NULL};
+
+static void sqlite_check_keyword_option(DefElem *def, const char *const *values);
+static int	sqlite_check_int_option(DefElem *def);
+
 extern PGDLLEXPORT Datum sqlite_fdw_validator(PG_FUNCTION_ARGS);
 
 PG_FUNCTION_INFO_V1(sqlite_fdw_validator);
@@ -147,7 +183,12 @@ sqlite_fdw_validator(PG_FUNCTION_ARGS)
 		if (strcmp(def->defname, "truncatable") == 0 ||
 			strcmp(def->defname, "keep_connections") == 0 ||
 			strcmp(def->defname, "updatable") == 0 ||
-			strcmp(def->defname, "force_readonly") == 0)
+			strcmp(def->defname, "force_readonly") == 0 ||
+			strcmp(def->defname, "snapshot_scan") == 0 ||
+			strcmp(def->defname, "use_remote_estimate") == 0 ||
+			strcmp(def->defname, "async_capable") == 0 ||
+			strcmp(def->defname, "strict") == 0 ||
+			strcmp(def->defname, "strict_affinity") == 0)
 		{
 			defGetBoolean(def);
 		}
@@ -172,10 +213,137 @@ sqlite_fdw_validator(PG_FUNCTION_ARGS)
 						 errmsg("\"%s\" must be an integer value greater than zero",
 								def->defname)));
 		}
+		else if (strcmp(def->defname, "parallel_workers") == 0)
+		{
+			char	   *value;
+			int			int_val;
+			bool		is_parsed;
+
+			value = defGetString(def);
+			is_parsed = parse_int(value, &int_val, 0, NULL);
+
+			if (!is_parsed)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid value for integer option \"%s\": %s",
+								def->defname, value)));
+
+			if (int_val < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("\"%s\" must be an integer value greater than or equal to zero",
+								def->defname)));
+		}
+		else if (strcmp(def->defname, "journal_mode") == 0)
+			sqlite_check_keyword_option(def, journal_mode_values);
+		else if (strcmp(def->defname, "synchronous") == 0)
+			sqlite_check_keyword_option(def, synchronous_values);
+		else if (strcmp(def->defname, "temp_store") == 0)
+			sqlite_check_keyword_option(def, temp_store_values);
+		else if (strcmp(def->defname, "cache_size") == 0)
+		{
+			/* negative values are a size in KiB, positive in pages */
+			sqlite_check_int_option(def);
+		}
+		else if (strcmp(def->defname, "busy_timeout") == 0 ||
+				 strcmp(def->defname, "stmt_cache_size") == 0)
+		{
+			if (sqlite_check_int_option(def) < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("\"%s\" must be an integer value greater than or equal to zero",
+								def->defname)));
+		}
+		else if (strcmp(def->defname, "page_size_hint") == 0)
+		{
+			int			int_val = sqlite_check_int_option(def);
+
+			if (int_val < 512 || int_val > 65536 || (int_val & (int_val - 1)) != 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("\"%s\" must be a power of two between 512 and 65536",
+								def->defname)));
+		}
+		else if (strcmp(def->defname, "mmap_size") == 0 ||
+				 strcmp(def->defname, "estimated_rows") == 0)
+		{
+			/* the mapping and the table can be larger than int, parse as int64 */
+			char	   *value = defGetString(def);
+			char	   *endptr;
+			long long	ll_val;
+
+			errno = 0;
+			ll_val = strtoll(value, &endptr, 10);
+
+			if (*value == '\0' || *endptr != '\0' || errno != 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("invalid value for integer option \"%s\": %s",
+								def->defname, value)));
+
+			if (ll_val < 0)
+				ereport(ERROR,
+						(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+						 errmsg("\"%s\" must be an integer value greater than or equal to zero",
+								def->defname)));
+		}
 	}
 	PG_RETURN_VOID();
 }
 
+/*
+ * Check that the value of a PRAGMA option is one of the given keywords.  The
+ * value is put into the PRAGMA statement as is, so nothing else is allowed.
+ */
+static void
+sqlite_check_keyword_option(DefElem *def, const char *const *values)
+{
+	char	   *value = defGetString(def);
+	const char *const *v;
+	StringInfoData buf;
+
+	for (v = values; *v != NULL; v++)
+	{
+		if (pg_strcasecmp(value, *v) == 0)
+			return;
+	}
+
+	initStringInfo(&buf);
+	for (v = values; *v != NULL; v++)
+		appendStringInfo(&buf, "%s%s", (buf.len > 0) ? ", " : "", *v);
+
+	ereport(ERROR,
+			(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+			 errmsg("invalid value for option \"%s\": %s",
+					def->defname, value),
+			 errhint("Valid values are: %s", buf.data)));
+}
+
+/*
+ * Check that the value of an option is a decimal integer and return it.  The
+ * value is put into the PRAGMA statement as is, so it must mean the same
+ * number to SQLite, which reads no octal, hexadecimal or fractional values.
+ */
+static int
+sqlite_check_int_option(DefElem *def)
+{
+	char	   *value = defGetString(def);
+	char	   *endptr;
+	long		long_val;
+
+	errno = 0;
+	long_val = strtol(value, &endptr, 10);
+
+	if (*value == '\0' || *endptr != '\0' || errno != 0 ||
+		long_val < PG_INT32_MIN || long_val > PG_INT32_MAX)
+		ereport(ERROR,
+				(errcode(ERRCODE_INVALID_PARAMETER_VALUE),
+				 errmsg("invalid value for integer option \"%s\": %s",
+						def->defname, value)));
+
+	return (int) long_val;
+}
+
 /*
  * Check if the provided option is one of the valid options.
  * context is the Oid of the catalog holding the object the option is for.
@@ -247,3 +415,35 @@ sqlite_get_options(Oid foreignoid)
 
 	return opt;
 }
+
+/*
+ * Check whether all values of a column of a foreign table are known to be
+ * stored in the SQLite storage class sqlite_fdw writes for the column data
+ * type, so no mixed affinity value has to be normalized.  The column option
+ * strict_affinity overrides the table option strict.
+ */
+bool
+sqlite_column_is_strict(Oid relid, AttrNumber attnum)
+{
+	ForeignTable *table;
+	ListCell   *lc;
+
+	foreach(lc, GetForeignColumnOptions(relid, attnum))
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "strict_affinity") == 0)
+			return defGetBoolean(def);
+	}
+
+	table = GetForeignTable(relid);
+	foreach(lc, table->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "strict") == 0)
+			return defGetBoolean(def);
+	}
+
+	return false;
+}
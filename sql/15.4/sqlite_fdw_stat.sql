@@ -0,0 +1,36 @@
+-- Statistics of remote statements, needs sqlite_fdw in shared_preload_libraries
+--Testcase 1:
+CREATE EXTENSION sqlite_fdw;
+--Testcase 2:
+CREATE SERVER sqlite_svr FOREIGN DATA WRAPPER sqlite_fdw
+OPTIONS (database '/tmp/sqlite_fdw_test/common.db');
+--Testcase 3:
+CREATE FOREIGN TABLE stat_u (u int, v text) SERVER sqlite_svr OPTIONS (table 'type_UNIQUE');
+--Testcase 4:
+SELECT sqlite_fdw_stat_statements_reset();
+--Testcase 5:
+SELECT v FROM stat_u WHERE u = 1;
+--Testcase 6:
+SELECT v FROM stat_u WHERE u = 2;
+--Testcase 7:
+SELECT v FROM stat_u WHERE u = 3;
+-- Queries differing only in constants share an entry
+--Testcase 8:
+SELECT query, calls, rows, total_time > 0 AS timed, min_time <= max_time AS min_max, vm_steps > 0 AS steps FROM sqlite_fdw_stat_statements;
+-- Statements of other users are hidden
+--Testcase 9:
+CREATE ROLE regress_sqlite_stat_user;
+--Testcase 10:
+SET ROLE regress_sqlite_stat_user;
+--Testcase 11:
+SELECT query, queryid IS NULL AS hidden, calls FROM sqlite_fdw_stat_statements;
+--Testcase 12:
+RESET ROLE;
+--Testcase 13:
+DROP ROLE regress_sqlite_stat_user;
+--Testcase 14:
+SELECT sqlite_fdw_stat_statements_reset();
+--Testcase 15:
+SELECT count(*) FROM sqlite_fdw_stat_statements;
+--Testcase 16:
+DROP EXTENSION sqlite_fdw CASCADE;
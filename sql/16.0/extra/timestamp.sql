@@ -161,6 +161,101 @@ explain (verbose, costs off)
 SELECT * FROM dates1
 WHERE date_as_number > (('2020-05-10 10:45:29')::timestamp);
 
+-- Text in the layout of SQLite date and time functions is parsed without timestamp_in()
+--Testcase 39:
+CREATE FOREIGN TABLE dates3 (
+	name text,
+	date_as_text text)
+SERVER sqlite_svr
+OPTIONS (table 'dates');
+
+--Testcase 40:
+CREATE FOREIGN TABLE dates4 (
+	name text,
+	date_as_text timestamp(2) without time zone)
+SERVER sqlite_svr
+OPTIONS (table 'dates');
+
+--Testcase 41:
+INSERT INTO dates3 (name, date_as_text) VALUES
+	('Fraction', '2020-05-12 11:45:31.25'),
+	('DateOnly', '2020-05-12'),
+	('ISO8601', '2020-05-12T11:45:31'),
+	('Rounded', '2020-05-12 11:45:31.129'),
+	('Other', 'May 12 2020 11:45');
+
+--Testcase 42:
+INSERT INTO dates4 (name, date_as_text) VALUES
+	('Bound', '2020-05-12 11:45:31.5'),
+	('BoundBC', '0044-03-15 12:00:00 BC');
+
+--Testcase 43:
+SELECT name, to_char(date_as_text, 'YYYY-MM-DD HH24:MI:SS.US') AS date_as_text
+FROM dates4 WHERE name NOT LIKE '%Date' AND name <> 'BoundBC' ORDER BY name;
+
+--Testcase 44:
+SELECT name, date_as_text FROM dates3 WHERE name LIKE 'Bound%' ORDER BY name;
+
+-- date, time and timestamptz with an explicit offset are parsed the same way
+--Testcase 48:
+CREATE FOREIGN TABLE dates5 (
+	name text,
+	date_as_text date)
+SERVER sqlite_svr
+OPTIONS (table 'dates');
+
+--Testcase 49:
+CREATE FOREIGN TABLE dates6 (
+	name text,
+	date_as_text time(2) without time zone)
+SERVER sqlite_svr
+OPTIONS (table 'dates');
+
+--Testcase 50:
+CREATE FOREIGN TABLE dates7 (
+	name text,
+	date_as_text timestamp with time zone)
+SERVER sqlite_svr
+OPTIONS (table 'dates');
+
+--Testcase 51:
+INSERT INTO dates3 (name, date_as_text) VALUES
+	('TimeFraction', '11:45:31.25'),
+	('TimeRounded', '11:45:31.129'),
+	('TimeOther', '11:45 PM'),
+	('TzOffset', '2020-05-12 11:45:31.25+02'),
+	('TzZulu', '2020-05-12T11:45:31Z'),
+	('TzOther', '2020-05-12 11:45:31 -03:30');
+
+--Testcase 52:
+SELECT name, to_char(date_as_text, 'YYYY-MM-DD') AS date_as_text
+FROM dates5 WHERE name IN ('DateOnly', 'Fraction', 'Other') ORDER BY name;
+
+--Testcase 53:
+SELECT name, date_as_text FROM dates6 WHERE name LIKE 'Time%' ORDER BY name;
+
+--Testcase 54:
+SELECT name, to_char(date_as_text AT TIME ZONE 'UTC', 'YYYY-MM-DD HH24:MI:SS.US') AS date_as_text
+FROM dates7 WHERE name LIKE 'Tz%' ORDER BY name;
+
+--Testcase 55:
+DROP FOREIGN TABLE dates5;
+
+--Testcase 56:
+DROP FOREIGN TABLE dates6;
+
+--Testcase 57:
+DROP FOREIGN TABLE dates7;
+
+--Testcase 45:
+DELETE FROM dates3 WHERE name NOT LIKE '%Date';
+
+--Testcase 46:
+DROP FOREIGN TABLE dates3;
+
+--Testcase 47:
+DROP FOREIGN TABLE dates4;
+
 --Testcase 35:
 DROP FOREIGN TABLE dates1;
 --Testcase 36:
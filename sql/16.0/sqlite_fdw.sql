@@ -997,6 +997,595 @@ SELECT * FROM RO_RW_test ORDER BY i;
 DROP FOREIGN TABLE RO_RW_test;
 -- End of RO/RW test
 
+-- ANALYZE of a foreign table
+--Testcase 369:
+ANALYZE numbers;
+--Testcase 370:
+SELECT reltuples::bigint = (SELECT count(*) FROM numbers) AS reltuples_ok, relpages > 0 AS relpages_ok FROM pg_class WHERE relname = 'numbers';
+--Testcase 371:
+SELECT attname, null_frac FROM pg_stats WHERE tablename = 'numbers' ORDER BY attname;
+
+-- Remote estimate
+--Testcase 372:
+ALTER FOREIGN TABLE numbers OPTIONS (ADD use_remote_estimate 'true');
+--Testcase 373:
+EXPLAIN (COSTS OFF) SELECT b FROM numbers WHERE a = 1;
+--Testcase 374:
+SELECT b FROM numbers WHERE a = 1;
+--Testcase 375:
+ALTER FOREIGN TABLE numbers OPTIONS (DROP use_remote_estimate);
+-- Remote estimate with the statistics of ANALYZE in SQLite
+--Testcase 376:
+CREATE SERVER sqlite_analyzed_svr FOREIGN DATA WRAPPER sqlite_fdw
+OPTIONS (database '/tmp/sqlite_fdw_test/analyzed.db');
+--Testcase 377:
+CREATE FOREIGN TABLE analyzed (a int OPTIONS (key 'true'), b int) SERVER sqlite_analyzed_svr OPTIONS (estimated_rows '5');
+--Testcase 378:
+CREATE FUNCTION explain_rows(query text) RETURNS text
+LANGUAGE plpgsql AS $$
+DECLARE
+    ln text;
+BEGIN
+    FOR ln IN EXECUTE 'EXPLAIN ' || query
+    LOOP
+        RETURN substring(ln from 'rows=\d+');
+    END LOOP;
+END;
+$$;
+--Testcase 379:
+SELECT explain_rows('SELECT * FROM analyzed');
+--Testcase 380:
+ALTER FOREIGN TABLE analyzed OPTIONS (ADD use_remote_estimate 'true');
+--Testcase 381:
+SELECT explain_rows('SELECT * FROM analyzed');
+--Testcase 382:
+DROP FUNCTION explain_rows(text);
+--Testcase 383:
+DROP SERVER sqlite_analyzed_svr CASCADE;
+-- Parallel scan
+--Testcase 384:
+ALTER FOREIGN TABLE numbers OPTIONS (ADD parallel_workers '-1');
+--Testcase 385:
+INSERT INTO numbers SELECT i, 'Number ' || i FROM generate_series(1001, 2000) i;
+--Testcase 386:
+ANALYZE numbers;
+--Testcase 387:
+CREATE TABLE numbers_serial AS SELECT * FROM numbers;
+--Testcase 388:
+ALTER FOREIGN TABLE numbers OPTIONS (ADD parallel_workers '2');
+--Testcase 389:
+SET parallel_setup_cost = 0;
+--Testcase 390:
+SET parallel_tuple_cost = 0;
+--Testcase 391:
+SELECT count(*) FILTER (WHERE a IS NOT NULL) = (SELECT count(*) FROM numbers_serial) AS count_ok, sum(a) FILTER (WHERE a IS NOT NULL) = (SELECT sum(a) FROM numbers_serial) AS sum_ok FROM numbers;
+--Testcase 392:
+EXPLAIN (COSTS OFF) SELECT a, b FROM numbers;
+-- Changes of the leader are not visible to workers
+--Testcase 393:
+BEGIN;
+--Testcase 394:
+INSERT INTO numbers VALUES (2001, 'Number 2001');
+--Testcase 395:
+EXPLAIN (COSTS OFF) SELECT a, b FROM numbers;
+--Testcase 396:
+SELECT count(*) FILTER (WHERE a IS NOT NULL) FROM numbers WHERE a > 1000;
+--Testcase 397:
+ROLLBACK;
+--Testcase 398:
+RESET parallel_tuple_cost;
+--Testcase 399:
+RESET parallel_setup_cost;
+--Testcase 400:
+ALTER FOREIGN TABLE numbers OPTIONS (DROP parallel_workers);
+--Testcase 401:
+DROP TABLE numbers_serial;
+--Testcase 402:
+DELETE FROM numbers WHERE a > 1000;
+--Testcase 403:
+ANALYZE numbers;
+-- Asynchronous execution
+--Testcase 404:
+ALTER FOREIGN TABLE numbers OPTIONS (ADD async_capable 'true');
+-- The connection is opened again in serialized mode for background fetchers
+--Testcase 405:
+EXPLAIN (COSTS OFF) SELECT a FROM numbers UNION ALL SELECT a FROM numbers;
+--Testcase 406:
+SELECT count(*) = 2 * (SELECT count(*) FROM numbers) AS count_ok, sum(a) = 2 * (SELECT sum(a) FROM numbers) AS sum_ok FROM (SELECT a FROM numbers UNION ALL SELECT a FROM numbers) t;
+-- Fetchers of a scan which failed in a subtransaction are stopped at its abort
+--Testcase 407:
+CREATE FUNCTION sqlite_fail(int) RETURNS int LANGUAGE plpgsql AS $$
+BEGIN
+    RAISE EXCEPTION 'stop';
+END;
+$$;
+--Testcase 408:
+BEGIN;
+--Testcase 409:
+SAVEPOINT s;
+--Testcase 410:
+SELECT sqlite_fail(a) FROM (SELECT a FROM numbers UNION ALL SELECT a FROM numbers) t;
+--Testcase 411:
+ROLLBACK TO SAVEPOINT s;
+--Testcase 412:
+SELECT count(*) = 2 * (SELECT count(*) FROM numbers) AS count_ok FROM (SELECT a FROM numbers UNION ALL SELECT a FROM numbers) t;
+--Testcase 413:
+COMMIT;
+--Testcase 414:
+DROP FUNCTION sqlite_fail(int);
+--Testcase 415:
+ALTER FOREIGN TABLE numbers OPTIONS (DROP async_capable);
+
+-- Batched DELETE
+--Testcase 416:
+ALTER FOREIGN TABLE numbers OPTIONS (ADD batch_size '2');
+--Testcase 417:
+INSERT INTO numbers VALUES (101, 'batch 1'), (102, 'batch 2'), (103, 'batch 3');
+--Testcase 418:
+DELETE FROM numbers WHERE a > 100 AND random() >= 0;
+--Testcase 419:
+SELECT * FROM numbers WHERE a > 100;
+--Testcase 420:
+ALTER FOREIGN TABLE numbers OPTIONS (DROP batch_size);
+--Testcase 421:
+ALTER FOREIGN TABLE multiprimary OPTIONS (ADD batch_size '2');
+--Testcase 422:
+INSERT INTO multiprimary VALUES (7, 70, 700), (7, 71, 710), (7, 72, 720);
+--Testcase 423:
+DELETE FROM multiprimary WHERE a = 7 AND random() >= 0;
+--Testcase 424:
+SELECT * FROM multiprimary WHERE a = 7;
+--Testcase 425:
+ALTER FOREIGN TABLE multiprimary OPTIONS (DROP batch_size);
+
+-- COPY and INSERT routed into a foreign partition
+--Testcase 426:
+CREATE FOREIGN TABLE numbers_part (a int OPTIONS (key 'true'), b varchar(255)) SERVER sqlite_svr OPTIONS (table 'numbers');
+--Testcase 427:
+CREATE TABLE numbers_parent (a int, b varchar(255)) PARTITION BY RANGE (a);
+--Testcase 428:
+ALTER TABLE numbers_parent ATTACH PARTITION numbers_part FOR VALUES FROM (100) TO (200);
+--Testcase 429:
+INSERT INTO numbers_parent VALUES (101, 'routed 1'), (102, 'routed 2');
+--Testcase 430:
+COPY numbers_parent FROM stdin;
+103	copied 1
+\.
+--Testcase 431:
+COPY numbers FROM stdin;
+104	copied 2
+\.
+--Testcase 432:
+SELECT * FROM numbers WHERE a > 100 ORDER BY a;
+--Testcase 433:
+DELETE FROM numbers WHERE a > 100;
+--Testcase 434:
+DROP TABLE numbers_parent;
+
+-- PRAGMA options of the connection
+--Testcase 435:
+ALTER SERVER sqlite_svr OPTIONS (ADD cache_size '-4096', ADD mmap_size '268435456', ADD synchronous 'normal', ADD temp_store 'memory', ADD busy_timeout '1000');
+-- The values are read back from the pragma functions of SQLite
+--Testcase 436:
+CREATE FOREIGN TABLE pragma_cache_size (cache_size int) SERVER sqlite_svr;
+--Testcase 437:
+CREATE FOREIGN TABLE pragma_synchronous (synchronous int) SERVER sqlite_svr;
+--Testcase 438:
+CREATE FOREIGN TABLE pragma_temp_store (temp_store int) SERVER sqlite_svr;
+--Testcase 439:
+CREATE FOREIGN TABLE pragma_busy_timeout (timeout int) SERVER sqlite_svr;
+--Testcase 440:
+SELECT c.cache_size, s.synchronous, t.temp_store, b.timeout FROM pragma_cache_size c, pragma_synchronous s, pragma_temp_store t, pragma_busy_timeout b;
+--Testcase 441:
+DROP FOREIGN TABLE pragma_cache_size, pragma_synchronous, pragma_temp_store, pragma_busy_timeout;
+-- Only decimal integers are accepted, SQLite reads other forms differently
+--Testcase 442:
+ALTER SERVER sqlite_svr OPTIONS (SET cache_size '0x10');
+--Testcase 443:
+ALTER SERVER sqlite_svr OPTIONS (SET busy_timeout '1e3');
+--Testcase 444:
+ALTER SERVER sqlite_svr OPTIONS (ADD journal_mode 'wall');
+--Testcase 445:
+ALTER SERVER sqlite_svr OPTIONS (ADD page_size_hint '1000');
+--Testcase 446:
+ALTER SERVER sqlite_svr OPTIONS (DROP cache_size, DROP mmap_size, DROP synchronous, DROP temp_store, DROP busy_timeout);
+
+-- UPDATE and DELETE of a table without key columns use rowid
+--Testcase 447:
+UPDATE noprimary SET b = b || 'x' WHERE a = 1 AND random() >= 0;
+--Testcase 448:
+SELECT * FROM noprimary ORDER BY a, b;
+--Testcase 449:
+ALTER FOREIGN TABLE noprimary OPTIONS (ADD batch_size '2');
+--Testcase 450:
+DELETE FROM noprimary WHERE a = 1 AND random() >= 0;
+--Testcase 451:
+ALTER FOREIGN TABLE noprimary OPTIONS (DROP batch_size);
+--Testcase 452:
+SELECT * FROM noprimary ORDER BY a, b;
+
+-- RETURNING
+--Testcase 453:
+INSERT INTO noprimary VALUES (6, 'ret') RETURNING *;
+--Testcase 454:
+INSERT INTO noprimary VALUES (7, 'ret2') RETURNING a + 1 AS next, b;
+--Testcase 455:
+WITH t AS (UPDATE noprimary SET b = b || '!' WHERE a >= 6 RETURNING *) SELECT * FROM t ORDER BY a;
+--Testcase 456:
+UPDATE noprimary SET b = b || '?' WHERE a = 6 AND random() >= 0 RETURNING *;
+--Testcase 457:
+DELETE FROM noprimary WHERE a = 7 RETURNING *;
+--Testcase 458:
+DELETE FROM noprimary WHERE a = 6 AND random() >= 0 RETURNING a;
+--Testcase 459:
+INSERT INTO noprimary VALUES (8, 'c') RETURNING 1 AS one;
+--Testcase 460:
+DELETE FROM noprimary WHERE a = 8 RETURNING 'gone' AS status;
+--Testcase 461:
+ALTER FOREIGN TABLE noprimary OPTIONS (ADD batch_size '5');
+--Testcase 462:
+INSERT INTO noprimary VALUES (9, 'x'), (10, 'y') RETURNING a;
+--Testcase 463:
+DELETE FROM noprimary WHERE a >= 9 AND random() >= 0 RETURNING a;
+--Testcase 464:
+ALTER FOREIGN TABLE noprimary OPTIONS (DROP batch_size);
+--Testcase 465:
+SELECT * FROM noprimary ORDER BY a;
+
+-- UPDATE and DELETE of more rows than fit into work_mem
+--Testcase 466:
+SET work_mem = '64kB';
+--Testcase 467:
+INSERT INTO noprimary SELECT i, repeat('x', 100) FROM generate_series(101, 3000) i;
+--Testcase 468:
+UPDATE noprimary SET b = 'y' WHERE a > 100 AND random() >= 0;
+--Testcase 469:
+SELECT count(*), min(b), max(b) FROM noprimary WHERE a > 100;
+--Testcase 470:
+DELETE FROM noprimary WHERE a > 100 AND random() >= 0;
+--Testcase 471:
+RESET work_mem;
+--Testcase 472:
+SELECT * FROM noprimary ORDER BY a;
+
+-- Scans of UPDATE and DELETE through a snapshot connection
+--Testcase 473:
+ALTER SERVER sqlite_svr OPTIONS (ADD snapshot_scan 'true');
+--Testcase 474:
+UPDATE noprimary SET b = b || '.' WHERE a > 0 AND random() >= 0;
+--Testcase 475:
+SELECT * FROM noprimary ORDER BY a;
+--Testcase 476:
+ALTER SERVER sqlite_svr OPTIONS (SET snapshot_scan 'maybe');
+--Testcase 477:
+ALTER SERVER sqlite_svr OPTIONS (DROP snapshot_scan);
+
+-- Snapshot scans of a database in WAL mode
+--Testcase 478:
+CREATE SERVER sqlite_wal_svr FOREIGN DATA WRAPPER sqlite_fdw
+OPTIONS (database '/tmp/sqlite_fdw_test/wal.db', journal_mode 'wal', snapshot_scan 'true');
+--Testcase 479:
+CREATE FOREIGN TABLE wal_t (a int OPTIONS (key 'true'), b text) SERVER sqlite_wal_svr;
+--Testcase 480:
+INSERT INTO wal_t SELECT i, 'v' || i FROM generate_series(1, 5) i;
+--Testcase 481:
+CREATE FUNCTION explain_snapshot_scan(query text) RETURNS SETOF text
+LANGUAGE plpgsql AS $$
+DECLARE
+    ln text;
+BEGIN
+    FOR ln IN EXECUTE 'EXPLAIN (ANALYZE, COSTS OFF, TIMING OFF, SUMMARY OFF) ' || query
+    LOOP
+        IF ln ~ 'Snapshot' THEN
+            RETURN NEXT btrim(ln);
+        END IF;
+    END LOOP;
+END;
+$$;
+-- The scan doesn't see rows which have been moved by the UPDATE
+--Testcase 482:
+SELECT explain_snapshot_scan('UPDATE wal_t SET a = a + 100 WHERE random() >= 0');
+--Testcase 483:
+SELECT * FROM wal_t ORDER BY a;
+-- Not after a modification in the same transaction
+--Testcase 484:
+BEGIN;
+--Testcase 485:
+DELETE FROM wal_t WHERE a = 105;
+--Testcase 486:
+SELECT explain_snapshot_scan('UPDATE wal_t SET a = a - 100 WHERE random() >= 0');
+--Testcase 487:
+SELECT * FROM wal_t ORDER BY a;
+--Testcase 488:
+ROLLBACK;
+--Testcase 489:
+SELECT * FROM wal_t ORDER BY a;
+--Testcase 490:
+DROP FUNCTION explain_snapshot_scan(text);
+--Testcase 491:
+DROP SERVER sqlite_wal_svr CASCADE;
+
+-- Cache of prepared statements
+--Testcase 492:
+ALTER SERVER sqlite_svr OPTIONS (ADD stmt_cache_size '1');
+-- Executions of a generic plan reuse the statement with the same SQL
+--Testcase 493:
+SET plan_cache_mode = force_generic_plan;
+--Testcase 494:
+PREPARE st_noprimary(int) AS SELECT b FROM noprimary WHERE a = $1;
+--Testcase 495:
+EXECUTE st_noprimary(4);
+--Testcase 496:
+CREATE TEMP TABLE stmt_cache_stats AS SELECT statement_cache_hits AS hits, statement_cache_misses AS misses FROM sqlite_fdw_connection_stats() WHERE server_name = 'sqlite_svr';
+--Testcase 497:
+EXECUTE st_noprimary(5);
+--Testcase 498:
+SELECT s.statement_cache_hits - t.hits AS hits, s.statement_cache_misses - t.misses AS misses FROM sqlite_fdw_connection_stats() s, stmt_cache_stats t WHERE s.server_name = 'sqlite_svr';
+--Testcase 499:
+SELECT count(*) FROM noprimary;
+--Testcase 500:
+EXECUTE st_noprimary(4);
+-- The statement has been evicted by the other one
+--Testcase 501:
+SELECT s.statement_cache_hits - t.hits AS hits, s.statement_cache_misses - t.misses AS misses FROM sqlite_fdw_connection_stats() s, stmt_cache_stats t WHERE s.server_name = 'sqlite_svr';
+-- A statement of a scan which failed in a subtransaction is used again after ROLLBACK TO
+--Testcase 502:
+BEGIN;
+--Testcase 503:
+SAVEPOINT s1;
+--Testcase 504:
+SELECT 1 / (a - a) FROM noprimary;
+--Testcase 505:
+ROLLBACK TO SAVEPOINT s1;
+--Testcase 506:
+SELECT 1 / (a - a + 1) FROM noprimary;
+--Testcase 507:
+SELECT s.statement_cache_hits - t.hits AS hits, s.statement_cache_misses - t.misses AS misses FROM sqlite_fdw_connection_stats() s, stmt_cache_stats t WHERE s.server_name = 'sqlite_svr';
+--Testcase 508:
+COMMIT;
+--Testcase 509:
+DEALLOCATE st_noprimary;
+--Testcase 510:
+DROP TABLE stmt_cache_stats;
+--Testcase 511:
+RESET plan_cache_mode;
+--Testcase 512:
+ALTER SERVER sqlite_svr OPTIONS (SET stmt_cache_size '-1');
+--Testcase 513:
+ALTER SERVER sqlite_svr OPTIONS (DROP stmt_cache_size);
+
+-- Statistics of cached connections
+--Testcase 514:
+INSERT INTO noprimary VALUES (11, 'stats');
+--Testcase 515:
+DELETE FROM noprimary WHERE a = 11;
+--Testcase 516:
+SELECT valid, xact_depth, cached_statements > 0 AS cached, statements_prepared >= cached_statements AS prepared, rows_fetched > 0 AS fetched, rows_modified >= 2 AS modified, busy_retries, cache_used > 0 AS cache_used, schema_used > 0 AS schema_used FROM sqlite_fdw_connection_stats() WHERE server_name = 'sqlite_svr';
+
+-- Statistics of foreign scans in EXPLAIN ANALYZE
+--Testcase 517:
+CREATE FUNCTION explain_sqlite_scan(query text) RETURNS SETOF text
+LANGUAGE plpgsql AS $$
+DECLARE
+    ln text;
+BEGIN
+    FOR ln IN EXECUTE 'EXPLAIN (ANALYZE, VERBOSE, COSTS OFF, TIMING OFF, SUMMARY OFF) ' || query
+    LOOP
+        -- The text of SQLite plans differs between SQLite versions
+        ln := regexp_replace(ln, 'SQLite Plan: .*', 'SQLite Plan: ...');
+        RETURN NEXT regexp_replace(ln, '\d+', 'N', 'g');
+    END LOOP;
+END;
+$$;
+--Testcase 518:
+SELECT explain_sqlite_scan('SELECT * FROM noprimary WHERE a = 4');
+--Testcase 519:
+DROP FUNCTION explain_sqlite_scan(text);
+
+-- Statistics of remote statements need shared_preload_libraries
+--Testcase 520:
+SELECT query, calls FROM sqlite_fdw_stat_statements;
+--Testcase 521:
+SELECT sqlite_fdw_stat_statements_reset();
+
+-- Text, varchar, bpchar and bytea values of a text column
+--Testcase 522:
+CREATE FOREIGN TABLE noprimary_conv(a int, b varchar(7), bc char(8) OPTIONS (column_name 'b'), bb bytea OPTIONS (column_name 'b'))
+  SERVER sqlite_svr OPTIONS (table 'noprimary');
+--Testcase 523:
+SELECT a, b, bc, bb FROM noprimary_conv ORDER BY a;
+--Testcase 524:
+DROP FOREIGN TABLE noprimary_conv;
+
+-- Conditions on columns with strict affinity can use SQLite indexes
+--Testcase 525:
+CREATE FUNCTION explain_sqlite_plan(query text) RETURNS SETOF text
+LANGUAGE plpgsql AS $$
+DECLARE
+    ln text;
+BEGIN
+    FOR ln IN EXECUTE 'EXPLAIN (ANALYZE, VERBOSE, COSTS OFF, TIMING OFF, SUMMARY OFF) ' || query
+    LOOP
+        IF ln ~ 'SQLite (query|Plan)' THEN
+            RETURN NEXT ln;
+        END IF;
+    END LOOP;
+END;
+$$;
+--Testcase 526:
+CREATE FOREIGN TABLE type_float_idx(col float8 OPTIONS (key 'true')) SERVER sqlite_svr OPTIONS (table 'type_FLOAT');
+--Testcase 527:
+SELECT explain_sqlite_plan('SELECT * FROM type_float_idx WHERE col = 3.1415');
+--Testcase 528:
+ALTER FOREIGN TABLE type_float_idx OPTIONS (ADD strict 'true');
+--Testcase 529:
+SELECT explain_sqlite_plan('SELECT * FROM type_float_idx WHERE col = 3.1415');
+--Testcase 530:
+ALTER FOREIGN TABLE type_float_idx ALTER COLUMN col OPTIONS (ADD strict_affinity 'false');
+--Testcase 531:
+SELECT explain_sqlite_plan('SELECT * FROM type_float_idx WHERE col = 3.1415');
+--Testcase 532:
+CREATE FOREIGN TABLE type_uuid_idx(col uuid OPTIONS (key 'true', strict_affinity 'true')) SERVER sqlite_svr OPTIONS (table 'type_UUIDpk');
+--Testcase 533:
+SELECT explain_sqlite_plan('SELECT * FROM type_uuid_idx WHERE col = ''a0eebc99-9c0b-4ef8-bb6d-6bb9bd380a11''');
+--Testcase 534:
+ALTER FOREIGN TABLE type_uuid_idx OPTIONS (ADD strict 'maybe');
+--Testcase 535:
+DROP FOREIGN TABLE type_float_idx, type_uuid_idx;
+--Testcase 536:
+DROP FUNCTION explain_sqlite_plan(text);
+
+-- IMPORT FOREIGN SCHEMA of STRICT tables and columns with clean affinity
+--Testcase 537:
+CREATE SCHEMA import_strict;
+--Testcase 538:
+IMPORT FOREIGN SCHEMA main LIMIT TO ("type_STRICT", "type_AFFINITY") FROM SERVER sqlite_svr INTO import_strict
+  OPTIONS (import_strict_affinity 'true');
+--Testcase 539:
+SELECT c.relname, ft.ftoptions FROM pg_foreign_table ft JOIN pg_class c ON c.oid = ft.ftrelid
+  WHERE c.relnamespace = 'import_strict'::regnamespace ORDER BY c.relname;
+--Testcase 540:
+SELECT c.relname, a.attname, format_type(a.atttypid, a.atttypmod), a.attfdwoptions FROM pg_attribute a JOIN pg_class c ON c.oid = a.attrelid
+  WHERE c.relnamespace = 'import_strict'::regnamespace AND a.attnum > 0 ORDER BY c.relname, a.attnum;
+--Testcase 541:
+EXPLAIN (VERBOSE, COSTS OFF) SELECT * FROM import_strict."type_AFFINITY" WHERE f > 1;
+--Testcase 542:
+SELECT * FROM import_strict."type_AFFINITY" WHERE f > 1 ORDER BY i;
+--Testcase 543:
+EXPLAIN (VERBOSE, COSTS OFF) SELECT i, f FROM import_strict."type_STRICT" WHERE a = 1;
+--Testcase 544:
+SELECT i, f FROM import_strict."type_STRICT" ORDER BY i;
+-- Integers other than 0 and 1 in a boolean column are converted without the fast path
+--Testcase 545:
+ALTER FOREIGN TABLE import_strict."type_AFFINITY" ALTER COLUMN b TYPE int;
+--Testcase 546:
+INSERT INTO import_strict."type_AFFINITY" (i, b) VALUES (3, 2);
+--Testcase 547:
+ALTER FOREIGN TABLE import_strict."type_AFFINITY" ALTER COLUMN b TYPE boolean;
+--Testcase 548:
+SELECT i, b FROM import_strict."type_AFFINITY" ORDER BY i;
+--Testcase 549:
+DELETE FROM import_strict."type_AFFINITY" WHERE i = 3;
+--Testcase 550:
+DROP FOREIGN TABLE import_strict."type_STRICT", import_strict."type_AFFINITY";
+--Testcase 551:
+DROP SCHEMA import_strict;
+
+-- IMPORT FOREIGN SCHEMA of unique keys and row estimates, views are skipped even if their table has been dropped
+--Testcase 552:
+CREATE SCHEMA import_keys;
+--Testcase 553:
+IMPORT FOREIGN SCHEMA main LIMIT TO ("type_UNIQUE", "type_NOROWID", "type_AFFINITY+", "type_DROPPED+", "type_STRICT") FROM SERVER sqlite_svr INTO import_keys
+  OPTIONS (import_estimated_rows 'true');
+--Testcase 554:
+SELECT c.relname, ft.ftoptions FROM pg_foreign_table ft JOIN pg_class c ON c.oid = ft.ftrelid
+  WHERE c.relnamespace = 'import_keys'::regnamespace ORDER BY c.relname;
+--Testcase 555:
+SELECT c.relname, a.attname, format_type(a.atttypid, a.atttypmod), a.attnotnull, a.attfdwoptions FROM pg_attribute a JOIN pg_class c ON c.oid = a.attrelid
+  WHERE c.relnamespace = 'import_keys'::regnamespace AND a.attnum > 0 ORDER BY c.relname, a.attnum;
+--Testcase 556:
+SELECT count(*) FROM pg_class WHERE relnamespace = 'import_keys'::regnamespace AND relname IN ('type_AFFINITY+', 'type_DROPPED+');
+--Testcase 557:
+SELECT * FROM import_keys."type_UNIQUE" ORDER BY u;
+--Testcase 558:
+ALTER FOREIGN TABLE import_keys."type_UNIQUE" OPTIONS (SET estimated_rows '-1');
+--Testcase 559:
+DROP FOREIGN TABLE import_keys."type_UNIQUE", import_keys."type_NOROWID", import_keys."type_STRICT";
+--Testcase 560:
+DROP SCHEMA import_keys;
+
+-- SEMI and ANTI joins are pushed down as EXISTS and NOT EXISTS
+--Testcase 561:
+CREATE FOREIGN TABLE semi_u (u int OPTIONS (key 'true'), v text) SERVER sqlite_svr OPTIONS (table 'type_UNIQUE');
+--Testcase 562:
+CREATE FOREIGN TABLE semi_n (k text OPTIONS (key 'true'), v int) SERVER sqlite_svr OPTIONS (table 'type_NOROWID');
+--Testcase 563:
+SET enable_hashjoin TO off;
+--Testcase 564:
+SET enable_mergejoin TO off;
+--Testcase 565:
+SET enable_nestloop TO off;
+--Testcase 566:
+EXPLAIN (VERBOSE, COSTS OFF)
+SELECT * FROM semi_u ft WHERE EXISTS (SELECT 1 FROM semi_n n WHERE ft.u = n.v AND n.k = 'a');
+--Testcase 567:
+SELECT * FROM semi_u ft WHERE EXISTS (SELECT 1 FROM semi_n n WHERE ft.u = n.v AND n.k = 'a');
+--Testcase 568:
+EXPLAIN (VERBOSE, COSTS OFF)
+SELECT * FROM semi_u ft WHERE NOT EXISTS (SELECT 1 FROM semi_n n WHERE ft.u = n.v);
+--Testcase 569:
+SELECT * FROM semi_u ft WHERE NOT EXISTS (SELECT 1 FROM semi_n n WHERE ft.u = n.v);
+-- ANTI join with a condition on the inner relation, and a LEFT JOIN planned as an ANTI join
+--Testcase 570:
+EXPLAIN (VERBOSE, COSTS OFF)
+SELECT * FROM semi_u ft WHERE NOT EXISTS (SELECT 1 FROM semi_n n WHERE ft.u = n.v AND n.k <> 'a');
+--Testcase 571:
+SELECT * FROM semi_u ft WHERE NOT EXISTS (SELECT 1 FROM semi_n n WHERE ft.u = n.v AND n.k <> 'a');
+--Testcase 572:
+EXPLAIN (VERBOSE, COSTS OFF)
+SELECT ft.* FROM semi_u ft LEFT JOIN semi_n n ON ft.u = n.v WHERE n.v IS NULL;
+--Testcase 573:
+SELECT ft.* FROM semi_u ft LEFT JOIN semi_n n ON ft.u = n.v WHERE n.v IS NULL;
+--Testcase 574:
+RESET enable_hashjoin;
+--Testcase 575:
+RESET enable_mergejoin;
+--Testcase 576:
+RESET enable_nestloop;
+--Testcase 577:
+DROP FOREIGN TABLE semi_u, semi_n;
+
+-- Rows of repeated parameter values are returned from the lookup cache
+--Testcase 578:
+CREATE FOREIGN TABLE lookup_u (u int OPTIONS (key 'true'), v text) SERVER sqlite_svr OPTIONS (table 'type_UNIQUE');
+--Testcase 579:
+CREATE FUNCTION explain_lookup_cache(query text) RETURNS SETOF text
+LANGUAGE plpgsql AS $$
+DECLARE
+    ln text;
+BEGIN
+    FOR ln IN EXECUTE 'EXPLAIN (ANALYZE, VERBOSE, COSTS OFF, TIMING OFF, SUMMARY OFF) ' || query
+    LOOP
+        IF ln ~ 'Foreign Scan' THEN
+            RETURN NEXT regexp_replace(ln, '\d+', 'N', 'g');
+        ELSIF ln ~ 'Lookup Cache' THEN
+            RETURN NEXT ln;
+        END IF;
+    END LOOP;
+END;
+$$;
+--Testcase 580:
+SELECT x, (SELECT v FROM lookup_u WHERE u = x) FROM (VALUES (1), (1), (2), (1), (3)) t(x);
+--Testcase 581:
+SELECT explain_lookup_cache('SELECT x, (SELECT v FROM lookup_u WHERE u = x) FROM (VALUES (1), (1), (2), (1), (3)) t(x)');
+--Testcase 582:
+DROP FUNCTION explain_lookup_cache(text);
+--Testcase 583:
+DROP FOREIGN TABLE lookup_u;
+
+-- AFTER STATEMENT triggers see the rows deleted by DELETE with batch_size
+--Testcase 584:
+ALTER FOREIGN TABLE numbers OPTIONS (ADD batch_size '2');
+--Testcase 585:
+CREATE FUNCTION numbers_left() RETURNS trigger LANGUAGE plpgsql AS $$
+BEGIN
+    RAISE NOTICE 'rows left: %', (SELECT count(*) FROM numbers WHERE a > 100);
+    RETURN NULL;
+END;
+$$;
+--Testcase 586:
+CREATE TRIGGER numbers_after_delete AFTER DELETE ON numbers FOR EACH STATEMENT EXECUTE FUNCTION numbers_left();
+--Testcase 587:
+INSERT INTO numbers VALUES (101, 'batch 1'), (102, 'batch 2'), (103, 'batch 3');
+--Testcase 588:
+DELETE FROM numbers WHERE a > 100 AND random() >= 0;
+--Testcase 589:
+DROP TRIGGER numbers_after_delete ON numbers;
+--Testcase 590:
+DROP FUNCTION numbers_left();
+--Testcase 591:
+ALTER FOREIGN TABLE numbers OPTIONS (DROP batch_size);
+
 --Bind error message test for some unsupported data type
 --Testcase 366:
 ALTER FOREIGN TABLE numbers ALTER COLUMN b TYPE tsquery;
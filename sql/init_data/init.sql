@@ -130,4 +130,20 @@ CREATE TABLE "♂" (
 	"URL" varchar(80)
 );
 
+-- STRICT table and a table with clean and mixed affinity columns for IMPORT FOREIGN SCHEMA
+CREATE TABLE "type_STRICT" (i integer primary key, f real, a any) STRICT;
+INSERT INTO "type_STRICT" VALUES (1, 1.5, 1), (2, 2, 'text');
+CREATE TABLE "type_AFFINITY" (i int primary key, f float, b boolean, u uuid, m float);
+INSERT INTO "type_AFFINITY" VALUES (1, 1.5, 1, X'a0eebc999c0b4ef8bb6d6bb9bd380a11', 2.5), (2, 2, 0, X'b0eebc999c0b4ef8bb6d6bb9bd380a12', 'Infinity');
+
+-- tables with keys other than a rowid primary key, a view and a view of a dropped table for IMPORT FOREIGN SCHEMA
+CREATE TABLE "type_UNIQUE" (u int NOT NULL, v text, UNIQUE (u));
+INSERT INTO "type_UNIQUE" VALUES (1, 'a'), (2, 'b');
+CREATE TABLE "type_NOROWID" (k text PRIMARY KEY, v int) WITHOUT ROWID;
+INSERT INTO "type_NOROWID" VALUES ('a', 1);
+CREATE VIEW  "type_AFFINITY+" AS SELECT i, f FROM "type_AFFINITY";
+CREATE TABLE "type_DROPPED" (i int);
+CREATE VIEW  "type_DROPPED+" AS SELECT i FROM "type_DROPPED";
+DROP TABLE "type_DROPPED";
+
 analyze;
@@ -0,0 +1,7 @@
+DROP TABLE IF EXISTS analyzed;
+
+CREATE TABLE analyzed(a int primary key, b int);
+WITH RECURSIVE s(i) AS (SELECT 1 UNION ALL SELECT i + 1 FROM s WHERE i < 1000)
+INSERT INTO analyzed SELECT i, i % 10 FROM s;
+
+ANALYZE;
@@ -0,0 +1,3 @@
+DROP TABLE IF EXISTS wal_t;
+
+CREATE TABLE wal_t(a int primary key, b text);
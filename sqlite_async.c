@@ -0,0 +1,442 @@
+/*-------------------------------------------------------------------------
+ *
+ * SQLite Foreign Data Wrapper for PostgreSQL
+ *
+ * Background row fetchers for asynchronous foreign scans
+ *
+ * SQLite has no non-blocking interface, so an asynchronous foreign scan
+ * steps its statement on a helper thread.  The thread calls nothing but
+ * SQLite and libc functions: it copies every row into a bounded ring of
+ * sqlite3_value arrays and wakes the backend up through a pipe, which the
+ * executor waits on like on a socket of a remote server.  All PostgreSQL
+ * work, including the conversion of the values, stays in the backend.
+ *
+ * IDENTIFICATION
+ * 		sqlite_async.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "sqlite_fdw.h"
+
+#ifndef WIN32
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <unistd.h>
+#endif
+
+#include "access/xact.h"
+#include "utils/memutils.h"
+
+/* Number of rows which can be fetched ahead of the backend */
+#define SQLITE_ASYNC_RING_SIZE	256
+
+struct SqliteAsyncFetcher
+{
+	sqlite3_stmt *stmt;			/* statement stepped by the thread */
+	int			ncols;			/* number of result columns */
+	int			nest_level;		/* transaction nesting level at start */
+	bool		timing;			/* measure the time of sqlite3_step() */
+	struct SqliteAsyncFetcher *next;	/* next active fetcher */
+
+#ifndef WIN32
+	pthread_t	thread;
+	pthread_mutex_t lock;		/* protects the fields below */
+	pthread_cond_t cond;		/* signaled when a row has been consumed */
+	int			pipe_fds[2];	/* readable end becomes ready on new rows */
+
+	sqlite3_value **rows[SQLITE_ASYNC_RING_SIZE];
+	int			head;			/* index of the oldest row */
+	int			nrows;			/* number of rows in the ring */
+	bool		done;			/* thread has finished stepping */
+	bool		cancel;			/* backend asked the thread to stop */
+	int			rc;				/* last result code of sqlite3_step */
+	char	   *errmsg;			/* error message, allocated by SQLite */
+	instr_time	step_time;		/* time spent in sqlite3_step() since the
+								 * backend got the last row */
+#endif
+};
+
+/* List of the fetchers whose threads have been started */
+static SqliteAsyncFetcher *active_fetchers = NULL;
+
+#ifndef WIN32
+static void *sqlite_async_fetch_rows(void *arg);
+static void sqlite_async_wakeup(SqliteAsyncFetcher * fetcher);
+static void sqlite_async_free_row(sqlite3_value * *row, int ncols);
+#endif
+
+/*
+ * Check whether asynchronous scans can be used.  The connection has to be
+ * usable from the helper thread, so SQLite must not be single-threaded.
+ */
+bool
+sqlite_async_is_supported(void)
+{
+#ifndef WIN32
+	return sqlite3_threadsafe() != 0;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Start a helper thread which fetches the rows of an already bound
+ * statement.  The statement must not be touched until the fetcher has been
+ * stopped.  If timing is true, the thread measures the time of its steps,
+ * see sqlite_async_next_row().
+ */
+SqliteAsyncFetcher *
+sqlite_async_start(sqlite3_stmt * stmt, bool timing)
+{
+#ifndef WIN32
+	SqliteAsyncFetcher *fetcher;
+	sigset_t	sigs;
+	sigset_t	oldsigs;
+	int			i;
+	int			rc;
+
+	fetcher = MemoryContextAllocZero(TopMemoryContext, sizeof(SqliteAsyncFetcher));
+	fetcher->stmt = stmt;
+	fetcher->ncols = sqlite3_column_count(stmt);
+	fetcher->nest_level = GetCurrentTransactionNestLevel();
+	fetcher->timing = timing;
+	INSTR_TIME_SET_ZERO(fetcher->step_time);
+	fetcher->rc = SQLITE_OK;
+
+	if (pipe(fetcher->pipe_fds) != 0)
+	{
+		pfree(fetcher);
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+				 errmsg("could not create pipe for asynchronous foreign scan: %m")));
+	}
+	for (i = 0; i < 2; i++)
+	{
+		fcntl(fetcher->pipe_fds[i], F_SETFL, O_NONBLOCK);
+		fcntl(fetcher->pipe_fds[i], F_SETFD, FD_CLOEXEC);
+	}
+
+	pthread_mutex_init(&fetcher->lock, NULL);
+	pthread_cond_init(&fetcher->cond, NULL);
+
+	/*
+	 * Signals must be delivered to the backend only, so the thread starts
+	 * with all of them blocked.
+	 */
+	sigfillset(&sigs);
+	pthread_sigmask(SIG_SETMASK, &sigs, &oldsigs);
+	rc = pthread_create(&fetcher->thread, NULL, sqlite_async_fetch_rows, fetcher);
+	pthread_sigmask(SIG_SETMASK, &oldsigs, NULL);
+
+	if (rc != 0)
+	{
+		pthread_mutex_destroy(&fetcher->lock);
+		pthread_cond_destroy(&fetcher->cond);
+		close(fetcher->pipe_fds[0]);
+		close(fetcher->pipe_fds[1]);
+		pfree(fetcher);
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+				 errmsg("could not start thread for asynchronous foreign scan: %s",
+						strerror(rc))));
+	}
+
+	fetcher->next = active_fetchers;
+	active_fetchers = fetcher;
+	return fetcher;
+#else
+	elog(ERROR, "asynchronous foreign scans are not supported on this platform");
+	return NULL;				/* keep compiler quiet */
+#endif
+}
+
+/*
+ * Get the next row fetched by the helper thread without waiting.  Returns
+ * false if the thread has not fetched anything yet.  Otherwise *rc is set to
+ * SQLITE_ROW and *row to the values which must be released with
+ * sqlite_async_release_row(), or *rc is the final result code of the scan.
+ * The time the thread spent in sqlite3_step() since the last call is added
+ * to *step_time.
+ */
+bool
+sqlite_async_next_row(SqliteAsyncFetcher * fetcher, sqlite3_value * **row, int *rc,
+					  instr_time *step_time)
+{
+#ifndef WIN32
+	bool		ready = true;
+
+	pthread_mutex_lock(&fetcher->lock);
+	if (fetcher->timing)
+	{
+		INSTR_TIME_ADD(*step_time, fetcher->step_time);
+		INSTR_TIME_SET_ZERO(fetcher->step_time);
+	}
+	if (fetcher->nrows > 0)
+	{
+		*row = fetcher->rows[fetcher->head];
+		*rc = SQLITE_ROW;
+		fetcher->rows[fetcher->head] = NULL;
+		fetcher->head = (fetcher->head + 1) % SQLITE_ASYNC_RING_SIZE;
+		/* Wake the thread up if it waits for a free slot */
+		if (fetcher->nrows-- == SQLITE_ASYNC_RING_SIZE)
+			pthread_cond_signal(&fetcher->cond);
+	}
+	else if (fetcher->done)
+		*rc = fetcher->rc;
+	else
+		ready = false;
+	pthread_mutex_unlock(&fetcher->lock);
+
+	return ready;
+#else
+	return false;
+#endif
+}
+
+/*
+ * Release the values of a row returned by sqlite_async_next_row().
+ */
+void
+sqlite_async_release_row(SqliteAsyncFetcher * fetcher, sqlite3_value * *row)
+{
+#ifndef WIN32
+	sqlite_async_free_row(row, fetcher->ncols);
+#endif
+}
+
+/*
+ * Error message of a failed scan, or NULL.
+ */
+const char *
+sqlite_async_errmsg(SqliteAsyncFetcher * fetcher)
+{
+#ifndef WIN32
+	return fetcher->errmsg;
+#else
+	return NULL;
+#endif
+}
+
+/*
+ * Descriptor which becomes readable when new rows or the end of the scan are
+ * available.
+ */
+pgsocket
+sqlite_async_wait_fd(SqliteAsyncFetcher * fetcher)
+{
+#ifndef WIN32
+	return fetcher->pipe_fds[0];
+#else
+	return PGINVALID_SOCKET;
+#endif
+}
+
+/*
+ * Consume pending wakeups of the descriptor returned by sqlite_async_wait_fd.
+ * Must be called before checking for new rows, so that no wakeup is lost.
+ */
+void
+sqlite_async_clear_wakeup(SqliteAsyncFetcher * fetcher)
+{
+#ifndef WIN32
+	char		buf[64];
+
+	while (read(fetcher->pipe_fds[0], buf, sizeof(buf)) > 0)
+		;
+#endif
+}
+
+/*
+ * Stop the helper thread and release the fetcher.  The statement can be used
+ * by the backend again after this.
+ */
+void
+sqlite_async_stop(SqliteAsyncFetcher * fetcher)
+{
+	SqliteAsyncFetcher **prev;
+
+	/* Unlink from the list of active fetchers */
+	for (prev = &active_fetchers; *prev != NULL; prev = &(*prev)->next)
+	{
+		if (*prev == fetcher)
+		{
+			*prev = fetcher->next;
+			break;
+		}
+	}
+
+#ifndef WIN32
+	pthread_mutex_lock(&fetcher->lock);
+	fetcher->cancel = true;
+	pthread_cond_signal(&fetcher->cond);
+	pthread_mutex_unlock(&fetcher->lock);
+
+	/* The thread stops after the current sqlite3_step() returns */
+	pthread_join(fetcher->thread, NULL);
+
+	while (fetcher->nrows > 0)
+	{
+		sqlite_async_free_row(fetcher->rows[fetcher->head], fetcher->ncols);
+		fetcher->head = (fetcher->head + 1) % SQLITE_ASYNC_RING_SIZE;
+		fetcher->nrows--;
+	}
+	sqlite3_free(fetcher->errmsg);
+	pthread_mutex_destroy(&fetcher->lock);
+	pthread_cond_destroy(&fetcher->cond);
+	close(fetcher->pipe_fds[0]);
+	close(fetcher->pipe_fds[1]);
+#endif
+	pfree(fetcher);
+}
+
+/*
+ * Stop all fetchers.  Called at the end of transaction before the remote
+ * transaction is closed, because the executor does not end foreign scans
+ * which failed.  Scans which did not fail have been ended already.
+ */
+void
+sqlite_async_stop_all(void)
+{
+	while (active_fetchers != NULL)
+		sqlite_async_stop(active_fetchers);
+}
+
+/*
+ * Stop the fetchers started in an aborted subtransaction of the given
+ * nesting level or in its children, before the remote subtransaction is
+ * rolled back.  Fetchers of the outer levels keep running.
+ */
+void
+sqlite_async_stop_subxact(int nest_level)
+{
+	SqliteAsyncFetcher *fetcher = active_fetchers;
+
+	while (fetcher != NULL)
+	{
+		SqliteAsyncFetcher *next = fetcher->next;
+
+		if (fetcher->nest_level >= nest_level)
+			sqlite_async_stop(fetcher);
+		fetcher = next;
+	}
+}
+
+#ifndef WIN32
+/*
+ * Body of the helper thread.  No PostgreSQL function may be called here.
+ */
+static void *
+sqlite_async_fetch_rows(void *arg)
+{
+	SqliteAsyncFetcher *fetcher = (SqliteAsyncFetcher *) arg;
+
+	sqlite3_mutex *db_mutex = sqlite3_db_mutex(sqlite3_db_handle(fetcher->stmt));
+
+	for (;;)
+	{
+		sqlite3_value **row = NULL;
+		char	   *errtext = NULL;
+		instr_time	start;
+		instr_time	end;
+		bool		wakeup;
+		int			rc;
+		int			i;
+
+		/* Wait for a free slot in the ring */
+		pthread_mutex_lock(&fetcher->lock);
+		while (fetcher->nrows == SQLITE_ASYNC_RING_SIZE && !fetcher->cancel)
+			pthread_cond_wait(&fetcher->cond, &fetcher->lock);
+		if (fetcher->cancel)
+		{
+			pthread_mutex_unlock(&fetcher->lock);
+			break;
+		}
+		pthread_mutex_unlock(&fetcher->lock);
+
+		/*
+		 * The backend may use the connection meanwhile, which would replace
+		 * the error message of a failed step.  Hold the mutex of the
+		 * connection until the message has been copied.
+		 */
+		sqlite3_mutex_enter(db_mutex);
+		if (fetcher->timing)
+			INSTR_TIME_SET_CURRENT(start);
+		rc = sqlite3_step(fetcher->stmt);
+		if (fetcher->timing)
+			INSTR_TIME_SET_CURRENT(end);
+		if (rc == SQLITE_ROW)
+		{
+			row = sqlite3_malloc(sizeof(sqlite3_value *) * Max(fetcher->ncols, 1));
+			if (row != NULL)
+			{
+				for (i = 0; i < fetcher->ncols; i++)
+				{
+					row[i] = sqlite3_value_dup(sqlite3_column_value(fetcher->stmt, i));
+					if (row[i] == NULL)
+					{
+						sqlite_async_free_row(row, i);
+						row = NULL;
+						break;
+					}
+				}
+			}
+			if (row == NULL)
+				rc = SQLITE_NOMEM;
+		}
+		if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+			errtext = sqlite3_mprintf("%s", sqlite3_errmsg(sqlite3_db_handle(fetcher->stmt)));
+		sqlite3_mutex_leave(db_mutex);
+
+		pthread_mutex_lock(&fetcher->lock);
+		if (fetcher->timing)
+			INSTR_TIME_ACCUM_DIFF(fetcher->step_time, end, start);
+		if (row != NULL)
+		{
+			fetcher->rows[(fetcher->head + fetcher->nrows) % SQLITE_ASYNC_RING_SIZE] = row;
+			fetcher->nrows++;
+			wakeup = (fetcher->nrows == 1);
+		}
+		else
+		{
+			fetcher->done = true;
+			fetcher->rc = rc;
+			fetcher->errmsg = errtext;
+			wakeup = true;
+		}
+		pthread_mutex_unlock(&fetcher->lock);
+
+		if (wakeup)
+			sqlite_async_wakeup(fetcher);
+		if (row == NULL)
+			break;
+	}
+
+	return NULL;
+}
+
+/*
+ * Make the readable end of the pipe ready.  A full pipe is ready anyway.
+ */
+static void
+sqlite_async_wakeup(SqliteAsyncFetcher * fetcher)
+{
+	char		c = 0;
+	ssize_t		rc;
+
+	rc = write(fetcher->pipe_fds[1], &c, 1);
+	(void) rc;					/* EAGAIN means the pipe is ready already */
+}
+
+static void
+sqlite_async_free_row(sqlite3_value * *row, int ncols)
+{
+	int			i;
+
+	for (i = 0; i < ncols; i++)
+		sqlite3_value_free(row[i]);
+	sqlite3_free(row);
+}
+#endif
@@ -0,0 +1,70 @@
+/* contrib/sqlite_fdw/sqlite_fdw--1.1--1.2.sql */
+
+-- complain if script is sourced in psql, rather than via ALTER EXTENSION
+\echo Use "ALTER EXTENSION sqlite_fdw UPDATE TO '1.2'" to load this file. \quit
+
+CREATE FUNCTION sqlite_fdw_connection_stats (OUT server_name text,
+    OUT valid boolean,
+    OUT xact_depth integer,
+    OUT cached_statements integer,
+    OUT statement_cache_hits bigint,
+    OUT statement_cache_misses bigint,
+    OUT statements_prepared bigint,
+    OUT rows_fetched bigint,
+    OUT rows_modified bigint,
+    OUT busy_retries bigint,
+    OUT cache_hit bigint,
+    OUT cache_miss bigint,
+    OUT cache_write bigint,
+    OUT cache_spill bigint,
+    OUT cache_used bigint,
+    OUT schema_used bigint,
+    OUT stmt_used bigint,
+    OUT lookaside_used bigint,
+    OUT lookaside_hit bigint,
+    OUT lookaside_miss_size bigint,
+    OUT lookaside_miss_full bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT PARALLEL RESTRICTED;
+
+COMMENT ON FUNCTION sqlite_fdw_connection_stats()
+IS 'lists opened SQLite connections with their runtime statistics';
+
+CREATE FUNCTION sqlite_fdw_stat_statements (OUT userid oid,
+    OUT dbid oid,
+    OUT serverid oid,
+    OUT queryid bigint,
+    OUT query text,
+    OUT calls bigint,
+    OUT total_time double precision,
+    OUT min_time double precision,
+    OUT max_time double precision,
+    OUT mean_time double precision,
+    OUT rows bigint,
+    OUT vm_steps bigint,
+    OUT fullscan_steps bigint,
+    OUT sorts bigint,
+    OUT autoindex bigint)
+RETURNS SETOF record
+AS 'MODULE_PATHNAME'
+LANGUAGE C STRICT VOLATILE PARALLEL SAFE;
+
+CREATE VIEW sqlite_fdw_stat_statements AS
+  SELECT * FROM sqlite_fdw_stat_statements();
+
+GRANT SELECT ON sqlite_fdw_stat_statements TO PUBLIC;
+
+CREATE FUNCTION sqlite_fdw_stat_statements_reset()
+RETURNS void
+AS 'MODULE_PATHNAME'
+LANGUAGE C PARALLEL SAFE;
+
+-- Don't want this to be available to non-superusers.
+REVOKE ALL ON FUNCTION sqlite_fdw_stat_statements_reset() FROM PUBLIC;
+
+COMMENT ON FUNCTION sqlite_fdw_stat_statements()
+IS 'shows cumulative statistics of remote SQLite statements';
+
+COMMENT ON FUNCTION sqlite_fdw_stat_statements_reset()
+IS 'discards statistics of remote SQLite statements';
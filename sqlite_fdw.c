@@ -15,10 +15,19 @@
 
 #include <sqlite3.h>
 
+#include "access/htup_details.h"
+#include "access/parallel.h"
 #include "catalog/pg_collation.h"
 #include "catalog/pg_type.h"
 #include "commands/defrem.h"
 #include "commands/explain.h"
+#include "commands/vacuum.h"
+#if PG_VERSION_NUM >= 130000
+	#include "common/hashfn.h"
+#endif
+#if PG_VERSION_NUM >= 140000
+	#include "executor/execAsync.h"
+#endif
 #include "foreign/fdwapi.h"
 #include "funcapi.h"
 #include "mb/pg_wchar.h"
@@ -47,10 +56,16 @@
 #include "parser/parsetree.h"
 #include "parser/parse_type.h"
 #include "storage/ipc.h"
+#if PG_VERSION_NUM >= 140000
+	#include "storage/latch.h"
+#endif
 #include "utils/builtins.h"
+#include "utils/datum.h"
 #include "utils/formatting.h"
 #include "utils/guc.h"
 #include "utils/lsyscache.h"
+#include "utils/memutils.h"
+#include "utils/sampling.h"
 #include "utils/selfuncs.h"
 
 
@@ -79,6 +94,19 @@ PG_MODULE_MAGIC;
 /* If no remote estimates, assume a sort costs 20% extra */
 #define DEFAULT_FDW_SORT_MULTIPLIER 1.2
 
+/*
+ * Mask applied to SQLite random() for Bernoulli sampling of rows during
+ * ANALYZE, the sample fraction is expressed in units of (mask + 1).
+ */
+#define SQLITE_ANALYZE_SAMPLE_MASK	1048575
+
+/*
+ * Number of rowid chunks per participant of a parallel foreign scan.  More
+ * chunks balance the work better when rows are not spread evenly over the
+ * rowid space, at the price of more statement executions.
+ */
+#define SQLITE_PARALLEL_CHUNKS_PER_PARTICIPANT	16
+
 /*
  * This enum describes what's kept in the fdw_private list for a ForeignPath.
  * We store:
@@ -109,6 +137,8 @@ enum FdwScanPrivateIndex
 	FdwScanPrivateRetrievedAttrs,
 	/* Integer representing UPDATE/DELETE target */
 	FdwScanPrivateForUpdate,
+	/* Integer, true if rows of repeated parameter values may be cached */
+	FdwScanPrivateLookupCache,
 #if (PG_VERSION_NUM < 100000)
 	/* rtindex */
 	FdwScanPrivateRtIndex,
@@ -130,6 +160,7 @@ enum FdwScanPrivateIndex
  *	  (NIL for a DELETE)
  * 3) Length till the end of VALUES clause for INSERT
  *	  (-1 for a DELETE/UPDATE)
+ * 4) Integer list of attribute numbers retrieved by RETURNING, if any
  */
 enum FdwModifyPrivateIndex
 {
@@ -138,7 +169,9 @@ enum FdwModifyPrivateIndex
 	/* Integer list of target attribute numbers for INSERT/UPDATE */
 	FdwModifyPrivateTargetAttnums,
 	/* Length till the end of VALUES clause (as an Integer node) */
-	FdwModifyPrivateLen
+	FdwModifyPrivateLen,
+	/* Integer list of attribute numbers retrieved by RETURNING */
+	FdwModifyPrivateRetrievedAttrs
 };
 
 /*
@@ -194,6 +227,28 @@ static void sqliteReScanForeignScan(ForeignScanState *node);
 
 static void sqliteEndForeignScan(ForeignScanState *node);
 
+static bool sqliteIsForeignScanParallelSafe(PlannerInfo *root,
+											RelOptInfo *rel,
+											RangeTblEntry *rte);
+static Size sqliteEstimateDSMForeignScan(ForeignScanState *node,
+										 ParallelContext *pcxt);
+static void sqliteInitializeDSMForeignScan(ForeignScanState *node,
+										   ParallelContext *pcxt,
+										   void *coordinate);
+static void sqliteReInitializeDSMForeignScan(ForeignScanState *node,
+											 ParallelContext *pcxt,
+											 void *coordinate);
+static void sqliteInitializeWorkerForeignScan(ForeignScanState *node,
+											  shm_toc *toc,
+											  void *coordinate);
+
+#if PG_VERSION_NUM >= 140000
+static bool sqliteIsForeignPathAsyncCapable(ForeignPath *path);
+static void sqliteForeignAsyncRequest(AsyncRequest *areq);
+static void sqliteForeignAsyncConfigureWait(AsyncRequest *areq);
+static void sqliteForeignAsyncNotify(AsyncRequest *areq);
+#endif
+
 
 static void sqliteAddForeignUpdateTargets(
 #if (PG_VERSION_NUM >= 140000)
@@ -241,6 +296,19 @@ static TupleTableSlot *sqliteExecForeignDelete(EState *estate,
 static void sqliteEndForeignModify(EState *estate,
 								   ResultRelInfo *rinfo);
 
+static SqliteFdwExecState *sqlite_create_foreign_modify(EState *estate,
+														ResultRelInfo *resultRelInfo,
+														CmdType operation,
+														Plan *subplan,
+														char *query,
+														List *target_attrs,
+														int values_end,
+														List *retrieved_attrs);
+static TupleTableSlot *sqlite_execute_foreign_modify(SqliteFdwExecState * fmstate,
+													 TupleTableSlot *slot);
+static void sqlite_store_returning_result(SqliteFdwExecState * fmstate,
+										  TupleTableSlot *slot);
+
 #if (PG_VERSION_NUM >= 110000)
 static void sqliteEndForeignInsert(EState *estate,
 								   ResultRelInfo *resultRelInfo);
@@ -274,6 +342,10 @@ static void sqliteExecForeignTruncate(List *rels,
 static bool sqliteAnalyzeForeignTable(Relation relation,
 									  AcquireSampleRowsFunc *func,
 									  BlockNumber *totalpages);
+static int	sqliteAcquireSampleRowsFunc(Relation relation, int elevel,
+										HeapTuple *rows, int targrows,
+										double *totalrows,
+										double *totaldeadrows);
 
 static int sqliteIsForeignRelUpdatable(Relation rel);
 
@@ -304,6 +376,17 @@ static void sqlite_prepare_wrapper(ForeignServer *server,
 								   const char **pzTail,
 								   bool is_cache);
 static void sqlite_to_pg_type(StringInfo str, char *typname);
+static void sqlite_import_schema_sql(StringInfo buf, ImportForeignSchemaStmt *stmt,
+									 sqlite3 * db, bool import_estimated_rows);
+static char *sqlite_import_table_command(ForeignServer *server, sqlite3 * db,
+										 ImportForeignSchemaStmt *stmt,
+										 const char *table, List *columns,
+										 bool strict, sqlite3_int64 rows,
+										 bool import_default, bool import_not_null,
+										 bool import_strict_affinity);
+static void sqlite_import_profile_affinity(ForeignServer *server, sqlite3 * db,
+										   const char *table, List *columns,
+										   bool strict);
 
 static TupleTableSlot **sqlite_execute_insert(EState *estate,
 											  ResultRelInfo *resultRelInfo,
@@ -315,21 +398,29 @@ static TupleTableSlot **sqlite_execute_insert(EState *estate,
 static void sqlite_prepare_query_params(PlanState *node,
 										List *fdw_exprs,
 										int numParams,
-										FmgrInfo **param_flinfo,
 										List **param_exprs,
-										const char ***param_values,
-										Oid **param_types);
+										SqliteBindInfo **param_binds);
 
 static void sqlite_process_query_params(ExprContext *econtext,
-										FmgrInfo *param_flinfo,
 										List *param_exprs,
-										const char **param_values,
 										sqlite3_stmt * *stmt,
-										Oid *param_types,
-										Oid foreignTableId);
+										SqliteBindInfo *param_binds,
+										StringInfo key);
 
 static void sqlite_create_cursor(ForeignScanState *node);
+static void sqlite_append_lookup_key(StringInfo key, SqliteBindInfo *bind,
+									 Datum value, bool isnull);
+static void sqlite_lookup_init(ForeignScanState *node);
+static bool sqlite_lookup_begin(SqliteFdwExecState * festate, StringInfo key);
+static void sqlite_lookup_add_row(SqliteFdwExecState * festate, TupleTableSlot *slot);
+static void sqlite_lookup_discard(SqliteFdwExecState * festate);
+static void sqlite_lookup_end(SqliteFdwExecState * festate);
+static uint32 sqlite_lookup_hash(const void *key, Size keysize);
+static int	sqlite_lookup_match(const void *key1, const void *key2, Size keysize);
+static void sqlite_materialize_scan(ForeignScanState *node);
+static List *sqlite_get_query_plan(sqlite3 * conn, const char *query);
 static void sqlite_execute_dml_stmt(ForeignScanState *node);
+static TupleTableSlot *sqlite_get_returning_data(ForeignScanState *node);
 static void sqlite_merge_fdw_options(SqliteFdwRelationInfo * fpinfo,
 									 const SqliteFdwRelationInfo * fpinfo_o,
 									 const SqliteFdwRelationInfo * fpinfo_i);
@@ -354,10 +445,15 @@ static void sqlite_add_foreign_final_paths(PlannerInfo *root,
 
 static void sqlite_get_remote_estimate(const char *sql,
 									   sqlite3 * conn,
+									   PlannerInfo *root,
+									   RelOptInfo *foreignrel,
 									   double *rows,
-									   int *width,
 									   Cost *startup_cost,
 									   Cost *total_cost);
+static double sqlite_get_remote_reltuples(ForeignServer *server, Oid foreigntableid);
+static bool sqlite_parse_eqp_step(const char *detail, bool *is_search, char *alias,
+								  const char **rest);
+static bool sqlite_get_int64_value(sqlite3 * db, const char *sql, sqlite3_int64 *value);
 static void sqlite_estimate_path_cost_size(PlannerInfo *root,
 										   RelOptInfo *foreignrel,
 										   List *param_join_conds,
@@ -368,6 +464,8 @@ static void sqlite_estimate_path_cost_size(PlannerInfo *root,
 static bool sqlite_foreign_join_ok(PlannerInfo *root, RelOptInfo *joinrel,
 								   JoinType jointype, RelOptInfo *outerrel, RelOptInfo *innerrel,
 								   JoinPathExtraData *extra);
+static bool sqlite_refers_to_rels(Node *node, Relids relids);
+static bool sqlite_conds_refer_to_rels(List *conds, Relids relids);
 static void sqlite_adjust_foreign_grouping_path_cost(PlannerInfo *root,
 													 List *pathkeys,
 													 double retrieved_rows,
@@ -383,8 +481,21 @@ static bool sqlite_all_baserels_are_foreign(PlannerInfo *root);
 static void sqlite_add_paths_with_pathkeys_for_rel(PlannerInfo *root, RelOptInfo *rel, List *fdw_private, Path *epq_path);
 static List *sqlite_get_useful_pathkeys_for_relation(PlannerInfo *root,
 													 RelOptInfo *rel);
-#if PG_VERSION_NUM >= 140000
 static int	sqlite_get_batch_size_option(Relation rel);
+static void sqlite_buffer_delete_keys(SqliteFdwExecState * fmstate, TupleTableSlot *planSlot);
+static void sqlite_execute_batch_delete(SqliteFdwExecState * fmstate);
+static Datum sqlite_get_junk_key_value(SqliteFdwExecState * fmstate, TupleTableSlot *planSlot,
+									   int attnum, bool *is_null);
+static SqliteBindInfo *sqlite_key_bind_info(SqliteFdwExecState * fmstate, int attnum);
+static int	sqlite_get_parallel_workers_option(Oid foreigntableid);
+static bool sqlite_has_key_column(Oid foreigntableid);
+static bool sqlite_is_rowid_identity(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid);
+static void sqlite_init_parallel_scan(SqliteFdwExecState * festate,
+									  SqliteFdwParallelScanState * pscan,
+									  int nworkers);
+static bool sqlite_next_rowid_range(SqliteFdwExecState * festate);
+#if PG_VERSION_NUM >= 140000
+static void sqlite_produce_tuple_asynchronously(AsyncRequest *areq);
 #endif
 static void conversion_error_callback(void *arg);
 static int32 sqlite_affinity_eqv_to_pgtype(Oid type);
@@ -411,6 +522,87 @@ typedef struct ConversionLocation
 	sqlite3_value *val;			/* abstract SQLite value to get affinity, length and text value */
 } ConversionLocation;
 
+/*
+ * Key of the lookup cache of a parameterized scan: the binary values of the
+ * query parameters
+ */
+typedef struct SqliteLookupKey
+{
+	Size		len;			/* length of data */
+	const char *data;			/* parameter values, owned by the entry */
+} SqliteLookupKey;
+
+/*
+ * Rows fetched by a parameterized scan for one set of parameter values
+ */
+struct SqliteLookupEntry
+{
+	SqliteLookupKey key;		/* hash key (must be first) */
+	HeapTuple  *rows;			/* the rows, allocated in lookup_cxt */
+	int			nrows;			/* number of rows */
+	int			maxrows;		/* allocated length of rows */
+	bool		complete;		/* all rows of the scan have been added */
+};
+
+/*
+ * A scan gives up caching if this many executions of the statement were not
+ * followed by any cache hit
+ */
+#define SQLITE_LOOKUP_MIN_MISSES	64
+
+/*
+ * Column of a SQLite table being imported by IMPORT FOREIGN SCHEMA
+ */
+typedef struct SqliteImportColumn
+{
+	char	   *name;			/* SQLite column name */
+	char	   *type_name;		/* declared SQLite data type, or NULL */
+	char	   *pg_type;		/* PostgreSQL data type of the column */
+	bool		not_null;
+	char	   *default_val;
+	bool		primary_key;
+	const char *strict_affinity;	/* value of the strict_affinity option,
+									 * or NULL not to set it */
+} SqliteImportColumn;
+
+/* Counters of sqlite3_stmt_status() shown by EXPLAIN ANALYZE of a scan */
+static const struct
+{
+	int			op;
+	const char *label;
+}			sqlite_scan_stmt_counters[] =
+{
+	{SQLITE_STMTSTATUS_VM_STEP, "SQLite VM Steps"},
+	{SQLITE_STMTSTATUS_FULLSCAN_STEP, "SQLite Full Scan Steps"},
+	{SQLITE_STMTSTATUS_SORT, "SQLite Sorts"},
+	{SQLITE_STMTSTATUS_AUTOINDEX, "SQLite Autoindex Rows"},
+};
+
+/*
+ * Measure the time of a part of a scan or modification for EXPLAIN ANALYZE
+ * and statement statistics.  The time elapsed since sqlite_timer_start() is
+ * added to *total.
+ */
+static inline void
+sqlite_timer_start(SqliteFdwExecState * festate, instr_time *start)
+{
+	if (festate->instrument_timer)
+		INSTR_TIME_SET_CURRENT(*start);
+}
+
+static inline void
+sqlite_timer_stop(SqliteFdwExecState * festate, instr_time *total,
+					   instr_time *start)
+{
+	if (festate->instrument_timer)
+	{
+		instr_time	end;
+
+		INSTR_TIME_SET_CURRENT(end);
+		INSTR_TIME_ACCUM_DIFF(*total, end, *start);
+	}
+}
+
 /*
  * Library load-time initialization, sets on_proc_exit() callback for
  * backend shutdown.
@@ -418,6 +610,7 @@ typedef struct ConversionLocation
 void
 _PG_init(void)
 {
+	sqlite_stat_init();
 	on_proc_exit(&sqlite_fdw_exit, PointerGetDatum(NULL));
 }
 
@@ -427,6 +620,7 @@ _PG_init(void)
 static void
 sqlite_fdw_exit(int code, Datum arg)
 {
+	sqlite_async_stop_all();
 	sqlite_cleanup_connection();
 }
 
@@ -447,6 +641,21 @@ sqlite_fdw_handler(PG_FUNCTION_ARGS)
 	fdwroutine->ReScanForeignScan = sqliteReScanForeignScan;
 	fdwroutine->EndForeignScan = sqliteEndForeignScan;
 
+	/* Support functions for parallel scans */
+	fdwroutine->IsForeignScanParallelSafe = sqliteIsForeignScanParallelSafe;
+	fdwroutine->EstimateDSMForeignScan = sqliteEstimateDSMForeignScan;
+	fdwroutine->InitializeDSMForeignScan = sqliteInitializeDSMForeignScan;
+	fdwroutine->ReInitializeDSMForeignScan = sqliteReInitializeDSMForeignScan;
+	fdwroutine->InitializeWorkerForeignScan = sqliteInitializeWorkerForeignScan;
+
+#if PG_VERSION_NUM >= 140000
+	/* Support functions for asynchronous execution */
+	fdwroutine->IsForeignPathAsyncCapable = sqliteIsForeignPathAsyncCapable;
+	fdwroutine->ForeignAsyncRequest = sqliteForeignAsyncRequest;
+	fdwroutine->ForeignAsyncConfigureWait = sqliteForeignAsyncConfigureWait;
+	fdwroutine->ForeignAsyncNotify = sqliteForeignAsyncNotify;
+#endif
+
 	fdwroutine->IsForeignRelUpdatable = sqliteIsForeignRelUpdatable;
 	fdwroutine->AddForeignUpdateTargets = sqliteAddForeignUpdateTargets;
 	fdwroutine->PlanForeignModify = sqlitePlanForeignModify;
@@ -505,8 +714,18 @@ sqlite_prepare_wrapper(ForeignServer *server, sqlite3 * db, char *query, sqlite3
 					   const char **pzTail, bool is_cache)
 {
 	int			rc;
+	SqliteConnStats *conn_stats;
 
 	elog(DEBUG1, "sqlite_fdw : %s %s\n", __func__, query);
+
+	/* Reuse the statement prepared by an earlier query, if any */
+	if (is_cache)
+	{
+		*stmt = sqlite_get_cached_stmt(server, db, query);
+		if (*stmt != NULL)
+			return;
+	}
+
 	rc = sqlite3_prepare_v2(db, query, -1, stmt, pzTail);
 	if (rc != SQLITE_OK)
 	{
@@ -515,12 +734,40 @@ sqlite_prepare_wrapper(ForeignServer *server, sqlite3 * db, char *query, sqlite3
 				 errmsg("SQL error during prepare: %s %s", sqlite3_errmsg(db), query)
 				 ));
 	}
-	/* cache stmt to finalize at last */
+	conn_stats = sqlite_get_connection_stats(server);
+	if (conn_stats)
+		conn_stats->stmts_prepared++;
+
+	/* cache stmt to reuse it, or at least to finalize at last */
 	if (is_cache)
-		sqlite_cache_stmt(server, stmt);
+		sqlite_cache_stmt(server, db, query, stmt);
 }
 
 
+/*
+ * Size of a foreign table which has never been analyzed.  The estimated_rows
+ * option is the number of rows from sqlite_stat1 at the time of IMPORT FOREIGN
+ * SCHEMA.  Without it use a minimum size estimate of 10 pages, and divide by
+ * the column-datatype-based width estimate to get the corresponding number of
+ * tuples.
+ */
+static void
+sqlite_estimate_unanalyzed_rel_size(RelOptInfo *baserel, double estimated_rows)
+{
+	if (estimated_rows >= 0)
+	{
+		baserel->tuples = estimated_rows;
+		baserel->pages = (BlockNumber) Max(1, ceil(estimated_rows * (baserel->reltarget->width + MAXALIGN(SizeofHeapTupleHeader)) / BLCKSZ));
+	}
+	else
+	{
+		baserel->pages = 10;
+		baserel->tuples =
+			(10 * BLCKSZ) / (baserel->reltarget->width +
+							 MAXALIGN(SizeofHeapTupleHeader));
+	}
+}
+
 /*
  * sqliteGetForeignRelSize: Create a FdwPlan for a scan on the foreign table
  */
@@ -529,9 +776,6 @@ sqliteGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntable
 {
 	SqliteFdwRelationInfo *fpinfo;
 	ListCell   *lc;
-#if PG_VERSION_NUM < 160000
-	RangeTblEntry *rte = planner_rt_fetch(baserel->relid, root);
-#endif
 
 	elog(DEBUG1, "sqlite_fdw : %s", __func__);
 
@@ -549,28 +793,39 @@ sqliteGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntable
 	 * use_remote_estimate overrides per-server setting.
 	 */
 	fpinfo->use_remote_estimate = false;
+	fpinfo->async_capable = false;
+	fpinfo->estimated_rows = -1;
 	fpinfo->fdw_startup_cost = DEFAULT_FDW_STARTUP_COST;
 	fpinfo->fdw_tuple_cost = DEFAULT_FDW_TUPLE_COST;
 
-	/*
-	 * If the table or the server is configured to use remote estimates,
-	 * identify which user to do remote access as during planning.
-	 * This should match what ExecCheckPermissions() does (ExecCheckRTEPerms() for older version).
-	 * If we fail due to lack of permissions, the query would have failed at runtime anyway.
-	 */
-	if (fpinfo->use_remote_estimate)
+	foreach(lc, fpinfo->server->options)
 	{
-#if (PG_VERSION_NUM < 160000)
-		Oid			userid = rte->checkAsUser ? rte->checkAsUser : GetUserId();
-#else
-		Oid			userid;
-		userid = OidIsValid(baserel->userid) ? baserel->userid : GetUserId();
-#endif
+		DefElem    *def = (DefElem *) lfirst(lc);
 
-		fpinfo->user = GetUserMapping(userid, fpinfo->server->serverid);
+		if (strcmp(def->defname, "use_remote_estimate") == 0)
+			fpinfo->use_remote_estimate = defGetBoolean(def);
+		else if (strcmp(def->defname, "async_capable") == 0)
+			fpinfo->async_capable = defGetBoolean(def);
 	}
-	else
-		fpinfo->user = NULL;
+	foreach(lc, fpinfo->table->options)
+	{
+		DefElem    *def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "use_remote_estimate") == 0)
+			fpinfo->use_remote_estimate = defGetBoolean(def);
+		else if (strcmp(def->defname, "async_capable") == 0)
+			fpinfo->async_capable = defGetBoolean(def);
+		else if (strcmp(def->defname, "estimated_rows") == 0)
+			fpinfo->estimated_rows = strtod(defGetString(def), NULL);
+	}
+
+	fpinfo->parallel_workers = sqlite_get_parallel_workers_option(foreigntableid);
+
+	/*
+	 * SQLite connections are made per server without any user mapping, so
+	 * remote estimates don't need to identify the user.
+	 */
+	fpinfo->user = NULL;
 
 	/*
 	 * Identify which baserestrictinfo clauses can be sent to the remote
@@ -597,6 +852,15 @@ sqliteGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntable
 		pull_varattnos((Node *) rinfo->clause, baserel->relid, &fpinfo->attrs_used);
 	}
 
+	/*
+	 * ctid is the SQLite rowid only for the rows of UPDATE or DELETE of a
+	 * table without key columns, otherwise it is not fetched.
+	 */
+	fpinfo->rowid_identity = sqlite_is_rowid_identity(root, baserel, foreigntableid);
+	if (!fpinfo->rowid_identity)
+		fpinfo->attrs_used = bms_del_member(fpinfo->attrs_used,
+											SelfItemPointerAttributeNumber - FirstLowInvalidHeapAttributeNumber);
+
 	/*
 	 * Compute the selectivity and cost of the local_conds, so we don't have
 	 * to do it over again for each path.  The best we can do for these
@@ -629,6 +893,33 @@ sqliteGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntable
 	 */
 	if (fpinfo->use_remote_estimate)
 	{
+		double		remote_tuples;
+
+		/*
+		 * SQLite doesn't estimate rows of a query, but the number of rows of
+		 * the table is known if it was analyzed in SQLite.  Use it instead
+		 * of local statistics, which can be outdated or absent.
+		 */
+		remote_tuples = sqlite_get_remote_reltuples(fpinfo->server, foreigntableid);
+		if (remote_tuples >= 0)
+		{
+			baserel->tuples = remote_tuples;
+			if (baserel->pages == 0)
+				baserel->pages = (BlockNumber) Max(1, ceil(remote_tuples * (baserel->reltarget->width + MAXALIGN(SizeofHeapTupleHeader)) / BLCKSZ));
+		}
+#if (PG_VERSION_NUM >= 140000)
+		else if (baserel->tuples < 0)
+#else
+		else if (baserel->pages == 0 && baserel->tuples == 0)
+#endif
+			sqlite_estimate_unanalyzed_rel_size(baserel, fpinfo->estimated_rows);
+
+		/*
+		 * Selectivity of conditions not used by SQLite indexes is still
+		 * estimated with local statistics.
+		 */
+		set_baserel_size_estimates(root, baserel);
+
 		/*
 		 * Get cost/size estimates with help of remote server.  Save the
 		 * values in fpinfo so we don't need to do it again to generate the
@@ -649,21 +940,15 @@ sqliteGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntable
 		 * and reltuples equal to zero, which most likely has nothing to do
 		 * with reality.  We can't do a whole lot about that if we're not
 		 * allowed to consult the remote server, but we can use a hack similar
-		 * to plancat.c's treatment of empty relations: use a minimum size
-		 * estimate of 10 pages, and divide by the column-datatype-based width
-		 * estimate to get the corresponding number of tuples.
+		 * to plancat.c's treatment of empty relations, unless the number of
+		 * rows is known from IMPORT FOREIGN SCHEMA.
 		 */
 #if (PG_VERSION_NUM >= 140000)
 		if (baserel->tuples < 0)
 #else
 		if (baserel->pages == 0 && baserel->tuples == 0)
 #endif
-		{
-			baserel->pages = 10;
-			baserel->tuples =
-				(10 * BLCKSZ) / (baserel->reltarget->width +
-								 MAXALIGN(SizeofHeapTupleHeader));
-		}
+			sqlite_estimate_unanalyzed_rel_size(baserel, fpinfo->estimated_rows);
 
 		/*
 		 * Estimate baserel size as best we can with local statistics.
@@ -688,6 +973,7 @@ sqliteGetForeignRelSize(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntable
 	fpinfo->make_outerrel_subquery = false;
 	fpinfo->make_innerrel_subquery = false;
 	fpinfo->lower_subquery_rels = NULL;
+	fpinfo->hidden_subquery_rels = NULL;
 	/* Set the relation index. */
 	fpinfo->relation_index = baserel->relid;
 }
@@ -964,6 +1250,63 @@ sqliteGetForeignPaths(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid
 	/* Add paths with pathkeys */
 	sqlite_add_paths_with_pathkeys_for_rel(root, baserel, fdw_private, NULL);
 
+	/*
+	 * Add a parallel-aware path if the foreign table is configured for
+	 * parallel scans.  Participants scan disjoint rowid ranges of the table,
+	 * so the rows and the run cost are divided among them.  Tables without
+	 * rowid, views and empty tables are always scanned serially.
+	 */
+	if (baserel->consider_parallel &&
+		fpinfo->parallel_workers > 0 &&
+		bms_is_empty(baserel->lateral_relids))
+	{
+		int			parallel_workers = Min(fpinfo->parallel_workers,
+										   max_parallel_workers_per_gather);
+		Relation	rel;
+		StringInfoData sql;
+		sqlite3_int64 min_rowid;
+
+		/*
+		 * Core code already has some lock on each rel being planned, so we
+		 * can use NoLock here.
+		 */
+		rel = table_open(foreigntableid, NoLock);
+		initStringInfo(&sql);
+		sqlite_deparse_rowid_bound_sql(&sql, rel, false);
+		table_close(rel, NoLock);
+
+		if (parallel_workers > 0 &&
+			sqlite_get_int64_value(sqlite_get_connection(fpinfo->server, false),
+								   sql.data, &min_rowid))
+		{
+			double		parallel_divisor = parallel_workers;
+
+			/* Account for the leader like cost_seqscan() does */
+			if (parallel_leader_participation)
+			{
+				double		leader_contribution;
+
+				leader_contribution = 1.0 - (0.3 * parallel_workers);
+				if (leader_contribution > 0)
+					parallel_divisor += leader_contribution;
+			}
+
+			path = create_foreignscan_path(root, baserel,
+										   NULL,	/* default pathtarget */
+										   clamp_row_est(baserel->rows / parallel_divisor),
+										   startup_cost,
+										   startup_cost + (total_cost - startup_cost) / parallel_divisor,
+										   NIL, /* no pathkeys */
+										   NULL,	/* no outer rel either */
+										   NULL,	/* no extra plan */
+										   NIL);	/* no fdw_private */
+			path->path.parallel_aware = true;
+			path->path.parallel_safe = true;
+			path->path.parallel_workers = parallel_workers;
+			add_partial_path(baserel, (Path *) path);
+		}
+	}
+
 	/*
 	 * If we're not using remote estimates, stop here.  We have no way to
 	 * estimate whether any join clauses would be worth sending across, so
@@ -1168,6 +1511,7 @@ sqliteGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid,
 	ListCell   *lc;
 	List	   *fdw_recheck_quals = NIL;
 	int			for_update;
+	bool		lookup_cache;
 
 	elog(DEBUG1, "sqlite_fdw : %s", __func__);
 
@@ -1366,6 +1710,13 @@ sqliteGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid,
 									   has_final_sort, has_limit, false,
 									   &retrieved_attrs, &params_list);
 
+	/*
+	 * A parallel-aware scan fetches the rows of a rowid range at a time, the
+	 * bounds of the range are bound after the other parameters.
+	 */
+	if (best_path->path.parallel_aware)
+		sqlite_append_rowid_range_cond(&sql, remote_exprs == NIL);
+
 	/* Remember remote_exprs for possible use by sqlitePlanDirectModify */
 	fpinfo->final_remote_exprs = remote_exprs;
 
@@ -1378,11 +1729,25 @@ sqliteGetForeignPlan(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid,
 		for_update = true;
 	}
 
+	/*
+	 * Rows of repeated parameter values are cached by the scan when it is
+	 * rescanned, see sqlite_lookup_init.  Since PostgreSQL 14 the rescans of
+	 * the inner side of a parameterized nested loop are left to Memoize,
+	 * which caches them above the scan, so only the rescans of a correlated
+	 * subquery are cached.
+	 */
+#if PG_VERSION_NUM >= 140000
+	lookup_cache = (best_path->path.param_info == NULL);
+#else
+	lookup_cache = true;
+#endif
+
 	/*
 	 * Build the fdw_private list that will be available to the executor.
 	 * Items in the list must match enum FdwScanPrivateIndex, above.
 	 */
-	fdw_private = list_make3(makeString(sql.data), retrieved_attrs, makeInteger(for_update));
+	fdw_private = list_make4(makeString(sql.data), retrieved_attrs,
+							 makeInteger(for_update), makeInteger(lookup_cache));
 #if (PG_VERSION_NUM < 100000)
 	fdw_private = lappend(fdw_private, makeInteger(root->all_baserels == NULL ? -2 : bms_next_member(root->all_baserels, -1)));
 #endif
@@ -1488,7 +1853,6 @@ sqliteBeginForeignScan(ForeignScanState *node, int eflags)
 	 */
 	festate = (SqliteFdwExecState *) palloc0(sizeof(SqliteFdwExecState));
 	node->fdw_state = (void *) festate;
-	festate->rowidx = 0;
 
 	/*
 	 * Identify which user to do the remote access as.  This should match what
@@ -1530,8 +1894,38 @@ sqliteBeginForeignScan(ForeignScanState *node, int eflags)
 	festate->query = strVal(list_nth(fsplan->fdw_private, FdwScanPrivateSelectSql));
 	festate->retrieved_attrs = list_nth(fsplan->fdw_private, FdwScanPrivateRetrievedAttrs);
 	festate->for_update = intVal(list_nth(fsplan->fdw_private, FdwScanPrivateForUpdate)) ? true : false;
+	festate->lookup_disabled = intVal(list_nth(fsplan->fdw_private, FdwScanPrivateLookupCache)) ? false : true;
 	festate->conn = conn;
+	festate->conn_stats = sqlite_get_connection_stats(festate->server);
 	festate->cursor_exists = false;
+	festate->instrument = (estate->es_instrument != 0);
+	festate->instrument_timer = (estate->es_instrument & INSTRUMENT_TIMER) != 0 ||
+		sqlite_stat_timing_enabled();
+#if PG_VERSION_NUM >= 140000
+	/*
+	 * A connection opened before async_capable was set for the table is not
+	 * in serialized mode, its rows are fetched without a background thread.
+	 */
+	festate->async_capable = node->ss.ps.async_capable && !festate->for_update &&
+		sqlite3_db_mutex(conn) != NULL;
+#endif
+
+	/*
+	 * The target of UPDATE or DELETE doesn't need to be fetched completely
+	 * before the first modification, if it can be read through a connection
+	 * which doesn't see the modifications.
+	 */
+	if (festate->for_update)
+	{
+		sqlite3    *snapshot_conn = sqlite_get_snapshot_connection(festate->server);
+
+		if (snapshot_conn != NULL)
+		{
+			festate->conn = snapshot_conn;
+			festate->for_update = false;
+			festate->snapshot_scan = true;
+		}
+	}
 
 	/*
 	 * Get info we'll need for converting data fetched from the foreign server
@@ -1553,6 +1947,8 @@ sqliteBeginForeignScan(ForeignScanState *node, int eflags)
 	}
 
 	festate->attinmeta = TupleDescGetAttInMetadata(festate->tupdesc);
+	festate->converters = sqlite_get_value_converters(festate->tupdesc,
+													  festate->retrieved_attrs);
 
 	/* Initialize the Sqlite statement */
 	festate->stmt = NULL;
@@ -1560,6 +1956,22 @@ sqliteBeginForeignScan(ForeignScanState *node, int eflags)
 	/* Prepare Sqlite statement */
 	sqlite_prepare_wrapper(festate->server, festate->conn, festate->query, &festate->stmt, NULL, true);
 
+	/*
+	 * Counters of a cached statement include its earlier executions, so start
+	 * them from zero for EXPLAIN ANALYZE and statement statistics.
+	 */
+	sqlite_stat_begin(festate->stmt);
+	if (festate->instrument)
+	{
+		int			hiwtr;
+		int			i;
+
+		for (i = 0; i < lengthof(sqlite_scan_stmt_counters); i++)
+			sqlite3_stmt_status(festate->stmt, sqlite_scan_stmt_counters[i].op, 1);
+		sqlite3_db_status(festate->conn, SQLITE_DBSTATUS_CACHE_MISS,
+						  &festate->cache_miss_start, &hiwtr, 0);
+	}
+
 	/* Prepare for output conversion of parameters used in remote query. */
 	numParams = list_length(fsplan->fdw_exprs);
 	festate->numParams = numParams;
@@ -1567,19 +1979,27 @@ sqliteBeginForeignScan(ForeignScanState *node, int eflags)
 		sqlite_prepare_query_params((PlanState *) node,
 									fsplan->fdw_exprs,
 									numParams,
-									&festate->param_flinfo,
 									&festate->param_exprs,
-									&festate->param_values,
-									&festate->param_types);
+									&festate->param_binds);
 }
 
+/*
+ * Build the values of a tuple from the current row of stmt, or from values
+ * fetched in advance by a background fetcher if values is not NULL.  The
+ * SQLite rowid, if retrieved, is stored into *ctid.  rel is the foreign
+ * table, or NULL for a join or an upper relation.
+ */
 static void
 make_tuple_from_result_row(sqlite3_stmt * stmt,
+						   sqlite3_value * *values,
 						   TupleDesc tupleDescriptor,
 						   List *retrieved_attrs,
 						   Datum *row,
 						   bool *is_null,
-						   SqliteFdwExecState * festate,
+						   ItemPointer ctid,
+						   Relation rel,
+						   AttInMetadata *attinmeta,
+						   SqliteValueConverter *converters,
 						   ForeignScanState *node)
 {
 	ConversionLocation errpos;
@@ -1596,7 +2016,7 @@ make_tuple_from_result_row(sqlite3_stmt * stmt,
 	 */
 	errpos.cur_attno = 0;
 	errpos.att = NULL;
-	errpos.rel = festate->rel;
+	errpos.rel = rel;
 	errpos.fsstate = node;
 	errpos.val = NULL;
 	errcallback.callback = conversion_error_callback;
@@ -1607,10 +2027,20 @@ make_tuple_from_result_row(sqlite3_stmt * stmt,
 	foreach(lc, retrieved_attrs)
 	{
 		int					attnum = lfirst_int(lc) - 1;
-		Form_pg_attribute   att = TupleDescAttr(tupleDescriptor, attnum);
-		sqlite3_value	   *val = sqlite3_column_value(stmt, stmt_colid);
+		Form_pg_attribute   att;
+		sqlite3_value	   *val = values ? values[stmt_colid] : sqlite3_column_value(stmt, stmt_colid);
 		int					sqlite_value_affinity = sqlite3_value_type(val);
 
+		/* rowid identifying the row for UPDATE or DELETE */
+		if (attnum + 1 == SelfItemPointerAttributeNumber)
+		{
+			if (sqlite_value_affinity == SQLITE_INTEGER)
+				sqlite_rowid_to_tid(sqlite3_value_int64(val), ctid);
+			stmt_colid++;
+			continue;
+		}
+		att = TupleDescAttr(tupleDescriptor, attnum);
+
 		errpos.cur_attno = attnum;
 		errpos.att = att;
 		errpos.val = val;
@@ -1625,10 +2055,10 @@ make_tuple_from_result_row(sqlite3_stmt * stmt,
 			 * Flags about special convert behaviour from options on database, table or column level
 			 */
 
-			sqlite_coverted = sqlite_convert_to_pg(att, val,
-												   festate->attinmeta,
-												   attnum, sqlite_value_affinity,
-												   AffinityBehaviourFlags);
+			sqlite_coverted = converters[stmt_colid] (att, val,
+													  attinmeta,
+													  attnum, sqlite_value_affinity,
+													  AffinityBehaviourFlags);
 			if (!sqlite_coverted.isnull) {
 				is_null[attnum] = false;
 				row[attnum] = sqlite_coverted.value;
@@ -1667,92 +2097,168 @@ sqliteIterateForeignScan(ForeignScanState *node)
 
 	ExecClearTuple(tupleSlot);
 
+	/* Rows of these parameter values have been cached by an earlier scan */
+	if (festate->lookup_entry != NULL && !festate->lookup_filling)
+	{
+		if (festate->lookup_pos < festate->lookup_entry->nrows)
+		{
+			HeapTuple	tuple = festate->lookup_entry->rows[festate->lookup_pos++];
+
+			heap_deform_tuple(tuple, tupleDescriptor, tupleSlot->tts_values,
+							  tupleSlot->tts_isnull);
+			tupleSlot->tts_tid = tuple->t_self;
+			ExecStoreVirtualTuple(tupleSlot);
+		}
+		return tupleSlot;
+	}
+
+#if PG_VERSION_NUM >= 140000
 	/*
-	 * We get all rows before starting update if this scan is for update
-	 * because there is no isolation between update and select on the same
-	 * database connections. Please see for details:
-	 * https://sqlite.org/isolation.html
+	 * An asynchronous scan gets rows from its background fetcher.  If no row
+	 * is ready yet, return an empty slot; eof_reached tells it from the end
+	 * of the scan.
 	 */
-	if (festate->for_update && festate->rowidx == 0)
+	if (festate->async_capable)
 	{
-		int			size = 0;
+		sqlite3_value **row;
 
-		/* festate->rows need longer context than per tuple */
-		MemoryContext oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+		if (festate->fetcher == NULL && !festate->eof_reached)
+			festate->fetcher = sqlite_async_start(festate->stmt,
+												  festate->instrument_timer);
 
-		festate->row_nums = 0;
-		festate->rowidx = 0;
-		while (1)
+		if (festate->fetcher != NULL &&
+			sqlite_async_next_row(festate->fetcher, &row, &rc,
+								  &festate->step_time))
 		{
-			rc = sqlite3_step(festate->stmt);
-			if (rc == SQLITE_ROW)
+			if (SQLITE_ROW == rc)
 			{
+				instr_time	start;
 
-				if (size == 0)
+				sqlite_timer_start(festate, &start);
+				PG_TRY();
 				{
-					size = 1;
-					festate->rows = palloc(sizeof(Datum *) * size);
-					festate->rows_isnull = palloc(sizeof(bool *) * size);
+					make_tuple_from_result_row(festate->stmt, row,
+											   tupleDescriptor,
+											   festate->retrieved_attrs,
+											   tupleSlot->tts_values,
+											   tupleSlot->tts_isnull,
+											   &tupleSlot->tts_tid,
+											   festate->rel,
+											   festate->attinmeta,
+											   festate->converters,
+											   node);
 				}
-				else if (festate->row_nums >= size)
+				PG_FINALLY();
 				{
-					/* expand array */
-					size = size * 2;
-					festate->rows = repalloc(festate->rows, sizeof(Datum *) * size);
-					festate->rows_isnull = repalloc(festate->rows_isnull, sizeof(bool *) * size);
+					sqlite_async_release_row(festate->fetcher, row);
 				}
-				festate->rows[festate->row_nums] = palloc(sizeof(Datum) * tupleDescriptor->natts);
-				festate->rows_isnull[festate->row_nums] = palloc(sizeof(bool) * tupleDescriptor->natts);
-				make_tuple_from_result_row(festate->stmt,
-										   tupleDescriptor, festate->retrieved_attrs,
-										   festate->rows[festate->row_nums],
-										   festate->rows_isnull[festate->row_nums],
-										   festate,
-										   node);
-
-				festate->row_nums++;
-
-			}
-			else if (SQLITE_DONE == rc)
-			{
-				/* No more rows/data exists */
-				break;
+				PG_END_TRY();
+				sqlite_timer_stop(festate, &festate->convert_time, &start);
+				ExecStoreVirtualTuple(tupleSlot);
+				festate->rows_fetched++;
+				if (festate->conn_stats)
+					festate->conn_stats->rows_fetched++;
 			}
 			else
 			{
-				sqlitefdw_report_error(ERROR, festate->stmt, festate->conn, NULL, rc);
+				festate->eof_reached = true;
+				if (SQLITE_DONE != rc)
+				{
+					const char *message = sqlite_async_errmsg(festate->fetcher);
+
+					ereport(ERROR,
+							(errcode(ERRCODE_FDW_ERROR),
+							 errmsg("Failed to execute remote SQL"),
+							 errcontext("SQL query: %s", festate->query),
+							 errhint("SQLite error '%s', SQLite result code %d", message ? message : "", rc)
+							 ));
+				}
 			}
 		}
-		MemoryContextSwitchTo(oldcontext);
+		return tupleSlot;
 	}
+#endif
+
+	/*
+	 * We get all rows before starting update if this scan is for update
+	 * because there is no isolation between update and select on the same
+	 * database connections. Please see for details:
+	 * https://sqlite.org/isolation.html
+	 */
+	if (festate->for_update && festate->rows == NULL)
+		sqlite_materialize_scan(node);
 
 	if (festate->for_update)
 	{
-		if (festate->rowidx < festate->row_nums)
+		if (tuplestore_gettupleslot(festate->rows, true, false,
+									festate->rows_slot))
 		{
-			memcpy(tupleSlot->tts_values, festate->rows[festate->rowidx], sizeof(Datum) * tupleDescriptor->natts);
-			memcpy(tupleSlot->tts_isnull, festate->rows_isnull[festate->rowidx], sizeof(bool) * tupleDescriptor->natts);
+			int			natts = tupleDescriptor->natts;
+
+			slot_getallattrs(festate->rows_slot);
+			memcpy(tupleSlot->tts_values, festate->rows_slot->tts_values, sizeof(Datum) * natts);
+			memcpy(tupleSlot->tts_isnull, festate->rows_slot->tts_isnull, sizeof(bool) * natts);
+			if (festate->rows_slot->tts_isnull[natts])
+				ItemPointerSetInvalid(&tupleSlot->tts_tid);
+			else
+				sqlite_rowid_to_tid(DatumGetInt64(festate->rows_slot->tts_values[natts]),
+									&tupleSlot->tts_tid);
 			ExecStoreVirtualTuple(tupleSlot);
-			festate->rowidx++;
+
+			/*
+			 * The values point into the tuple of rows_slot, which is freed by
+			 * the next fetch or with the tuplestore at rescan.  Copy them into
+			 * the scan slot, which then owns them.
+			 */
+			ExecMaterializeSlot(tupleSlot);
 		}
 	}
 	else
 	{
-		rc = sqlite3_step(festate->stmt);
+		instr_time	start;
+
+		sqlite_timer_start(festate, &start);
+		if (festate->pscan_exhausted)
+			rc = SQLITE_DONE;
+		else
+			rc = sqlite3_step(festate->stmt);
+
+		/* Parallel scan continues with the next rowid range, if any */
+		while (SQLITE_DONE == rc && festate->pscan != NULL &&
+			   sqlite_next_rowid_range(festate))
+			rc = sqlite3_step(festate->stmt);
+		sqlite_timer_stop(festate, &festate->step_time, &start);
+
 		if (SQLITE_ROW == rc)
 		{
-			make_tuple_from_result_row(festate->stmt,
+			sqlite_timer_start(festate, &start);
+			make_tuple_from_result_row(festate->stmt, NULL,
 									   tupleDescriptor,
 									   festate->retrieved_attrs,
 									   tupleSlot->tts_values,
 									   tupleSlot->tts_isnull,
-									   festate,
+									   &tupleSlot->tts_tid,
+									   festate->rel,
+									   festate->attinmeta,
+									   festate->converters,
 									   node);
+			sqlite_timer_stop(festate, &festate->convert_time, &start);
 			ExecStoreVirtualTuple(tupleSlot);
+			festate->rows_fetched++;
+			if (festate->conn_stats)
+				festate->conn_stats->rows_fetched++;
+			if (festate->lookup_filling)
+				sqlite_lookup_add_row(festate, tupleSlot);
 		}
 		else if (SQLITE_DONE == rc)
 		{
-			/* No more rows/data exists */
+			/* No more rows/data exists, the cached entry is complete */
+			if (festate->lookup_filling)
+			{
+				festate->lookup_entry->complete = true;
+				festate->lookup_entry = NULL;
+				festate->lookup_filling = false;
+			}
 		}
 		else
 		{
@@ -1777,10 +2283,32 @@ sqliteEndForeignScan(ForeignScanState *node)
 	if (festate == NULL)
 		return;
 
+	/* Stop the background fetcher before the statement is released */
+	if (festate->fetcher)
+	{
+		sqlite_async_stop(festate->fetcher);
+		festate->fetcher = NULL;
+	}
+
 	if (festate->stmt)
 	{
+		/* End the read transaction of the snapshot connection */
+		if (festate->snapshot_scan)
+			sqlite3_reset(festate->stmt);
+		sqlite_stat_store(festate->server, festate->stmt, festate->step_time,
+						  festate->rows_fetched);
+		sqlite_release_stmt(festate->server, festate->stmt);
 		festate->stmt = NULL;
 	}
+
+	/* Release the rows of a scan for update, and their temporary files */
+	if (festate->rows)
+	{
+		tuplestore_end(festate->rows);
+		festate->rows = NULL;
+	}
+
+	sqlite_lookup_end(festate);
 }
 
 /*
@@ -1796,55 +2324,410 @@ sqliteReScanForeignScan(ForeignScanState *node)
 
 	elog(DEBUG1, "sqlite_fdw : %s", __func__);
 
+	/* The background fetcher steps the statement, stop it first */
+	if (festate->fetcher)
+	{
+		sqlite_async_stop(festate->fetcher);
+		festate->fetcher = NULL;
+	}
+
 	if (festate->stmt)
 	{
 		sqlite3_reset(festate->stmt);
 	}
 	festate->cursor_exists = false;
-	festate->rowidx = 0;
+
+	/* Rows of a scan for update are fetched again with the new parameters */
+	if (festate->rows)
+	{
+		tuplestore_end(festate->rows);
+		festate->rows = NULL;
+	}
+	festate->pscan_exhausted = false;
+	festate->eof_reached = false;
+
+	/* Rows of an unfinished scan can't be cached */
+	if (festate->lookup_filling)
+		sqlite_lookup_discard(festate);
+	festate->lookup_entry = NULL;
+	sqlite_lookup_init(node);
 }
 
 /*
- * sqliteAddForeignUpdateTargets: Add column(s) needed for update/delete on a foreign table,
- * we are using first column as row identification column, so we are adding that into target
- * list.
+ * sqliteIsForeignScanParallelSafe
+ *		Determine whether a foreign scan can be executed in parallel workers.
+ *
+ * Workers use their own SQLite connections, so they can't see changes made
+ * by the leader in the current transaction.  Therefore parallel scans are
+ * done only if the user allowed them with the parallel_workers option and
+ * the leader has not modified the database yet.  Changes made after planning
+ * are handled at execution by letting the leader scan all rows, see
+ * sqlite_init_parallel_scan().
  */
-static void
-sqliteAddForeignUpdateTargets(
-#if (PG_VERSION_NUM >= 140000)
-							  PlannerInfo *root,
-							  Index rtindex,
-#else
-							  Query *parsetree,
-#endif
-							  RangeTblEntry *target_rte,
-							  Relation target_relation)
+static bool
+sqliteIsForeignScanParallelSafe(PlannerInfo *root, RelOptInfo *rel,
+								RangeTblEntry *rte)
 {
+	ForeignTable *table;
 
-	Oid			relid = RelationGetRelid(target_relation);
-	TupleDesc	tupdesc = target_relation->rd_att;
-	int			i;
-	bool		has_key = false;
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
 
-	/* loop through all columns of the foreign table */
-	for (i = 0; i < tupdesc->natts; ++i)
-	{
-		Form_pg_attribute att = TupleDescAttr(tupdesc, i);
-		AttrNumber	attrno = att->attnum;
-		List	   *options;
-		ListCell   *option;
+	if (sqlite_get_parallel_workers_option(rte->relid) <= 0)
+		return false;
 
-		/* look for the "key" option on this column */
-		options = GetForeignColumnOptions(relid, attrno);
-		foreach(option, options)
-		{
-			DefElem		*def = (DefElem *) lfirst(option);
+	table = GetForeignTable(rte->relid);
+	return !sqlite_connection_has_writes(GetForeignServer(table->serverid));
+}
 
-			/* if "key" is set, add a resjunk for this column */
-			if (IS_KEY_COLUMN(def))
-			{
-				Var		   *var;
-#if PG_VERSION_NUM < 140000
+/*
+ * sqliteEstimateDSMForeignScan
+ *		Estimate the amount of dynamic shared memory for a parallel scan.
+ */
+static Size
+sqliteEstimateDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt)
+{
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	return sizeof(SqliteFdwParallelScanState);
+}
+
+/*
+ * sqliteInitializeDSMForeignScan
+ *		Initialize the shared state of a parallel scan in the leader.
+ */
+static void
+sqliteInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt,
+							   void *coordinate)
+{
+	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
+	SqliteFdwParallelScanState *pscan = (SqliteFdwParallelScanState *) coordinate;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	sqlite_init_parallel_scan(festate, pscan, pcxt->nworkers);
+	festate->pscan = pscan;
+}
+
+/*
+ * sqliteReInitializeDSMForeignScan
+ *		Reset the shared state of a parallel scan before a rescan.
+ */
+static void
+sqliteReInitializeDSMForeignScan(ForeignScanState *node, ParallelContext *pcxt,
+								 void *coordinate)
+{
+	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
+	SqliteFdwParallelScanState *pscan = (SqliteFdwParallelScanState *) coordinate;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	sqlite_init_parallel_scan(festate, pscan, pcxt->nworkers);
+}
+
+/*
+ * sqliteInitializeWorkerForeignScan
+ *		Attach a parallel worker to the shared state of a parallel scan.
+ */
+static void
+sqliteInitializeWorkerForeignScan(ForeignScanState *node, shm_toc *toc,
+								  void *coordinate)
+{
+	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	festate->pscan = (SqliteFdwParallelScanState *) coordinate;
+}
+
+#if PG_VERSION_NUM >= 140000
+/*
+ * sqliteIsForeignPathAsyncCapable
+ *		Check whether a given ForeignPath node is async-capable.
+ */
+static bool
+sqliteIsForeignPathAsyncCapable(ForeignPath *path)
+{
+	RelOptInfo *rel = ((Path *) path)->parent;
+	SqliteFdwRelationInfo *fpinfo = (SqliteFdwRelationInfo *) rel->fdw_private;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	return fpinfo->async_capable && !path->path.parallel_aware &&
+		sqlite_async_is_supported();
+}
+
+/*
+ * sqliteForeignAsyncRequest
+ *		Asynchronously request next tuple from a foreign SQLite table.
+ */
+static void
+sqliteForeignAsyncRequest(AsyncRequest *areq)
+{
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	sqlite_produce_tuple_asynchronously(areq);
+}
+
+/*
+ * sqliteForeignAsyncConfigureWait
+ *		Configure a file descriptor event for which we wish to wait.
+ */
+static void
+sqliteForeignAsyncConfigureWait(AsyncRequest *areq)
+{
+	ForeignScanState *node = (ForeignScanState *) areq->requestee;
+	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
+	AppendState *requestor = (AppendState *) areq->requestor;
+	WaitEventSet *set = requestor->as_eventset;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	/* This should not be called unless callback_pending */
+	Assert(areq->callback_pending);
+	Assert(festate->fetcher != NULL);
+
+	AddWaitEventToSet(set, WL_SOCKET_READABLE,
+					  sqlite_async_wait_fd(festate->fetcher),
+					  NULL, areq);
+}
+
+/*
+ * sqliteForeignAsyncNotify
+ *		Fetch some more tuples from a file descriptor that becomes ready,
+ *		requesting next tuple.
+ */
+static void
+sqliteForeignAsyncNotify(AsyncRequest *areq)
+{
+	ForeignScanState *node = (ForeignScanState *) areq->requestee;
+	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	sqlite_async_clear_wakeup(festate->fetcher);
+	sqlite_produce_tuple_asynchronously(areq);
+}
+
+/*
+ * Asynchronously produce next tuple from a foreign SQLite table.  The row is
+ * taken from the background fetcher, the request is left pending if the
+ * fetcher has not fetched any row yet.
+ */
+static void
+sqlite_produce_tuple_asynchronously(AsyncRequest *areq)
+{
+	ForeignScanState *node = (ForeignScanState *) areq->requestee;
+	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
+	TupleTableSlot *result;
+
+	result = ExecProcNode((PlanState *) node);
+	if (!TupIsNull(result))
+		ExecAsyncRequestDone(areq, result);
+	else if (festate->eof_reached || !festate->async_capable)
+		ExecAsyncRequestDone(areq, NULL);
+	else
+		ExecAsyncRequestPending(areq);
+}
+#endif
+
+/*
+ * Set up the rowid chunks of a parallel scan.  The bounds of the rowid space
+ * are looked up again at every (re)scan because the table may have changed.
+ */
+static void
+sqlite_init_parallel_scan(SqliteFdwExecState * festate,
+						  SqliteFdwParallelScanState * pscan,
+						  int nworkers)
+{
+	StringInfoData sql;
+	sqlite3_int64 min_rowid;
+	sqlite3_int64 max_rowid;
+	uint64		span;
+	bool		has_writes;
+
+	initStringInfo(&sql);
+	sqlite_deparse_rowid_bound_sql(&sql, festate->rel, false);
+	if (!sqlite_get_int64_value(festate->conn, sql.data, &min_rowid))
+	{
+		/* Empty table, there is nothing to hand out */
+		pscan->min_rowid = 0;
+		pscan->max_rowid = 0;
+		pscan->chunk_size = 0;
+		pscan->nchunks = 0;
+	}
+	else
+	{
+		resetStringInfo(&sql);
+		sqlite_deparse_rowid_bound_sql(&sql, festate->rel, true);
+		if (!sqlite_get_int64_value(festate->conn, sql.data, &max_rowid))
+			max_rowid = min_rowid;
+
+		/* Unsigned arithmetic doesn't overflow for any pair of rowids */
+		span = (uint64) max_rowid - (uint64) min_rowid;
+		pscan->min_rowid = min_rowid;
+		pscan->max_rowid = max_rowid;
+		pscan->chunk_size = span / ((uint64) (nworkers + 1) * SQLITE_PARALLEL_CHUNKS_PER_PARTICIPANT) + 1;
+		pscan->nchunks = span / pscan->chunk_size + 1;
+	}
+	pg_atomic_init_u64(&pscan->next_chunk, 0);
+
+	/*
+	 * Changes made in the current transaction are visible only through the
+	 * connection of the leader, in that case the leader scans all rows.
+	 */
+#if SQLITE_VERSION_NUMBER >= 3034000
+	has_writes = (sqlite3_txn_state(festate->conn, "main") == SQLITE_TXN_WRITE);
+#else
+	has_writes = true;
+#endif
+	if (has_writes && !parallel_leader_participation)
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+				 errmsg("cannot scan foreign table \"%s\" by parallel workers",
+						RelationGetRelationName(festate->rel)),
+				 errdetail("The SQLite database has been modified in the current transaction."),
+				 errhint("Enable parallel_leader_participation or set max_parallel_workers_per_gather to 0.")));
+	pscan->leader_only = has_writes;
+}
+
+/*
+ * Claim the next rowid chunk of a parallel scan and bind its bounds to the
+ * statement.  Returns false if there are no chunks left for this participant.
+ */
+static bool
+sqlite_next_rowid_range(SqliteFdwExecState * festate)
+{
+	SqliteFdwParallelScanState *pscan = festate->pscan;
+	uint64		chunk;
+	int64		lower;
+	int64		upper;
+	int			rc;
+
+	if (festate->pscan_exhausted)
+		return false;
+
+	if (pscan->leader_only && IsParallelWorker())
+	{
+		festate->pscan_exhausted = true;
+		return false;
+	}
+
+	chunk = pg_atomic_fetch_add_u64(&pscan->next_chunk, 1);
+	if (chunk >= pscan->nchunks)
+	{
+		festate->pscan_exhausted = true;
+		return false;
+	}
+
+	lower = (int64) ((uint64) pscan->min_rowid + chunk * pscan->chunk_size);
+	if (chunk == pscan->nchunks - 1)
+		upper = pscan->max_rowid;
+	else
+		upper = (int64) ((uint64) lower + pscan->chunk_size - 1);
+
+	sqlite3_reset(festate->stmt);
+	rc = sqlite3_bind_int64(festate->stmt, festate->numParams + 1, lower);
+	if (rc == SQLITE_OK)
+		rc = sqlite3_bind_int64(festate->stmt, festate->numParams + 2, upper);
+	if (rc != SQLITE_OK)
+		sqlitefdw_report_error(ERROR, festate->stmt, festate->conn, NULL, rc);
+
+	return true;
+}
+
+/*
+ * Check whether some column of a foreign table has the option "key".
+ */
+static bool
+sqlite_has_key_column(Oid foreigntableid)
+{
+	Relation	rel;
+	int			natts;
+	int			i;
+
+	rel = table_open(foreigntableid, NoLock);
+	natts = RelationGetDescr(rel)->natts;
+	table_close(rel, NoLock);
+
+	for (i = 1; i <= natts; i++)
+	{
+		List	   *options = GetForeignColumnOptions(foreigntableid, i);
+		ListCell   *lc;
+
+		foreach(lc, options)
+		{
+			DefElem    *def = (DefElem *) lfirst(lc);
+
+			if (IS_KEY_COLUMN(def))
+				return true;
+		}
+	}
+	return false;
+}
+
+/*
+ * Check whether baserel is a target of UPDATE or DELETE whose rows are
+ * identified by the SQLite rowid, because no column is marked as key.
+ */
+static bool
+sqlite_is_rowid_identity(PlannerInfo *root, RelOptInfo *baserel, Oid foreigntableid)
+{
+	if (root->parse->commandType != CMD_UPDATE &&
+		root->parse->commandType != CMD_DELETE)
+		return false;
+
+#if PG_VERSION_NUM >= 140000
+	if (!bms_is_member(baserel->relid, root->all_result_relids))
+		return false;
+#else
+	if (baserel->relid != root->parse->resultRelation)
+		return false;
+#endif
+
+	return !sqlite_has_key_column(foreigntableid);
+}
+
+/*
+ * sqliteAddForeignUpdateTargets: Add column(s) needed for update/delete on a foreign table,
+ * we are using first column as row identification column, so we are adding that into target
+ * list.
+ */
+static void
+sqliteAddForeignUpdateTargets(
+#if (PG_VERSION_NUM >= 140000)
+							  PlannerInfo *root,
+							  Index rtindex,
+#else
+							  Query *parsetree,
+#endif
+							  RangeTblEntry *target_rte,
+							  Relation target_relation)
+{
+
+	Oid			relid = RelationGetRelid(target_relation);
+	TupleDesc	tupdesc = target_relation->rd_att;
+	int			i;
+	bool		has_key = false;
+
+	/* loop through all columns of the foreign table */
+	for (i = 0; i < tupdesc->natts; ++i)
+	{
+		Form_pg_attribute att = TupleDescAttr(tupdesc, i);
+		AttrNumber	attrno = att->attnum;
+		List	   *options;
+		ListCell   *option;
+
+		/* look for the "key" option on this column */
+		options = GetForeignColumnOptions(relid, attrno);
+		foreach(option, options)
+		{
+			DefElem		*def = (DefElem *) lfirst(option);
+
+			/* if "key" is set, add a resjunk for this column */
+			if (IS_KEY_COLUMN(def))
+			{
+				Var		   *var;
+#if PG_VERSION_NUM < 140000
 				Index		rtindex = parsetree->resultRelation;
 				TargetEntry *tle;
 #endif
@@ -1875,13 +2758,34 @@ sqliteAddForeignUpdateTargets(
 		}
 	}
 
+	/*
+	 * Without key columns the rows are identified by the SQLite rowid, which
+	 * is fetched as ctid.  Tables WITHOUT ROWID and views need key columns.
+	 */
 	if (!has_key)
-		ereport(ERROR,
-				(errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-				 errmsg("no primary key column specified for foreign table"),
-				 errdetail("For UPDATE or DELETE, at least one foreign table column must be marked as primary key column."),
-				 errhint("Set the option \"%s\" on the columns that belong to the primary key.", "key")));
+	{
+		Var		   *var;
+#if PG_VERSION_NUM < 140000
+		Index		rtindex = parsetree->resultRelation;
+		TargetEntry *tle;
+#endif
 
+		var = makeVar(rtindex,
+					  SelfItemPointerAttributeNumber,
+					  TIDOID,
+					  -1,
+					  InvalidOid,
+					  0);
+#if (PG_VERSION_NUM >= 140000)
+		add_row_identity_var(root, var, rtindex, "ctid");
+#else
+		tle = makeTargetEntry((Expr *) var,
+							  list_length(parsetree->targetList) + 1,
+							  pstrdup("ctid"),
+							  true);
+		parsetree->targetList = lappend(parsetree->targetList, tle);
+#endif
+	}
 }
 
 static List *
@@ -1899,6 +2803,9 @@ sqlitePlanForeignModify(PlannerInfo *root,
 	TupleDesc		tupdesc;
 	int				i;
 	List		   *condAttr = NULL;
+	List		   *withCheckOptionList = NIL;
+	List		   *returningList = NIL;
+	List		   *retrieved_attrs = NIL;
 	bool			doNothing = false;
 	int				values_end_len = -1;
 
@@ -1960,10 +2867,26 @@ sqlitePlanForeignModify(PlannerInfo *root,
 		}
 	}
 
+	/*
+	 * Extract the relevant WITH CHECK OPTION list if any.
+	 */
+	if (plan->withCheckOptionLists)
+		withCheckOptionList = (List *) list_nth(plan->withCheckOptionLists,
+												subplan_index);
+
+	/*
+	 * Extract the relevant RETURNING list if any.
+	 */
 	if (plan->returningLists)
+	{
+#if SQLITE_VERSION_NUMBER < 3035000
 		ereport(ERROR,
 				(errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
-				 errmsg("RETURNING clause is not supported")));
+				 errmsg("RETURNING clause is not supported"),
+				 errhint("RETURNING requires SQLite 3.35.0 or later.")));
+#endif
+		returningList = (List *) list_nth(plan->returningLists, subplan_index);
+	}
 
 	/*
 	 * ON CONFLICT DO UPDATE and DO NOTHING case with inference specification
@@ -2001,26 +2924,36 @@ sqlitePlanForeignModify(PlannerInfo *root,
 		}
 	}
 
+	/* Rows of a table without key columns are identified by the rowid */
+	if (condAttr == NIL)
+		condAttr = list_make1_int(SelfItemPointerAttributeNumber);
+
 	/*
 	 * Construct the SQL command string.
 	 */
 	switch (operation)
 	{
 		case CMD_INSERT:
-			sqlite_deparse_insert(&sql, root, resultRelation, rel, targetAttrs, doNothing, &values_end_len);
+			sqlite_deparse_insert(&sql, root, resultRelation, rel, targetAttrs, doNothing,
+								  withCheckOptionList, returningList,
+								  &retrieved_attrs, &values_end_len);
 			break;
 		case CMD_UPDATE:
-			sqlite_deparse_update(&sql, root, resultRelation, rel, targetAttrs, condAttr);
+			sqlite_deparse_update(&sql, root, resultRelation, rel, targetAttrs, condAttr,
+								  withCheckOptionList, returningList,
+								  &retrieved_attrs);
 			break;
 		case CMD_DELETE:
-			sqlite_deparse_delete(&sql, root, resultRelation, rel, condAttr);
+			sqlite_deparse_delete(&sql, root, resultRelation, rel, condAttr,
+								  returningList, &retrieved_attrs);
 			break;
 		default:
 			elog(ERROR, "unexpected operation: %d", (int) operation);
 			break;
 	}
 	table_close(rel, NoLock);
-	return list_make3(makeString(sql.data), targetAttrs, makeInteger(values_end_len));
+	return list_make4(makeString(sql.data), targetAttrs, makeInteger(values_end_len),
+					  retrieved_attrs);
 }
 
 static void
@@ -2032,18 +2965,14 @@ sqliteBeginForeignModify(ModifyTableState *mtstate,
 {
 	SqliteFdwExecState *fmstate = NULL;
 	EState	   *estate = mtstate->ps.state;
-	Relation	rel = resultRelInfo->ri_RelationDesc;
-	AttrNumber	n_params = 0;
-	Oid			typefnoid = InvalidOid;
-	bool		isvarlena = false;
-	ListCell   *lc = NULL;
-	Oid			foreignTableId = InvalidOid;
 	Plan	   *subplan;
-	int			i;
+	char	   *query;
+	List	   *target_attrs;
+	List	   *retrieved_attrs;
+	int			values_end;
 
 	elog(DEBUG1, "sqlite_fdw : %s", __func__);
 
-	foreignTableId = RelationGetRelid(rel);
 #if (PG_VERSION_NUM >= 140000)
 	subplan = outerPlanState(mtstate)->plan;
 #else
@@ -2057,20 +2986,67 @@ sqliteBeginForeignModify(ModifyTableState *mtstate,
 	if (eflags & EXEC_FLAG_EXPLAIN_ONLY)
 		return;
 
+	/* Deconstruct fdw_private data. */
+	query = strVal(list_nth(fdw_private, FdwModifyPrivateUpdateSql));
+	target_attrs = (List *) list_nth(fdw_private, FdwModifyPrivateTargetAttnums);
+	values_end = intVal(list_nth(fdw_private, FdwModifyPrivateLen));
+	retrieved_attrs = (List *) list_nth(fdw_private, FdwModifyPrivateRetrievedAttrs);
+
+	fmstate = sqlite_create_foreign_modify(estate, resultRelInfo,
+										   mtstate->operation, subplan,
+										   query, target_attrs, values_end,
+										   retrieved_attrs);
+
+	resultRelInfo->ri_FdwState = fmstate;
+}
+
+/*
+ * sqlite_create_foreign_modify
+ *		Build the execution state of INSERT, UPDATE or DELETE and prepare
+ *		its statement.  subplan is used to find the key columns of UPDATE
+ *		and DELETE, INSERT does not need it.  retrieved_attrs are the columns
+ *		returned by RETURNING.
+ */
+static SqliteFdwExecState *
+sqlite_create_foreign_modify(EState *estate,
+							 ResultRelInfo *resultRelInfo,
+							 CmdType operation,
+							 Plan *subplan,
+							 char *query,
+							 List *target_attrs,
+							 int values_end,
+							 List *retrieved_attrs)
+{
+	SqliteFdwExecState *fmstate;
+	Relation	rel = resultRelInfo->ri_RelationDesc;
+	AttrNumber	n_params = 0;
+	ListCell   *lc = NULL;
+	Oid			foreignTableId = RelationGetRelid(rel);
+	int			i;
+
 	fmstate = (SqliteFdwExecState *) palloc0(sizeof(SqliteFdwExecState));
 	fmstate->rel = rel;
 	fmstate->table = GetForeignTable(foreignTableId);
 	fmstate->server = GetForeignServer(fmstate->table->serverid);
 
 	fmstate->conn = sqlite_get_connection(fmstate->server, false);
-	fmstate->query = strVal(list_nth(fdw_private, FdwModifyPrivateUpdateSql));
-	fmstate->target_attrs = (List *) list_nth(fdw_private, FdwModifyPrivateTargetAttnums);
-	fmstate->retrieved_attrs = (List *) list_nth(fdw_private, FdwModifyPrivateTargetAttnums);
-	fmstate->values_end = intVal(list_nth(fdw_private, FdwModifyPrivateLen));
+	fmstate->query = query;
+	fmstate->target_attrs = target_attrs;
+	fmstate->values_end = values_end;
 	fmstate->orig_query = pstrdup(fmstate->query);
 
-	n_params = list_length(fmstate->retrieved_attrs) + 1;
-	fmstate->p_flinfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo) * n_params);
+	/* Prepare for conversion of the row returned by RETURNING */
+	fmstate->retrieved_attrs = retrieved_attrs;
+	fmstate->has_returning = (retrieved_attrs != NIL);
+	if (fmstate->has_returning)
+	{
+		fmstate->attinmeta = TupleDescGetAttInMetadata(RelationGetDescr(rel));
+		fmstate->converters = sqlite_get_value_converters(RelationGetDescr(rel),
+														  retrieved_attrs);
+	}
+
+	n_params = list_length(fmstate->target_attrs) + 1;
+	fmstate->column_binds = (SqliteBindInfo *) palloc0(sizeof(SqliteBindInfo) * RelationGetDescr(rel)->natts);
 	fmstate->p_nums = 0;
 	fmstate->temp_cxt = AllocSetContextCreate(estate->es_query_cxt,
 											  "sqlite_fdw temporary data",
@@ -2079,7 +3055,7 @@ sqliteBeginForeignModify(ModifyTableState *mtstate,
 											  ALLOCSET_SMALL_MAXSIZE);
 
 	/* Set up for remaining transmittable parameters */
-	foreach(lc, fmstate->retrieved_attrs)
+	foreach(lc, fmstate->target_attrs)
 	{
 		int			attnum = lfirst_int(lc);
 		Form_pg_attribute attr = TupleDescAttr(RelationGetDescr(rel), attnum - 1);
@@ -2089,62 +3065,221 @@ sqliteBeginForeignModify(ModifyTableState *mtstate,
 		/* Ignore generated columns; */
 		if (attr->attgenerated)
 		{
-			if (list_length(fmstate->retrieved_attrs) >= 1)
+			if (list_length(fmstate->target_attrs) >= 1)
 				fmstate->p_nums = 1;
 			continue;
 		}
 #endif
-		getTypeOutputInfo(attr->atttypid, &typefnoid, &isvarlena);
-		fmgr_info(typefnoid, &fmstate->p_flinfo[fmstate->p_nums]);
+		sqlite_init_bind_info(&fmstate->column_binds[attnum - 1], InvalidOid, attr, foreignTableId);
 		fmstate->p_nums++;
 	}
 	Assert(fmstate->p_nums <= n_params);
 
-#if (PG_VERSION_NUM >= 140000)
 	/* Set batch_size from foreign server/table options. */
 	fmstate->batch_size = sqlite_get_batch_size_option(rel);
-#endif
 
-	n_params = list_length(fmstate->retrieved_attrs);
 	/* Initialize sqlite statment */
 	fmstate->stmt = NULL;
 
 	fmstate->num_slots = 1;
 	/* Prepare sqlite statment */
 	sqlite_prepare_wrapper(fmstate->server, fmstate->conn, fmstate->query, &fmstate->stmt, NULL, true);
-
-	resultRelInfo->ri_FdwState = fmstate;
+	sqlite_stat_begin(fmstate->stmt);
+	fmstate->instrument_timer = sqlite_stat_timing_enabled();
 
 	fmstate->junk_idx = palloc0(RelationGetDescr(rel)->natts * sizeof(AttrNumber));
-	/* loop through table columns */
+	fmstate->key_attrs = NIL;
+
+	/* Only UPDATE and DELETE identify the rows by their key columns */
+	if (operation != CMD_UPDATE && operation != CMD_DELETE)
+		return fmstate;
+
+	/* loop through table columns */
 	for (i = 0; i < RelationGetDescr(rel)->natts; ++i)
 	{
+		Form_pg_attribute attr = TupleDescAttr(RelationGetDescr(rel), i);
+		List	   *options;
+		ListCell   *option;
+
 		/*
 		 * for primary key columns, get the resjunk attribute number and store
 		 * it
 		 */
 		fmstate->junk_idx[i] =
 			ExecFindJunkAttributeInTlist(subplan->targetlist,
-										 get_attname(foreignTableId, i + 1
-#if (PG_VERSION_NUM >= 110000)
-													 ,false
-#endif
-													 ));
+										 NameStr(attr->attname));
+		if (fmstate->junk_idx[i] == InvalidAttrNumber)
+			continue;
+
+		/*
+		 * Remember the key columns bound in WHERE clause of UPDATE/DELETE,
+		 * so that column options are not looked up for every row.
+		 */
+		options = GetForeignColumnOptions(foreignTableId, attr->attnum);
+		foreach(option, options)
+		{
+			DefElem    *def = (DefElem *) lfirst(option);
+
+			if (IS_KEY_COLUMN(def))
+			{
+				fmstate->key_attrs = lappend_int(fmstate->key_attrs, attr->attnum);
+				sqlite_init_bind_info(&fmstate->column_binds[i], InvalidOid,
+									  attr, foreignTableId);
+			}
+		}
+	}
+
+	/* Without key columns the SQLite rowid is passed up as ctid */
+	if (fmstate->key_attrs == NIL)
+	{
+		fmstate->rowid_junk_idx =
+			ExecFindJunkAttributeInTlist(subplan->targetlist, "ctid");
+		if (!AttributeNumberIsValid(fmstate->rowid_junk_idx))
+			elog(ERROR, "could not find junk ctid column");
+		fmstate->key_attrs = list_make1_int(SelfItemPointerAttributeNumber);
+		sqlite_init_bind_info(&fmstate->rowid_bind, INT8OID, NULL, InvalidOid);
 	}
 
+	/*
+	 * DELETE can collect the keys of batch_size rows and delete them with one
+	 * statement.  The rows are deleted later than their ExecForeignDelete
+	 * calls, so row triggers, which could look at the SQLite table, disable
+	 * batching, and so does RETURNING, which needs each deleted row.  The
+	 * last batch is deleted by EndForeignModify, after AFTER STATEMENT
+	 * triggers have fired, so these triggers disable batching too.
+	 */
+	if (operation == CMD_DELETE && fmstate->batch_size > 1 &&
+		fmstate->key_attrs != NIL && !fmstate->has_returning &&
+		!(rel->trigdesc &&
+		  (rel->trigdesc->trig_delete_before_row ||
+		   rel->trigdesc->trig_delete_after_row ||
+		   rel->trigdesc->trig_delete_after_statement)))
+	{
+		int			num_keys = list_length(fmstate->key_attrs);
+		int			max_rows;
+
+		/* SQLite limits the number of parameters of a statement */
+		max_rows = sqlite3_limit(fmstate->conn, SQLITE_LIMIT_VARIABLE_NUMBER, -1) / num_keys;
+		fmstate->delete_batch_size = Min(fmstate->batch_size, max_rows);
+		fmstate->num_pending = 0;
+		fmstate->pending_values = (Datum *) palloc(sizeof(Datum) * fmstate->delete_batch_size * num_keys);
+		fmstate->pending_nulls = (bool *) palloc(sizeof(bool) * fmstate->delete_batch_size * num_keys);
+		fmstate->batch_cxt = AllocSetContextCreate(estate->es_query_cxt,
+												   "sqlite_fdw batch data",
+												   ALLOCSET_DEFAULT_SIZES);
+	}
+
+	return fmstate;
 }
+
 #if (PG_VERSION_NUM >= 110000)
+/*
+ * sqliteBeginForeignInsert
+ *		Begin an insert operation on a foreign table, used by COPY FROM and
+ *		by INSERT routed into a foreign partition
+ */
 static void
 sqliteBeginForeignInsert(ModifyTableState *mtstate,
 						 ResultRelInfo *resultRelInfo)
 {
-	elog(ERROR, "Not support partition insert");
+	SqliteFdwExecState *fmstate;
+	ModifyTable *plan = castNode(ModifyTable, mtstate->ps.plan);
+	EState	   *estate = mtstate->ps.state;
+	Relation	rel = resultRelInfo->ri_RelationDesc;
+	TupleDesc	tupdesc = RelationGetDescr(rel);
+	int			attnum;
+	int			values_end_len = -1;
+	StringInfoData sql;
+	List	   *targetAttrs = NIL;
+	List	   *retrieved_attrs = NIL;
+	Index		varno = resultRelInfo->ri_RangeTableIndex;
+	bool		doNothing = false;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	/*
+	 * If the foreign table we are about to insert routed rows into is also an
+	 * UPDATE subplan result rel that will be updated later, proceeding with
+	 * the INSERT will result in the later UPDATE incorrectly modifying those
+	 * routed rows, so prevent the INSERT --- it would be nice if we could
+	 * handle this case; but for now, throw an error for safety.
+	 */
+	if (plan && plan->operation == CMD_UPDATE &&
+		(resultRelInfo->ri_usesFdwDirectModify ||
+		 resultRelInfo->ri_FdwState))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("cannot route tuples into foreign table to be updated \"%s\"",
+						RelationGetRelationName(rel))));
+
+#if SQLITE_VERSION_NUMBER < 3035000
+	if (resultRelInfo->ri_returningList)
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+				 errmsg("RETURNING clause is not supported"),
+				 errhint("RETURNING requires SQLite 3.35.0 or later.")));
+#endif
+
+	/*
+	 * The RETURNING list and WITH CHECK OPTIONs of a routed row were mapped
+	 * from the first result relation of the query, so their Vars have its
+	 * range table index.
+	 */
+	if (plan)
+		varno = mtstate->resultRelInfo[0].ri_RangeTableIndex;
+
+	initStringInfo(&sql);
+
+	/* We transmit all columns that are defined in the foreign table. */
+	for (attnum = 1; attnum <= tupdesc->natts; attnum++)
+	{
+		Form_pg_attribute attr = TupleDescAttr(tupdesc, attnum - 1);
+
+		if (!attr->attisdropped)
+			targetAttrs = lappend_int(targetAttrs, attnum);
+	}
+
+	/* Check if we add the ON CONFLICT clause to the remote query. */
+	if (plan)
+	{
+		OnConflictAction onConflictAction = plan->onConflictAction;
+
+		/* We only support DO NOTHING without an inference specification. */
+		if (onConflictAction == ONCONFLICT_NOTHING)
+			doNothing = true;
+		else if (onConflictAction != ONCONFLICT_NONE)
+			elog(ERROR, "unexpected ON CONFLICT specification: %d",
+				 (int) onConflictAction);
+	}
+
+	/*
+	 * Construct the SQL command string.  A partition which receives routed
+	 * rows may have no range table entry of its own, but INSERT does not
+	 * qualify the column names, so the index is not looked up.
+	 */
+	sqlite_deparse_insert(&sql, NULL, varno, rel, targetAttrs, doNothing,
+						  resultRelInfo->ri_WithCheckOptions,
+						  resultRelInfo->ri_returningList,
+						  &retrieved_attrs, &values_end_len);
+
+	fmstate = sqlite_create_foreign_modify(estate, resultRelInfo, CMD_INSERT,
+										   NULL, sql.data, targetAttrs,
+										   values_end_len, retrieved_attrs);
+
+	resultRelInfo->ri_FdwState = fmstate;
 }
+
+/*
+ * sqliteEndForeignInsert
+ *		Finish an insert operation on a foreign table
+ */
 static void
 sqliteEndForeignInsert(EState *estate,
 					   ResultRelInfo *resultRelInfo)
 {
-	elog(ERROR, "Not support partition insert");
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	sqliteEndForeignModify(estate, resultRelInfo);
 }
 #endif
 /*
@@ -2230,16 +3365,20 @@ sqliteGetForeignModifyBatchSize(ResultRelInfo *resultRelInfo)
 		batch_size = sqlite_get_batch_size_option(resultRelInfo->ri_RelationDesc);
 
 	/*
-	 * Disable batching when there are any BEFORE/AFTER ROW
-	 * INSERT triggers on the foreign table, or there are any
+	 * Disable batching when we have to use RETURNING, there are any
+	 * BEFORE/AFTER ROW INSERT triggers on the foreign table, or there are any
 	 * WITH CHECK OPTION constraints from parent views.
 	 *
+	 * SQLite returns the rows of RETURNING in an arbitrary order, so they
+	 * could not be matched with the slots of a batch.
+	 *
 	 * When there are any BEFORE ROW INSERT triggers on the table, we can't
 	 * support it, because such triggers might query the table we're inserting
 	 * into and act differently if the tuples that have already been processed
 	 * and prepared for insertion are not there.
 	 */
-	if (resultRelInfo->ri_WithCheckOptions != NIL ||
+	if (resultRelInfo->ri_projectReturning != NULL ||
+		resultRelInfo->ri_WithCheckOptions != NIL ||
 		(resultRelInfo->ri_TrigDesc &&
 		 (resultRelInfo->ri_TrigDesc->trig_insert_before_row ||
 		  resultRelInfo->ri_TrigDesc->trig_insert_after_row)))
@@ -2370,6 +3509,7 @@ sqlitePlanDirectModify(PlannerInfo *root,
 	List		   *targetAttrs = NIL;
 	List		   *remote_exprs;
 	List		   *params_list = NIL;
+	List		   *returningList = NIL;
 	List		   *retrieved_attrs = NIL;
 
 	elog(DEBUG1, "sqlite_fdw : %s", __func__);
@@ -2410,11 +3550,11 @@ sqlitePlanDirectModify(PlannerInfo *root,
 #endif
 		return false;
 
-	/* not supported  RETURNING clause by this FDW */
+#if SQLITE_VERSION_NUMBER < 3035000
+	/* RETURNING is not supported by SQLite before 3.35.0 */
 	if (plan->returningLists)
-	{
 		return false;
-	}
+#endif
 
 	/* Safe to fetch data about the target foreign rel */
 	if (fscan->scan.scanrelid == 0)
@@ -2510,6 +3650,12 @@ sqlitePlanDirectModify(PlannerInfo *root,
 	 */
 	rel = table_open(rte->relid, NoLock);
 
+	/*
+	 * Extract the relevant RETURNING list if any.
+	 */
+	if (plan->returningLists)
+		returningList = (List *) list_nth(plan->returningLists, subplan_index);
+
 	/*
 	 * Recall the qual clauses that must be evaluated remotely.  (These are
 	 * bare clauses not RestrictInfos, but deparse.c's appendConditions()
@@ -2532,13 +3678,13 @@ sqlitePlanDirectModify(PlannerInfo *root,
 #endif
 											 targetAttrs,
 											 remote_exprs, &params_list,
-											 &retrieved_attrs);
+											 returningList, &retrieved_attrs);
 			break;
 		case CMD_DELETE:
 			sqlite_deparse_direct_delete_sql(&sql, root, resultRelation, rel,
 											 foreignrel,
 											 remote_exprs, &params_list,
-											 &retrieved_attrs);
+											 returningList, &retrieved_attrs);
 			break;
 		default:
 			elog(ERROR, "unexpected operation: %d", (int) operation);
@@ -2568,7 +3714,7 @@ sqlitePlanDirectModify(PlannerInfo *root,
 									retrieved_attrs,
 									makeBoolean(plan->canSetTag));
 #else
-									makeInteger(0),
+									makeInteger((retrieved_attrs != NIL)),
 									retrieved_attrs,
 									makeInteger(plan->canSetTag));
 #endif
@@ -2675,6 +3821,16 @@ sqliteBeginDirectModify(ForeignScanState *node, int eflags)
 	dmstate->retrieved_attrs = (List *) list_nth(fsplan->fdw_private,
 												 FdwDirectModifyPrivateRetrievedAttrs);
 
+	/* Prepare for conversion of the rows returned by RETURNING */
+	if (dmstate->has_returning)
+	{
+		TupleDesc	tupdesc = RelationGetDescr(dmstate->rel);
+
+		dmstate->attinmeta = TupleDescGetAttInMetadata(tupdesc);
+		dmstate->converters = sqlite_get_value_converters(tupdesc,
+														  dmstate->retrieved_attrs);
+	}
+
 	/* Create context for per-tuple temp workspace. */
 	dmstate->temp_cxt = AllocSetContextCreate(estate->es_query_cxt,
 											  "sqlite_fdw temporary data",
@@ -2685,6 +3841,7 @@ sqliteBeginDirectModify(ForeignScanState *node, int eflags)
 
 	/* Prepare SQLite statement */
 	sqlite_prepare_wrapper(dmstate->server, dmstate->conn, dmstate->query, &dmstate->stmt, NULL, true);
+	sqlite_stat_begin(dmstate->stmt);
 
 	/*
 	 * Prepare for processing of parameters used in remote query, if any.
@@ -2695,10 +3852,8 @@ sqliteBeginDirectModify(ForeignScanState *node, int eflags)
 		sqlite_prepare_query_params((PlanState *) node,
 									fsplan->fdw_exprs,
 									numParams,
-									&dmstate->param_flinfo,
 									&dmstate->param_exprs,
-									&dmstate->param_values,
-									&dmstate->param_types);
+									&dmstate->param_binds);
 }
 
 /*
@@ -2712,26 +3867,40 @@ sqliteIterateDirectModify(ForeignScanState *node)
 	EState	   *estate = node->ss.ps.state;
 	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
 	Instrumentation *instr = node->ss.ps.instrument;
+#if PG_VERSION_NUM >= 140000
+	ResultRelInfo *resultRelInfo = node->resultRelInfo;
+#else
+	ResultRelInfo *resultRelInfo = estate->es_result_relation_info;
+#endif
 
 	elog(DEBUG1, "sqlite_fdw : %s", __func__);
 
-	Assert(!dmstate->has_returning);
-
 	/*
 	 * If this is the first call after Begin, execute the statement.
 	 */
 	if (dmstate->num_tuples == -1)
 		sqlite_execute_dml_stmt(node);
 
-	/* Increment the command es_processed count if necessary. */
-	if (dmstate->set_processed)
-		estate->es_processed += dmstate->num_tuples;
+	/*
+	 * If the local query doesn't specify RETURNING, just clear tuple slot.
+	 */
+	if (!resultRelInfo->ri_projectReturning)
+	{
+		/* Increment the command es_processed count if necessary. */
+		if (dmstate->set_processed)
+			estate->es_processed += dmstate->num_tuples;
+
+		/* Increment the tuple count for EXPLAIN ANALYZE if necessary. */
+		if (instr)
+			instr->tuplecount += dmstate->num_tuples;
 
-	/* Increment the tuple count for EXPLAIN ANALYZE if necessary. */
-	if (instr)
-		instr->tuplecount += dmstate->num_tuples;
+		return ExecClearTuple(slot);
+	}
 
-	return ExecClearTuple(slot);
+	/*
+	 * Get the next RETURNING tuple.
+	 */
+	return sqlite_get_returning_data(node);
 }
 
 /*
@@ -2751,6 +3920,10 @@ sqliteEndDirectModify(ForeignScanState *node)
 
 	if (dmstate->stmt)
 	{
+		if (dmstate->num_tuples >= 0)
+			sqlite_stat_store(dmstate->server, dmstate->stmt,
+							  dmstate->step_time, dmstate->num_tuples);
+		sqlite_release_stmt(dmstate->server, dmstate->stmt);
 		dmstate->stmt = NULL;
 	}
 }
@@ -2878,43 +4051,58 @@ sqliteExecForeignTruncate(List *rels,
 
 static void
 bindJunkColumnValue(SqliteFdwExecState * fmstate,
-					TupleTableSlot *slot,
 					TupleTableSlot *planSlot,
-					Oid foreignTableId,
 					int bindnum)
 {
-	int			i;
+	ListCell   *lc;
 
-	/* Bind where condition using junk column */
-	for (i = 0; i < slot->tts_tupleDescriptor->natts; ++i)
+	/* Bind where condition using junk column of every key column */
+	foreach(lc, fmstate->key_attrs)
 	{
-		Form_pg_attribute att = TupleDescAttr(slot->tts_tupleDescriptor, i);
-		AttrNumber	attrno = att->attnum;
-		List	   *options;
-		ListCell   *option;
-
-		/* look for the "key" option on this column */
-		if (fmstate->junk_idx[i] == InvalidAttrNumber)
-			continue;
-		options = GetForeignColumnOptions(foreignTableId, attrno);
-		foreach(option, options)
-		{
-			DefElem	   *def = (DefElem *) lfirst(option);
-			bool		is_null = false;
+		int			attnum = lfirst_int(lc);
+		bool		is_null = false;
+		Datum		value;
 
-			if (IS_KEY_COLUMN(def))
-			{
-				Datum		value;
-				/* Get the id that was passed up as a resjunk column */
-				value = ExecGetJunkAttribute(planSlot, fmstate->junk_idx[i], &is_null);
-				/* Bind qual */
-				sqlite_bind_sql_var(att, bindnum, value, fmstate->stmt, &is_null, foreignTableId);
-				bindnum++;
-			}
-		}
+		/* Get the id that was passed up as a resjunk column */
+		value = sqlite_get_junk_key_value(fmstate, planSlot, attnum, &is_null);
+		/* Bind qual */
+		sqlite_bind_sql_var(sqlite_key_bind_info(fmstate, attnum), bindnum, value, fmstate->stmt, &is_null);
+		bindnum++;
 	}
 }
 
+/*
+ * Get the value of a key column of the row to be updated or deleted from its
+ * resjunk column.  For SelfItemPointerAttributeNumber it is the SQLite rowid
+ * passed up as ctid.
+ */
+static Datum
+sqlite_get_junk_key_value(SqliteFdwExecState * fmstate, TupleTableSlot *planSlot,
+						  int attnum, bool *is_null)
+{
+	Datum		value;
+
+	if (attnum != SelfItemPointerAttributeNumber)
+		return ExecGetJunkAttribute(planSlot, fmstate->junk_idx[attnum - 1], is_null);
+
+	value = ExecGetJunkAttribute(planSlot, fmstate->rowid_junk_idx, is_null);
+	if (*is_null ||
+		ItemPointerGetBlockNumberNoCheck((ItemPointer) DatumGetPointer(value)) == InvalidBlockNumber)
+		elog(ERROR, "SQLite rowid of the row was not fetched");
+	return Int64GetDatum(sqlite_tid_to_rowid((ItemPointer) DatumGetPointer(value)));
+}
+
+/*
+ * Bind information of a key column, see sqlite_get_junk_key_value.
+ */
+static SqliteBindInfo *
+sqlite_key_bind_info(SqliteFdwExecState * fmstate, int attnum)
+{
+	if (attnum == SelfItemPointerAttributeNumber)
+		return &fmstate->rowid_bind;
+	return &fmstate->column_binds[attnum - 1];
+}
+
 /*
  * sqliteExecForeignUpdate
  *		Update one row in a foreign table
@@ -2926,22 +4114,18 @@ sqliteExecForeignUpdate(EState *estate,
 						TupleTableSlot *planSlot)
 {
 	SqliteFdwExecState *fmstate = (SqliteFdwExecState *) resultRelInfo->ri_FdwState;
-	Relation	rel = resultRelInfo->ri_RelationDesc;
-	Oid			foreignTableId = RelationGetRelid(rel);
 	ListCell   *lc = NULL;
 	int			bindnum = 0;
 	int			i = 0;
-	int			rc = 0;
 
 	elog(DEBUG1, "sqlite_fdw : %s", __func__);
 
 	/* Bind the values */
-	foreach(lc, fmstate->retrieved_attrs)
+	foreach(lc, fmstate->target_attrs)
 	{
 		int			attnum = lfirst_int(lc);
 		bool		is_null;
 		Datum		value = 0;
-		Form_pg_attribute bind_att = NULL;
 #if PG_VERSION_NUM >= 140000
 		TupleDesc	tupdesc = RelationGetDescr(fmstate->rel);
 		Form_pg_attribute attr = TupleDescAttr(tupdesc, attnum - 1);
@@ -2951,27 +4135,17 @@ sqliteExecForeignUpdate(EState *estate,
 			continue;
 #endif
 		/* first attribute cannot be in target list attribute */
-		bind_att = TupleDescAttr(slot->tts_tupleDescriptor, attnum - 1);
 		value = slot_getattr(slot, attnum, &is_null);
 
-		sqlite_bind_sql_var(bind_att, bindnum, value, fmstate->stmt, &is_null, foreignTableId);
+		sqlite_bind_sql_var(&fmstate->column_binds[attnum - 1], bindnum, value, fmstate->stmt, &is_null);
 		bindnum++;
 		i++;
 	}
 
-	bindJunkColumnValue(fmstate, slot, planSlot, foreignTableId, bindnum);
+	bindJunkColumnValue(fmstate, planSlot, bindnum);
 
 	/* Execute the query */
-	rc = sqlite3_step(fmstate->stmt);
-	if (rc != SQLITE_DONE)
-	{
-		sqlitefdw_report_error(ERROR, fmstate->stmt, fmstate->conn, NULL, rc);
-	}
-
-	sqlite3_reset(fmstate->stmt);
-
-	/* Return NULL if nothing was updated on the remote end */
-	return slot;
+	return sqlite_execute_foreign_modify(fmstate, slot);
 }
 
 static TupleTableSlot *
@@ -2981,274 +4155,1179 @@ sqliteExecForeignDelete(EState *estate,
 						TupleTableSlot *planSlot)
 {
 	SqliteFdwExecState *fmstate = (SqliteFdwExecState *) resultRelInfo->ri_FdwState;
-	Relation	rel = resultRelInfo->ri_RelationDesc;
-	Oid			foreignTableId = RelationGetRelid(rel);
-	int			rc = 0;
 
 	elog(DEBUG1, "sqlite_fdw : %s", __func__);
 
-	bindJunkColumnValue(fmstate, slot, planSlot, foreignTableId, 0);
+	if (fmstate->delete_batch_size > 1)
+	{
+		sqlite_buffer_delete_keys(fmstate, planSlot);
+		if (fmstate->num_pending == fmstate->delete_batch_size)
+			sqlite_execute_batch_delete(fmstate);
+		return slot;
+	}
+
+	bindJunkColumnValue(fmstate, planSlot, 0);
 
 	/* Execute the query */
+	return sqlite_execute_foreign_modify(fmstate, slot);
+}
+
+/*
+ * sqlite_execute_foreign_modify
+ *		Execute the bound INSERT, UPDATE or DELETE statement of one row.
+ *
+ * With RETURNING, the returned row is stored into slot, and NULL is returned
+ * if nothing was modified on the remote end, e.g. for INSERT OR IGNORE.
+ */
+static TupleTableSlot *
+sqlite_execute_foreign_modify(SqliteFdwExecState * fmstate,
+							  TupleTableSlot *slot)
+{
+	instr_time	start;
+	int			rc;
+
+	sqlite_timer_start(fmstate, &start);
 	rc = sqlite3_step(fmstate->stmt);
+	sqlite_timer_stop(fmstate, &fmstate->step_time, &start);
+	if (fmstate->has_returning)
+	{
+		if (rc == SQLITE_ROW)
+			sqlite_store_returning_result(fmstate, slot);
+		else if (rc == SQLITE_DONE)
+			slot = NULL;
+
+		/* Several rows can only match a key which is not unique */
+		while (rc == SQLITE_ROW)
+			rc = sqlite3_step(fmstate->stmt);
+	}
 	if (rc != SQLITE_DONE)
 	{
 		sqlitefdw_report_error(ERROR, fmstate->stmt, fmstate->conn, NULL, rc);
 	}
-	sqlite3_reset(fmstate->stmt);
-	/* Return NULL if nothing was updated on the remote end */
-	return slot;
+	fmstate->rows_modified += sqlite3_changes(fmstate->conn);
+	sqlite3_reset(fmstate->stmt);
+
+	return slot;
+}
+
+/*
+ * sqlite_store_returning_result
+ *		Store the current row returned by RETURNING into slot.
+ */
+static void
+sqlite_store_returning_result(SqliteFdwExecState * fmstate,
+							  TupleTableSlot *slot)
+{
+	ExecClearTuple(slot);
+	make_tuple_from_result_row(fmstate->stmt, NULL,
+							   slot->tts_tupleDescriptor,
+							   fmstate->retrieved_attrs,
+							   slot->tts_values,
+							   slot->tts_isnull,
+							   &slot->tts_tid,
+							   fmstate->rel,
+							   fmstate->attinmeta,
+							   fmstate->converters,
+							   NULL);
+	ExecStoreVirtualTuple(slot);
+}
+
+static void
+sqliteEndForeignModify(EState *estate,
+					   ResultRelInfo *resultRelInfo)
+{
+
+	SqliteFdwExecState *fmstate = (SqliteFdwExecState *) resultRelInfo->ri_FdwState;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	/* Delete the rows remaining from the last batch */
+	if (fmstate && fmstate->num_pending > 0)
+		sqlite_execute_batch_delete(fmstate);
+
+	if (fmstate && fmstate->stmt)
+	{
+		sqlite_stat_store(fmstate->server, fmstate->stmt, fmstate->step_time,
+						  fmstate->rows_modified);
+		sqlite_release_stmt(fmstate->server, fmstate->stmt);
+		fmstate->stmt = NULL;
+	}
+	if (fmstate && fmstate->batch_stmt)
+	{
+		sqlite_stat_store(fmstate->server, fmstate->batch_stmt,
+						  fmstate->batch_time, fmstate->batch_rows);
+		sqlite_release_stmt(fmstate->server, fmstate->batch_stmt);
+		fmstate->batch_stmt = NULL;
+	}
+}
+
+static void
+sqliteExplainForeignScan(ForeignScanState *node,
+						 struct ExplainState *es)
+{
+	ForeignScan *plan = castNode(ForeignScan, node->ss.ps.plan);
+	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
+	List	   *fdw_private = plan->fdw_private;
+	char	   *sql = strVal(list_nth(fdw_private, FdwScanPrivateSelectSql));
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	if (es->verbose)
+	{
+		ExplainPropertyText("SQLite query", sql, es);
+	}
+
+	/* Statistics of the executed scan */
+	if (es->analyze && festate != NULL)
+	{
+		int			cache_miss;
+		int			hiwtr;
+		int			i;
+
+		ExplainPropertyInteger("SQLite Rows Fetched", NULL,
+							   festate->rows_fetched, es);
+		if (festate->snapshot_scan)
+			ExplainPropertyBool("SQLite Snapshot Scan", true, es);
+		if (festate->lookup_hits > 0)
+			ExplainPropertyInteger("SQLite Lookup Cache Hits", NULL,
+								   festate->lookup_hits, es);
+		if (es->timing)
+		{
+			ExplainPropertyFloat("SQLite Step Time", "ms",
+								 INSTR_TIME_GET_MILLISEC(festate->step_time), 3, es);
+			ExplainPropertyFloat("SQLite Conversion Time", "ms",
+								 INSTR_TIME_GET_MILLISEC(festate->convert_time), 3, es);
+		}
+		for (i = 0; i < lengthof(sqlite_scan_stmt_counters); i++)
+			ExplainPropertyInteger(sqlite_scan_stmt_counters[i].label, NULL,
+								   sqlite3_stmt_status(festate->stmt,
+													   sqlite_scan_stmt_counters[i].op, 0),
+								   es);
+		if (sqlite3_db_status(festate->conn, SQLITE_DBSTATUS_CACHE_MISS,
+							  &cache_miss, &hiwtr, 0) == SQLITE_OK)
+			ExplainPropertyInteger("SQLite Cache Misses", NULL,
+								   cache_miss - festate->cache_miss_start, es);
+
+		if (es->verbose)
+			ExplainPropertyList("SQLite Plan",
+								sqlite_get_query_plan(festate->conn, sql), es);
+	}
+}
+
+/*
+ * Get the steps of the SQLite query plan of a query, as shown by EXPLAIN
+ * QUERY PLAN.
+ */
+static List *
+sqlite_get_query_plan(sqlite3 * conn, const char *query)
+{
+	sqlite3_stmt *stmt = NULL;
+	char	   *sql = psprintf("EXPLAIN QUERY PLAN %s", query);
+	List	   *steps = NIL;
+	int			rc;
+
+	rc = sqlite3_prepare_v2(conn, sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK)
+	{
+		sqlite3_finalize(stmt);
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+				 errmsg("SQL error during prepare: %s %s", sqlite3_errmsg(conn), sql)
+				 ));
+	}
+
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		const char *detail = (const char *) sqlite3_column_text(stmt, 3);
+
+		if (detail != NULL)
+			steps = lappend(steps, pstrdup(detail));
+	}
+	if (rc != SQLITE_DONE)
+	{
+		sqlite3_finalize(stmt);
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_ERROR),
+				 errmsg("Failed to execute remote SQL"),
+				 errcontext("SQL query: %s", sql),
+				 errhint("SQLite error '%s', SQLite result code %d", sqlite3_errmsg(conn), rc)
+				 ));
+	}
+	sqlite3_finalize(stmt);
+
+	return steps;
+}
+
+static void
+sqliteExplainForeignModify(ModifyTableState *mtstate,
+						   ResultRelInfo *rinfo,
+						   List *fdw_private,
+						   int subplan_index,
+						   struct ExplainState *es)
+{
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+#if PG_VERSION_NUM >= 140000
+	if (es->verbose)
+	{
+		/*
+		 * For INSERT we should always have batch size >= 1, but UPDATE and
+		 * DELETE don't support batching so don't show the property.
+		 */
+		if (rinfo->ri_BatchSize > 0)
+			ExplainPropertyInteger("Batch Size", NULL, rinfo->ri_BatchSize, es);
+	}
+#endif
+}
+
+/*
+ * Execute a query returning a single integer value, such as PRAGMA or
+ * count(*).  Returns false if the query can't be prepared or returns no
+ * value, for example when an optional SQLite feature is not compiled in.
+ */
+static bool
+sqlite_get_int64_value(sqlite3 * db, const char *sql, sqlite3_int64 *value)
+{
+	sqlite3_stmt *stmt = NULL;
+	bool		found = false;
+
+	if (sqlite3_prepare_v2(db, sql, -1, &stmt, NULL) != SQLITE_OK)
+	{
+		elog(DEBUG1, "sqlite_fdw : %s cannot prepare %s: %s", __func__, sql, sqlite3_errmsg(db));
+		sqlite3_finalize(stmt);
+		return false;
+	}
+
+	if (sqlite3_step(stmt) == SQLITE_ROW &&
+		sqlite3_column_type(stmt, 0) != SQLITE_NULL)
+	{
+		*value = sqlite3_column_int64(stmt, 0);
+		found = true;
+	}
+	sqlite3_finalize(stmt);
+	return found;
+}
+
+/*
+ * sqliteAnalyzeForeignTable
+ *		Test whether analyzing this foreign table is supported
+ */
+static bool
+sqliteAnalyzeForeignTable(Relation relation,
+						  AcquireSampleRowsFunc *func,
+						  BlockNumber *totalpages)
+{
+	ForeignTable *table;
+	ForeignServer *server;
+	sqlite3	   *db;
+	StringInfoData sql;
+	sqlite3_int64 relsize = 0;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	/* Return the row-analysis function pointer */
+	*func = sqliteAcquireSampleRowsFunc;
+
+	table = GetForeignTable(RelationGetRelid(relation));
+	server = GetForeignServer(table->serverid);
+	db = sqlite_get_connection(server, false);
+
+	/*
+	 * Get the size of the table in bytes from dbstat virtual table.  If
+	 * SQLite is built without dbstat, use the size of the whole database
+	 * file, this overestimates the number of pages but is still much better
+	 * than the default 10 pages guess of the planner.
+	 */
+	initStringInfo(&sql);
+	sqlite_deparse_analyze_size_sql(&sql, relation);
+	if (!sqlite_get_int64_value(db, sql.data, &relsize))
+	{
+		sqlite3_int64 page_count = 0;
+		sqlite3_int64 page_size = 0;
+
+		if (sqlite_get_int64_value(db, "PRAGMA page_count", &page_count) &&
+			sqlite_get_int64_value(db, "PRAGMA page_size", &page_size))
+			relsize = page_count * page_size;
+	}
+
+	*totalpages = (BlockNumber) Max(1, relsize / BLCKSZ);
+
+	return true;
+}
+
+/*
+ * Acquire a random sample of rows from foreign table managed by sqlite_fdw.
+ *
+ * Number of rows in the table is read by count(*) first.  If the table is
+ * larger than targrows, rows are filtered on SQLite side by Bernoulli
+ * sampling using random(), with some oversampling, and the final sample is
+ * selected locally by the same reservoir algorithm as for ordinary tables.
+ * Hence only about targrows rows are transferred and converted to
+ * PostgreSQL values.
+ *
+ * We report estimates of live tuples from count(*) and dead tuples as zero,
+ * SQLite doesn't keep dead tuples in a table.
+ */
+static int
+sqliteAcquireSampleRowsFunc(Relation relation, int elevel,
+							HeapTuple *rows, int targrows,
+							double *totalrows,
+							double *totaldeadrows)
+{
+	ForeignTable *table;
+	ForeignServer *server;
+	sqlite3	   *db;
+	sqlite3_stmt *stmt = NULL;
+	StringInfoData sql;
+	List	   *retrieved_attrs = NIL;
+	TupleDesc	tupdesc = RelationGetDescr(relation);
+	AttInMetadata *attinmeta;
+	SqliteValueConverter *converters;
+	Datum	   *values;
+	bool	   *nulls;
+	sqlite3_int64 remote_rows = 0;
+	double		samplerows = 0;
+	double		rowstoskip = -1;
+	int			numrows = 0;
+	int			rc;
+	ReservoirStateData rstate;
+	MemoryContext anl_cxt = CurrentMemoryContext;
+	MemoryContext tmp_cxt;
+	ConversionLocation errpos;
+	ErrorContextCallback errcallback;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	table = GetForeignTable(RelationGetRelid(relation));
+	server = GetForeignServer(table->serverid);
+	db = sqlite_get_connection(server, false);
+
+	/* Count rows of the table */
+	initStringInfo(&sql);
+	sqlite_deparse_analyze_info_sql(&sql, relation);
+	sqlite_prepare_wrapper(server, db, sql.data, &stmt, NULL, true);
+	rc = sqlite3_step(stmt);
+	if (rc != SQLITE_ROW)
+		sqlitefdw_report_error(ERROR, stmt, db, sql.data, rc);
+	remote_rows = sqlite3_column_int64(stmt, 0);
+	sqlite_release_stmt(server, stmt);
+
+	/* Construct SELECT of sample rows */
+	resetStringInfo(&sql);
+	sqlite_deparse_analyze(&sql, relation, &retrieved_attrs);
+	if (remote_rows > targrows)
+	{
+		/* Select 10% more rows than needed, reservoir cuts the excess */
+		double		sample_frac = targrows * 1.1 / remote_rows;
+
+		if (sample_frac < 1.0)
+			appendStringInfo(&sql, " WHERE (random() & %d) < %d",
+							 SQLITE_ANALYZE_SAMPLE_MASK,
+							 (int) ceil(sample_frac * (SQLITE_ANALYZE_SAMPLE_MASK + 1)));
+	}
+	sqlite_prepare_wrapper(server, db, sql.data, &stmt, NULL, true);
+
+	tmp_cxt = AllocSetContextCreate(CurrentMemoryContext,
+									"sqlite_fdw temporary data",
+									ALLOCSET_SMALL_SIZES);
+	attinmeta = TupleDescGetAttInMetadata(tupdesc);
+	converters = sqlite_get_value_converters(tupdesc, retrieved_attrs);
+	values = (Datum *) palloc(tupdesc->natts * sizeof(Datum));
+	nulls = (bool *) palloc(tupdesc->natts * sizeof(bool));
+	reservoir_init_selection_state(&rstate, targrows);
+
+	errpos.rel = relation;
+	errpos.fsstate = NULL;
+
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
+	{
+		int			pos = -1;
+
+		/* Allow users to cancel long query */
+		vacuum_delay_point();
+
+		samplerows += 1;
+
+		if (numrows < targrows)
+			pos = numrows++;
+		else
+		{
+			/*
+			 * Once the initial sample is full, each row replaces a random
+			 * one of the sample with decreasing probability, see
+			 * acquire_sample_rows() for details.
+			 */
+			if (rowstoskip < 0)
+				rowstoskip = reservoir_get_next_S(&rstate, samplerows, targrows);
+
+			if (rowstoskip <= 0)
+			{
+#if PG_VERSION_NUM >= 150000
+				pos = (int) (targrows * sampler_random_fract(&rstate.randstate));
+#else
+				pos = (int) (targrows * sampler_random_fract(rstate.randstate));
+#endif
+				Assert(pos >= 0 && pos < targrows);
+				heap_freetuple(rows[pos]);
+			}
+			rowstoskip -= 1;
+		}
+
+		if (pos >= 0)
+		{
+			ListCell   *lc;
+			int			stmt_colid = 0;
+
+			MemoryContextReset(tmp_cxt);
+			MemoryContextSwitchTo(tmp_cxt);
+
+			memset(values, 0, tupdesc->natts * sizeof(Datum));
+			memset(nulls, true, tupdesc->natts * sizeof(bool));
+
+			/*
+			 * Set up and install callback to report where conversion error
+			 * occurs.
+			 */
+			errcallback.callback = conversion_error_callback;
+			errcallback.arg = (void *) &errpos;
+			errcallback.previous = error_context_stack;
+			error_context_stack = &errcallback;
+
+			foreach(lc, retrieved_attrs)
+			{
+				int			attnum = lfirst_int(lc) - 1;
+				Form_pg_attribute att = TupleDescAttr(tupdesc, attnum);
+				sqlite3_value *val = sqlite3_column_value(stmt, stmt_colid);
+				int			sqlite_value_affinity = sqlite3_value_type(val);
+
+				errpos.cur_attno = attnum + 1;
+				errpos.att = att;
+				errpos.val = val;
+				if (sqlite_value_affinity != SQLITE_NULL)
+				{
+					NullableDatum sqlite_coverted;
+
+					sqlite_coverted = converters[stmt_colid] (att, val, attinmeta,
+															  attnum, sqlite_value_affinity, 0);
+					nulls[attnum] = sqlite_coverted.isnull;
+					values[attnum] = sqlite_coverted.value;
+				}
+				stmt_colid++;
+			}
+
+			/* Uninstall error context callback. */
+			error_context_stack = errcallback.previous;
+
+			MemoryContextSwitchTo(anl_cxt);
+			rows[pos] = heap_form_tuple(tupdesc, values, nulls);
+		}
+	}
+
+	if (rc != SQLITE_DONE)
+		sqlitefdw_report_error(ERROR, stmt, db, sql.data, rc);
+	sqlite_release_stmt(server, stmt);
+
+	MemoryContextDelete(tmp_cxt);
+
+	*totalrows = (double) remote_rows;
+	*totaldeadrows = 0;
+
+	ereport(elevel,
+			(errmsg("\"%s\": table contains %.0f rows, %.0f rows fetched, %d rows in sample",
+					RelationGetRelationName(relation),
+					(double) remote_rows, samplerows, numrows)));
+
+	return numrows;
+}
+
+/*
+ * Import a foreign schema
+ */
+static List *
+sqliteImportForeignSchema(ImportForeignSchemaStmt *stmt,
+						  Oid serverOid)
+{
+	sqlite3		   *volatile db = NULL;
+	sqlite3_stmt   *volatile sql_stmt = NULL;
+	ForeignServer  *server;
+	ListCell	   *lc;
+	StringInfoData  buf;
+	List	 	   *commands = NIL;
+	bool			import_default = false;
+	bool			import_not_null = true;
+	bool			import_strict_affinity = false;
+	bool			import_estimated_rows = false;
+
+	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+
+	/* Parse statement options */
+	foreach(lc, stmt->options)
+	{
+		DefElem		*def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "import_default") == 0)
+			import_default = defGetBoolean(def);
+		else if (strcmp(def->defname, "import_not_null") == 0)
+			import_not_null = defGetBoolean(def);
+		else if (strcmp(def->defname, "import_strict_affinity") == 0)
+			import_strict_affinity = defGetBoolean(def);
+		else if (strcmp(def->defname, "import_estimated_rows") == 0)
+			import_estimated_rows = defGetBoolean(def);
+		else
+			ereport(ERROR,
+					(errcode(ERRCODE_FDW_INVALID_OPTION_NAME),
+					 errmsg("invalid option \"%s\"", def->defname)));
+	}
+
+	server = GetForeignServerByName(stmt->server_name, false);
+	db = sqlite_get_connection(server, false);
+
+	PG_TRY();
+	{
+		char	   *table = NULL;
+		bool		strict = false;
+		sqlite3_int64 rows = -1;
+		List	   *columns = NIL;
+
+		initStringInfo(&buf);
+		sqlite_import_schema_sql(&buf, stmt, db, import_estimated_rows);
+		sqlite_prepare_wrapper(server, db, buf.data, (sqlite3_stmt * *) & sql_stmt, NULL, false);
+
+		/* The rows are the columns of all tables, ordered by table */
+		for (;;)
+		{
+			SqliteImportColumn *col;
+			const char *name = NULL;
+			char	   *default_val;
+			StringInfoData pg_type;
+			int			rc = sqlite3_step(sql_stmt);
+
+			if (rc == SQLITE_ROW)
+				name = (const char *) sqlite3_column_text(sql_stmt, 0);
+			else if (rc != SQLITE_DONE)
+			{
+				/*
+				 * Not pass sql_stmt to sqlitefdw_report_error because it is
+				 * finalized in PG_CATCH
+				 */
+				sqlitefdw_report_error(ERROR, NULL, db, sqlite3_sql(sql_stmt), rc);
+			}
+
+			/* All columns of the previous table have been read */
+			if (table != NULL && (name == NULL || strcmp(name, table) != 0))
+			{
+				char	   *command = sqlite_import_table_command(server, db, stmt, table, columns,
+																  strict, rows,
+																  import_default, import_not_null,
+																  import_strict_affinity);
+
+				commands = lappend(commands, command);
+				elog(DEBUG1, "sqlite_fdw : %s %s", __func__, command);
+				table = NULL;
+				columns = NIL;
+			}
+			if (rc == SQLITE_DONE)
+				break;
+
+			if (table == NULL)
+			{
+				table = pstrdup(name);
+				strict = (sqlite3_column_int(sql_stmt, 1) != 0);
+				rows = (sqlite3_column_type(sql_stmt, 2) == SQLITE_NULL) ?
+					-1 : sqlite3_column_int64(sql_stmt, 2);
+			}
+
+			col = palloc0(sizeof(SqliteImportColumn));
+			col->name = pstrdup((char *) sqlite3_column_text(sql_stmt, 3));
+			if (sqlite3_column_type(sql_stmt, 4) != SQLITE_NULL)
+				col->type_name = pstrdup((char *) sqlite3_column_text(sql_stmt, 4));
+			col->not_null = (sqlite3_column_int(sql_stmt, 5) == 1);
+			default_val = (char *) sqlite3_column_text(sql_stmt, 6);
+			if (default_val)
+				col->default_val = pstrdup(default_val);
+			col->primary_key = (sqlite3_column_int(sql_stmt, 7) != 0);
+
+			initStringInfo(&pg_type);
+			sqlite_to_pg_type(&pg_type, col->type_name);
+			col->pg_type = pg_type.data;
+
+			columns = lappend(columns, col);
+		}
+	}
+	PG_CATCH();
+	{
+		if (sql_stmt)
+			sqlite3_finalize(sql_stmt);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	if (sql_stmt)
+		sqlite3_finalize(sql_stmt);
+
+	return commands;
+}
+
+/*
+ * Construct the query which returns the columns of all tables to import in
+ * one pass over the schema, ordered by table.  Views are not imported: the
+ * columns of a view whose table has been dropped can't be read, which would
+ * fail the whole query.  The columns are:
+ *
+ * name of the table, STRICT flag, number of rows from sqlite_stat1 or NULL,
+ * then name, data type, NOT NULL flag, default value and key flag of the
+ * column.
+ *
+ * Key columns are the primary key of the table.  A table without primary key
+ * takes the columns of its oldest unique index over NOT NULL columns.
+ */
+static void
+sqlite_import_schema_sql(StringInfo buf, ImportForeignSchemaStmt *stmt, sqlite3 * db,
+						 bool import_estimated_rows)
+{
+	sqlite3_int64 stat_exists;
+	ListCell   *lc;
+
+	appendStringInfoString(buf, "SELECT s.name, ");
+
+	/* PRAGMA table_list appeared together with STRICT tables */
+	if (sqlite3_libversion_number() >= 3037000)
+		appendStringInfoString(buf, "coalesce((SELECT l.strict FROM pragma_table_list l WHERE l.schema = 'main' AND l.name = s.name), 0), ");
+	else
+		appendStringInfoString(buf, "0, ");
+
+	/* sqlite_stat1 exists only if ANALYZE was executed in SQLite */
+	if (import_estimated_rows &&
+		sqlite_get_int64_value(db, "SELECT 1 FROM sqlite_master WHERE type = 'table' AND name = 'sqlite_stat1'", &stat_exists))
+		appendStringInfoString(buf, "(SELECT CAST(stat AS integer) FROM sqlite_stat1 WHERE tbl = s.name ORDER BY idx IS NOT NULL LIMIT 1), ");
+	else
+		appendStringInfoString(buf, "NULL, ");
+
+	appendStringInfoString(buf,
+						   "p.name, p.type, p.\"notnull\", p.dflt_value, "
+						   "p.pk > 0 OR (NOT EXISTS (SELECT 1 FROM pragma_table_info(s.name) k WHERE k.pk > 0) AND "
+						   "p.name IN (SELECT i.name FROM pragma_index_info("
+						   "(SELECT il.name FROM pragma_index_list(s.name) il WHERE il.\"unique\" AND NOT il.partial AND "
+						   "NOT EXISTS (SELECT 1 FROM pragma_index_info(il.name) ii LEFT JOIN pragma_table_info(s.name) c ON c.name = ii.name WHERE c.\"notnull\" IS NOT 1) "
+						   "ORDER BY il.seq DESC LIMIT 1)) i)) "
+						   "FROM sqlite_master s JOIN pragma_table_info(s.name) p "
+						   "WHERE s.type = 'table' AND s.name NOT LIKE 'sqlite_%'");
+
+	/* Apply restrictions for LIMIT TO and EXCEPT */
+	if (stmt->list_type == FDW_IMPORT_SCHEMA_LIMIT_TO ||
+		stmt->list_type == FDW_IMPORT_SCHEMA_EXCEPT)
+	{
+		bool		first_item = true;
+
+		appendStringInfoString(buf, " AND s.name ");
+		if (stmt->list_type == FDW_IMPORT_SCHEMA_EXCEPT)
+			appendStringInfoString(buf, "NOT ");
+		appendStringInfoString(buf, "IN (");
+
+		foreach(lc, stmt->table_list)
+		{
+			RangeVar   *rv = (RangeVar *) lfirst(lc);
+
+			if (first_item)
+				first_item = false;
+			else
+				appendStringInfoString(buf, ", ");
+
+			appendStringInfoString(buf, quote_literal_cstr(rv->relname));
+		}
+		appendStringInfoChar(buf, ')');
+	}
+
+	appendStringInfoString(buf, " ORDER BY s.rowid, p.cid");
+}
+
+/*
+ * Build the CREATE FOREIGN TABLE command of an imported table
+ */
+static char *
+sqlite_import_table_command(ForeignServer *server, sqlite3 * db,
+							ImportForeignSchemaStmt *stmt,
+							const char *table, List *columns,
+							bool strict, sqlite3_int64 rows,
+							bool import_default, bool import_not_null,
+							bool import_strict_affinity)
+{
+	StringInfoData buf;
+	ListCell   *lc;
+	bool		first_item = true;
+
+	/*
+	 * Values of a STRICT table have the declared data type, except for the
+	 * columns declared as ANY.
+	 */
+	if (strict)
+	{
+		foreach(lc, columns)
+		{
+			SqliteImportColumn *col = (SqliteImportColumn *) lfirst(lc);
+
+			if (col->type_name && pg_strcasecmp(col->type_name, "any") == 0)
+				col->strict_affinity = "false";
+		}
+	}
+	if (import_strict_affinity)
+		sqlite_import_profile_affinity(server, db, table, columns, strict);
+
+	initStringInfo(&buf);
+	appendStringInfo(&buf, "CREATE FOREIGN TABLE %s.%s (\n",
+					 quote_identifier(stmt->local_schema), quote_identifier(table));
+
+	foreach(lc, columns)
+	{
+		SqliteImportColumn *col = (SqliteImportColumn *) lfirst(lc);
+		bool		first_option = true;
+
+		if (first_item)
+			first_item = false;
+		else
+			appendStringInfoString(&buf, ",\n");
+
+		appendStringInfo(&buf, "%s %s", quote_identifier(col->name), col->pg_type);
+
+		/* part of the primary key */
+		if (col->primary_key)
+		{
+			appendStringInfoString(&buf, " OPTIONS (key 'true'");
+			first_option = false;
+		}
+		if (col->strict_affinity)
+		{
+			appendStringInfo(&buf, "%sstrict_affinity '%s'",
+							 first_option ? " OPTIONS (" : ", ",
+							 col->strict_affinity);
+			/* keep values written by sqlite_fdw in the same form */
+			if (strcmp(col->strict_affinity, "true") == 0 &&
+				strcmp(col->pg_type, "uuid") == 0)
+				appendStringInfoString(&buf, ", column_type 'BLOB'");
+			first_option = false;
+		}
+		if (!first_option)
+			appendStringInfoChar(&buf, ')');
+
+		if (col->not_null && import_not_null)
+			appendStringInfo(&buf, " NOT NULL");
+
+		if (col->default_val && import_default)
+			appendStringInfo(&buf, " DEFAULT %s", col->default_val);
+	}
+
+	appendStringInfo(&buf, "\n) SERVER %s\nOPTIONS (table ",
+					 quote_identifier(stmt->server_name));
+	sqlite_deparse_string_literal(&buf, table);
+	if (strict)
+		appendStringInfoString(&buf, ", strict 'true'");
+	if (rows >= 0)
+		appendStringInfo(&buf, ", estimated_rows '" INT64_FORMAT "'", (int64) rows);
+	appendStringInfoString(&buf, ");");
+
+	return buf.data;
+}
+
+/*
+ * Scan a SQLite table once and check typeof() of every column which sqlite_fdw
+ * normalizes, see sqlite_deparse_column_name().  A column is strict if all of
+ * its values have the storage class sqlite_fdw writes for its data type.  Only
+ * the ANY columns of a STRICT table are checked.
+ */
+static void
+sqlite_import_profile_affinity(ForeignServer *server, sqlite3 * db, const char *table, List *columns,
+							   bool strict)
+{
+	sqlite3_stmt *volatile profile_stmt = NULL;
+	StringInfoData query;
+	List	   *profiled = NIL;
+	ListCell   *lc;
+
+	initStringInfo(&query);
+	foreach(lc, columns)
+	{
+		SqliteImportColumn *col = (SqliteImportColumn *) lfirst(lc);
+		const char *name = quote_identifier(col->name);
+		bool		is_float = (strcmp(col->pg_type, "double precision") == 0 ||
+								strcmp(col->pg_type, "decimal") == 0);
+		bool		is_bool = (strcmp(col->pg_type, "boolean") == 0);
+		bool		is_uuid = (strcmp(col->pg_type, "uuid") == 0);
+
+		/* The declaration of a STRICT table is already known */
+		if (strict && col->strict_affinity == NULL)
+			continue;
+		if (!is_float && !is_bool && !is_uuid)
+			continue;
+
+		appendStringInfoString(&query, profiled == NIL ? "SELECT " : ", ");
+
+		/* Count the values which need normalization */
+		if (is_float)
+			appendStringInfo(&query, "total(typeof(%s) IN ('text', 'blob'))", name);
+		else if (is_bool)
+			appendStringInfo(&query, "total(%s IS NOT NULL AND (typeof(%s) <> 'integer' OR %s NOT IN (0, 1)))",
+							 name, name, name);
+		else
+			appendStringInfo(&query, "total(%s IS NOT NULL AND (typeof(%s) <> 'blob' OR length(%s) <> 16))",
+							 name, name, name);
+		profiled = lappend(profiled, col);
+	}
+	if (profiled == NIL)
+	{
+		pfree(query.data);
+		return;
+	}
+	appendStringInfo(&query, " FROM %s", quote_identifier(table));
+
+	PG_TRY();
+	{
+		int			rc;
+		int			i = 0;
+
+		sqlite_prepare_wrapper(server, db, query.data, (sqlite3_stmt * *) & profile_stmt, NULL, false);
+		rc = sqlite3_step(profile_stmt);
+		if (rc != SQLITE_ROW)
+			sqlitefdw_report_error(ERROR, NULL, db, sqlite3_sql(profile_stmt), rc);
+
+		foreach(lc, profiled)
+		{
+			SqliteImportColumn *col = (SqliteImportColumn *) lfirst(lc);
+
+			if (sqlite3_column_double(profile_stmt, i++) == 0)
+				col->strict_affinity = "true";
+		}
+	}
+	PG_CATCH();
+	{
+		if (profile_stmt)
+			sqlite3_finalize(profile_stmt);
+		PG_RE_THROW();
+	}
+	PG_END_TRY();
+
+	sqlite3_finalize(profile_stmt);
+	list_free(profiled);
+	pfree(query.data);
+}
+
+/*
+ * Get the number of rows of a foreign table from sqlite_stat1, which is
+ * filled by ANALYZE command of SQLite.  Returns -1 if there are no such
+ * statistics.
+ */
+static double
+sqlite_get_remote_reltuples(ForeignServer *server, Oid foreigntableid)
+{
+	sqlite3	   *conn = sqlite_get_connection(server, false);
+	Relation	rel;
+	StringInfoData sql;
+	sqlite3_int64 tuples;
+
+	/*
+	 * Core code already has some lock on each rel being planned, so we can
+	 * use NoLock here.
+	 */
+	rel = table_open(foreigntableid, NoLock);
+	initStringInfo(&sql);
+	sqlite_deparse_remote_tuples_sql(&sql, rel);
+	table_close(rel, NoLock);
+
+	if (!sqlite_get_int64_value(conn, sql.data, &tuples))
+		return -1;
+	return (double) tuples;
+}
+
+/*
+ * Get the average number of rows for a given number of equality constrained
+ * leading columns of the index from sqlite_stat1.  The first integer of the
+ * stat column is the number of rows in the index, next integers are the
+ * average numbers of rows with the same values in the first N columns.
+ * Returns -1 if there are no such statistics.
+ */
+static double
+sqlite_get_remote_index_rows(sqlite3 * conn, const char *idxname, int neq)
+{
+	sqlite3_stmt *stmt = NULL;
+	double		result = -1;
+
+	if (sqlite3_prepare_v2(conn, "SELECT stat FROM sqlite_stat1 WHERE idx = ?",
+						   -1, &stmt, NULL) != SQLITE_OK)
+	{
+		/* There is no sqlite_stat1 table if ANALYZE was never executed */
+		sqlite3_finalize(stmt);
+		return -1;
+	}
+
+	sqlite3_bind_text(stmt, 1, idxname, -1, SQLITE_TRANSIENT);
+	if (sqlite3_step(stmt) == SQLITE_ROW)
+	{
+		const char *stat = (const char *) sqlite3_column_text(stmt, 0);
+		int			i = 0;
+
+		while (stat && *stat)
+		{
+			char	   *end;
+			double		val = strtod(stat, &end);
+
+			if (end == stat)
+				break;
+			if (i == neq)
+			{
+				result = val;
+				break;
+			}
+			stat = end;
+			i++;
+		}
+	}
+	sqlite3_finalize(stmt);
+	return result;
 }
 
-static void
-sqliteEndForeignModify(EState *estate,
-					   ResultRelInfo *resultRelInfo)
+/*
+ * Get the number of rows of the relation which is scanned by a SCAN or
+ * SEARCH step of a SQLite query plan.  Relations of a pushed down join are
+ * aliased as rN in the remote query, where N is the relid.
+ */
+static double
+sqlite_eqp_relation_tuples(PlannerInfo *root, RelOptInfo *foreignrel, const char *alias)
 {
+	int			relid;
 
-	SqliteFdwExecState *fmstate = (SqliteFdwExecState *) resultRelInfo->ri_FdwState;
+	if (IS_SIMPLE_REL(foreignrel))
+		return Max(foreignrel->tuples, 1);
 
-	elog(DEBUG1, "sqlite_fdw : %s", __func__);
-	if (fmstate && fmstate->stmt)
+	if (sscanf(alias, "r%d", &relid) == 1 && relid > 0 &&
+		bms_is_member(relid, foreignrel->relids))
 	{
-		fmstate->stmt = NULL;
+		RelOptInfo *baserel = find_base_rel(root, relid);
+
+		return Max(baserel->tuples, 1);
 	}
+
+	return DEFAULTE_NUM_ROWS;
 }
 
-static void
-sqliteExplainForeignScan(ForeignScanState *node,
-						 struct ExplainState *es)
+/*
+ * Parse the detail text of a SCAN or SEARCH step of a SQLite query plan.
+ * SQLite before 3.36 prints "SEARCH TABLE name AS alias USING ...", later
+ * versions print "SEARCH alias USING ...".  The name or alias of the scanned
+ * relation is copied to alias, and *rest is set to the part after it, which
+ * tells the index and the constraints used.  Returns false for other steps.
+ */
+static bool
+sqlite_parse_eqp_step(const char *detail, bool *is_search, char *alias,
+					  const char **rest)
 {
-	ForeignScan *plan = castNode(ForeignScan, node->ss.ps.plan);
-	List	   *fdw_private = plan->fdw_private;
-	char	   *sql = strVal(list_nth(fdw_private, FdwScanPrivateSelectSql));
-
-	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+	const char *p;
+	size_t		len;
 
-	if (es->verbose)
+	if (strncmp(detail, "SCAN ", 5) == 0)
 	{
-		ExplainPropertyText("SQLite query", sql, es);
+		*is_search = false;
+		p = detail + 5;
 	}
-}
+	else if (strncmp(detail, "SEARCH ", 7) == 0)
+	{
+		*is_search = true;
+		p = detail + 7;
+	}
+	else
+		return false;
 
-static void
-sqliteExplainForeignModify(ModifyTableState *mtstate,
-						   ResultRelInfo *rinfo,
-						   List *fdw_private,
-						   int subplan_index,
-						   struct ExplainState *es)
-{
-	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+	if (strncmp(p, "TABLE ", 6) == 0)
+		p += 6;
+	if (strcmp(p, "CONSTANT ROW") == 0)
+		return false;
 
-#if PG_VERSION_NUM >= 140000
-	if (es->verbose)
+	/* An alias follows the name only in the older format */
+	len = strcspn(p, " ");
+	if (strncmp(p + len, " AS ", 4) == 0)
 	{
-		/*
-		 * For INSERT we should always have batch size >= 1, but UPDATE and
-		 * DELETE don't support batching so don't show the property.
-		 */
-		if (rinfo->ri_BatchSize > 0)
-			ExplainPropertyInteger("Batch Size", NULL, rinfo->ri_BatchSize, es);
+		p += len + 4;
+		len = strcspn(p, " ");
 	}
-#endif
-}
+	if (len == 0)
+		return false;
 
-static bool
-sqliteAnalyzeForeignTable(Relation relation,
-						  AcquireSampleRowsFunc *func,
-						  BlockNumber *totalpages)
-{
-	elog(DEBUG1, "sqlite_fdw : %s", __func__);
-	return false;
+	strlcpy(alias, p, Min(len + 1, NAMEDATALEN));
+	*rest = p + len;
+	return true;
 }
 
 /*
- * Import a foreign schema
+ * Estimate costs of executing a SQL statement remotely. The given "sql" must
+ * be an EXPLAIN QUERY PLAN command.
+ *
+ * SQLite doesn't report estimated costs or rows, so each SCAN and SEARCH step
+ * of the query plan is costed here.  A SCAN step reads all rows of the
+ * relation.  A SEARCH step reads the rows matching the equality constrained
+ * index columns, as told by sqlite_stat1, and each range constraint is
+ * assumed to select 1/4 of rows like SQLite does without sqlite_stat4.
+ * Steps of a join are nested loops, so every step is repeated for each row
+ * of the previous steps.  A temporary B-tree for ORDER BY, GROUP BY or
+ * DISTINCT is costed as a sort of all rows.
+ *
+ * Conditions which are not used by an index are not reflected in the
+ * number of rows, hence the result is an upper bound of the rows.
  */
-static List *
-sqliteImportForeignSchema(ImportForeignSchemaStmt *stmt,
-						  Oid serverOid)
+static void
+sqlite_get_remote_estimate(const char *sql, sqlite3 * conn,
+						   PlannerInfo *root, RelOptInfo *foreignrel,
+						   double *rows, Cost *startup_cost, Cost *total_cost)
 {
-	sqlite3		   *volatile db = NULL;
-	sqlite3_stmt   *volatile sql_stmt = NULL;
-	sqlite3_stmt   *volatile pragma_stmt = NULL;
-	ForeignServer  *server;
-	ListCell	   *lc;
-	StringInfoData  buf;
-	List	 	   *commands = NIL;
-	bool			import_default = false;
-	bool			import_not_null = true;
+	sqlite3_stmt *stmt = NULL;
+	int			rc;
+	double		outer_rows = 1;
+	double		or_rows = 0;
+	int			or_id = -1;
+	Cost		run_cost = 0;
+	bool		has_temp_btree = false;
 
-	elog(DEBUG1, "sqlite_fdw : %s", __func__);
+	elog(DEBUG1, "sqlite_fdw : %s %s", __func__, sql);
 
-	/* Parse statement options */
-	foreach(lc, stmt->options)
+	rc = sqlite3_prepare_v2(conn, sql, -1, &stmt, NULL);
+	if (rc != SQLITE_OK)
 	{
-		DefElem		*def = (DefElem *) lfirst(lc);
-
-		if (strcmp(def->defname, "import_default") == 0)
-			import_default = defGetBoolean(def);
-		else if (strcmp(def->defname, "import_not_null") == 0)
-			import_not_null = defGetBoolean(def);
-		else
-			ereport(ERROR,
-					(errcode(ERRCODE_FDW_INVALID_OPTION_NAME),
-					 errmsg("invalid option \"%s\"", def->defname)));
+		sqlite3_finalize(stmt);
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_UNABLE_TO_CREATE_EXECUTION),
+				 errmsg("SQL error during prepare: %s %s", sqlite3_errmsg(conn), sql)
+				 ));
 	}
 
-	server = GetForeignServerByName(stmt->server_name, false);
-	db = sqlite_get_connection(server, false);
-
-	PG_TRY();
+	while ((rc = sqlite3_step(stmt)) == SQLITE_ROW)
 	{
-		/* You want all tables, except system tables */
-		initStringInfo(&buf);
-		appendStringInfo(&buf, "SELECT name FROM sqlite_master WHERE type = 'table' AND name NOT LIKE 'sqlite_%%'");
+		int			id = sqlite3_column_int(stmt, 0);
+		int			parent = sqlite3_column_int(stmt, 1);
+		const char *detail = (const char *) sqlite3_column_text(stmt, 3);
+		bool		is_search;
+		const char *p;
+		char		alias[NAMEDATALEN];
+		double		tuples;
+		double		examined;
+		Cost		loop_cost;
+
+		if (detail == NULL)
+			continue;
 
-		/* Apply restrictions for LIMIT TO and EXCEPT */
-		if (stmt->list_type == FDW_IMPORT_SCHEMA_LIMIT_TO ||
-			stmt->list_type == FDW_IMPORT_SCHEMA_EXCEPT)
+		/* All branches of a MULTI-INDEX OR step are over, count their rows */
+		if (parent != or_id && or_rows > 0)
 		{
-			bool		first_item = true;
-
-			appendStringInfoString(&buf, " AND name ");
-			if (stmt->list_type == FDW_IMPORT_SCHEMA_EXCEPT)
-				appendStringInfoString(&buf, "NOT ");
-			appendStringInfoString(&buf, "IN (");
-
-			foreach(lc, stmt->table_list)
-			{
-				RangeVar   *rv = (RangeVar *) lfirst(lc);
-
-				if (first_item)
-					first_item = false;
-				else
-					appendStringInfoString(&buf, ", ");
+			outer_rows *= or_rows;
+			or_rows = 0;
+		}
 
-				appendStringInfoString(&buf, quote_literal_cstr(rv->relname));
-			}
-			appendStringInfoChar(&buf, ')');
+		if (strncmp(detail, "MULTI-INDEX OR", 14) == 0)
+		{
+			or_id = id;
+			continue;
+		}
+		if (strncmp(detail, "USE TEMP B-TREE", 15) == 0)
+		{
+			has_temp_btree = true;
+			continue;
 		}
 
-		sqlite_prepare_wrapper(server, db, buf.data, (sqlite3_stmt * *) & sql_stmt, NULL, false);
+		/* p points to the index and constraints part of the step */
+		if (!sqlite_parse_eqp_step(detail, &is_search, alias, &p))
+			continue;
 
-		/* Scan all rows for this table */
-		for (;;)
-		{
+		tuples = sqlite_eqp_relation_tuples(root, foreignrel, alias);
+		examined = tuples;
+		loop_cost = 0;
 
-			char	   *table;
-			char	   *query;
-			bool		first_item = true;
-			int			rc = sqlite3_step(sql_stmt);
+		if (is_search)
+		{
+			const char *cons = strchr(p, '(');
+			int			neq = 0;
+			int			nrange = 0;
 
-			if (rc == SQLITE_DONE)
-				break;
-			else if (rc != SQLITE_ROW)
+			/* Count equality and range constraints used by the index */
+			while (cons && *cons && *cons != ')')
 			{
-				/*
-				 * Not pass sql_stmt to sqlitefdw_report_error because it is
-				 * finalized in PG_CATCH
-				 */
-				sqlitefdw_report_error(ERROR, NULL, db, sqlite3_sql(sql_stmt), rc);
+				size_t		len = strcspn(cons + 1, " )");
+
+				if (len > 0 && memchr(cons + 1, '=', len) != NULL &&
+					memchr(cons + 1, '<', len) == NULL &&
+					memchr(cons + 1, '>', len) == NULL)
+					neq++;
+				else if (len > 0 && (memchr(cons + 1, '<', len) != NULL ||
+									 memchr(cons + 1, '>', len) != NULL))
+					nrange++;
+				cons += len + 1;
+				if (strncmp(cons, " AND", 4) == 0)
+					cons += 4;
 			}
-			table = (char *) sqlite3_column_text(sql_stmt, 0);
-
-			resetStringInfo(&buf);
-			appendStringInfo(&buf, "CREATE FOREIGN TABLE %s.%s (\n",
-							 quote_identifier(stmt->local_schema), quote_identifier(table));
-
-			query = palloc0(strlen(table) + 30);
-			sprintf(query, "PRAGMA table_info(%s)", quote_identifier(table));
-
-			sqlite_prepare_wrapper(server, db, query, (sqlite3_stmt * *) & pragma_stmt, NULL, false);
 
-			for (;;)
+			if (strstr(p, "INTEGER PRIMARY KEY") != NULL)
 			{
-				char	   *col_name;
-				char	   *type_name;
-				bool		not_null;
-				char	   *default_val;
-				int			primary_key;
-
-				rc = sqlite3_step(pragma_stmt);
-				if (rc == SQLITE_DONE)
-					break;
-				else if (rc != SQLITE_ROW)
-				{
-					/* Not pass sql_stmt because it is finalized in PG_CATCH */
-					sqlitefdw_report_error(ERROR, NULL, db, sqlite3_sql(pragma_stmt), rc);
-				}
-				col_name = (char *) sqlite3_column_text(pragma_stmt, 1);
-				type_name = (char *) sqlite3_column_text(pragma_stmt, 2);
-				not_null = (sqlite3_column_int(pragma_stmt, 3) == 1);
-				default_val = (char *) sqlite3_column_text(pragma_stmt, 4);
-				primary_key = sqlite3_column_int(pragma_stmt, 5);
-
-				if (first_item)
-					first_item = false;
-				else
-					appendStringInfoString(&buf, ",\n");
-
-				appendStringInfo(&buf, "%s ", quote_identifier(col_name));
-
-				sqlite_to_pg_type(&buf, type_name);
-
-				/* part of the primary key */
-				if (primary_key)
-					appendStringInfo(&buf, " OPTIONS (key 'true')");
+				if (neq > 0)
+					examined = 1;
+			}
+			else if (neq > 0)
+			{
+				const char *idx = strstr(p, "INDEX ");
+				double		idx_rows = -1;
 
-				if (not_null && import_not_null)
-					appendStringInfo(&buf, " NOT NULL");
+				if (idx != NULL && strstr(p, "AUTOMATIC") == NULL)
+				{
+					char		idxname[NAMEDATALEN * 2];
 
-				if (default_val && import_default)
-					appendStringInfo(&buf, " DEFAULT %s", default_val);
+					strlcpy(idxname, idx + 6, sizeof(idxname));
+					idxname[strcspn(idxname, " ")] = '\0';
+					idx_rows = sqlite_get_remote_index_rows(conn, idxname, neq);
+				}
 
+				/*
+				 * Without statistics SQLite assumes 10 rows for a value of
+				 * an indexed column.
+				 */
+				examined = (idx_rows >= 0) ? idx_rows : Min(tuples, 10);
 			}
 
-			sqlite3_finalize(pragma_stmt);
-			pragma_stmt = NULL;
-
-			appendStringInfo(&buf, "\n) SERVER %s\nOPTIONS (table ",
-							 quote_identifier(stmt->server_name));
-			sqlite_deparse_string_literal(&buf, table);
-			appendStringInfoString(&buf, ");");
-			commands = lappend(commands, pstrdup(buf.data));
+			while (nrange-- > 0)
+				examined /= 4;
+			examined = clamp_row_est(examined);
 
-			elog(DEBUG1, "sqlite_fdw : %s %s", __func__, pstrdup(buf.data));
+			/* Cost to descend the B-tree */
+			loop_cost += cpu_operator_cost * ceil(log2(tuples + 1));
 		}
+		loop_cost += cpu_tuple_cost * examined;
 
+		/* Steps of subqueries and OR branches are repeated for outer rows */
+		run_cost += outer_rows * loop_cost;
+
+		if (parent == 0)
+			outer_rows = clamp_row_est(outer_rows * examined);
+		else if (parent == or_id)
+			or_rows += examined;
 	}
-	PG_CATCH();
+
+	if (rc != SQLITE_DONE)
 	{
-		if (sql_stmt)
-			sqlite3_finalize(sql_stmt);
-		if (pragma_stmt)
-			sqlite3_finalize(pragma_stmt);
-		PG_RE_THROW();
+		sqlite3_finalize(stmt);
+		sqlitefdw_report_error(ERROR, NULL, conn, sql, rc);
 	}
-	PG_END_TRY();
+	sqlite3_finalize(stmt);
 
-	if (sql_stmt)
-		sqlite3_finalize(sql_stmt);
-	if (pragma_stmt)
-		sqlite3_finalize(pragma_stmt);
+	if (or_rows > 0)
+		outer_rows = clamp_row_est(outer_rows * or_rows);
 
-	return commands;
-}
+	if (has_temp_btree)
+	{
+		/* All rows must be sorted before the first row is returned */
+		Cost		sort_cost = 2.0 * cpu_operator_cost * outer_rows * ceil(log2(outer_rows + 1));
 
-/*
- * Estimate costs of executing a SQL statement remotely. The given "sql" must
- * be an EXPLAIN command.
- */
-static void
-sqlite_get_remote_estimate(const char *sql, sqlite3 * conn,
-						   double *rows, int *width,
-						   Cost *startup_cost, Cost *total_cost)
-{
-	/*
-	 * Disable this funtionality because Sqlite FDW does not use estimate from
-	 * remote for planning
-	 */
-	elog(ERROR, "Not supported to estimate from remote for planning");
+		*startup_cost = run_cost + sort_cost;
+		*total_cost = *startup_cost + cpu_operator_cost * outer_rows;
+	}
+	else
+	{
+		*startup_cost = 0;
+		*total_cost = run_cost;
+	}
+	*rows = outer_rows;
 }
 
 /*
@@ -3268,11 +5347,19 @@ sqlite_foreign_join_ok(PlannerInfo *root, RelOptInfo *joinrel, JoinType jointype
 	List	   *joinclauses;
 
 	/*
-	 * We support pushing down INNER and LEFT joins. Constructing queries
-	 * representing SEMI and ANTI joins is hard, hence not considered right
-	 * now.
+	 * We support pushing down INNER and LEFT joins, and SEMI and ANTI joins
+	 * as [NOT] EXISTS subqueries.
+	 */
+	if (jointype != JOIN_INNER && jointype != JOIN_LEFT &&
+		jointype != JOIN_SEMI && jointype != JOIN_ANTI)
+		return false;
+
+	/*
+	 * The columns of the inner relation of a SEMI or ANTI join are only
+	 * visible inside of the EXISTS subquery, so they can't be fetched.
 	 */
-	if (jointype != JOIN_INNER && jointype != JOIN_LEFT)
+	if ((jointype == JOIN_SEMI || jointype == JOIN_ANTI) &&
+		sqlite_refers_to_rels((Node *) joinrel->reltarget->exprs, innerrel->relids))
 		return false;
 
 	/*
@@ -3294,6 +5381,21 @@ sqlite_foreign_join_ok(PlannerInfo *root, RelOptInfo *joinrel, JoinType jointype
 	if (fpinfo_o->local_conds || fpinfo_i->local_conds)
 		return false;
 
+	/*
+	 * The SQLite rowid fetched as ctid of a base relation can't be
+	 * transferred through the target list of a join.
+	 */
+	if (fpinfo_o->rowid_identity || fpinfo_i->rowid_identity)
+		return false;
+
+	/*
+	 * The EXISTS conditions of semi-joins and anti-joins are put into the
+	 * WHERE clause, which would remove the rows on the nullable side of a
+	 * LEFT join instead of null-extending them.
+	 */
+	if (jointype == JOIN_LEFT && !bms_is_empty(fpinfo_i->hidden_subquery_rels))
+		return false;
+
 	/*
 	 * Merge FDW options.  We might be tempted to do this after we have deemed
 	 * the foreign join to be OK.  But we must do this beforehand so that we
@@ -3341,6 +5443,18 @@ sqlite_foreign_join_ok(PlannerInfo *root, RelOptInfo *joinrel, JoinType jointype
 		}
 	}
 
+	/*
+	 * The conditions which are not in the [NOT] EXISTS subquery can't refer
+	 * to the inner relation of a SEMI or ANTI join.  For a SEMI join all
+	 * conditions go to the subquery, so they all must be shippable.
+	 */
+	if (jointype == JOIN_SEMI && fpinfo->local_conds)
+		return false;
+	if (jointype == JOIN_ANTI &&
+		(sqlite_conds_refer_to_rels(fpinfo->remote_conds, innerrel->relids) ||
+		 sqlite_conds_refer_to_rels(fpinfo->local_conds, innerrel->relids)))
+		return false;
+
 	/*
 	 * sqlite_deparse_explicit_target_list() isn't smart enough to handle
 	 * anything other than a Var.  In particular, if there's some
@@ -3389,6 +5503,8 @@ sqlite_foreign_join_ok(PlannerInfo *root, RelOptInfo *joinrel, JoinType jointype
 	Assert(bms_is_subset(fpinfo_i->lower_subquery_rels, innerrel->relids));
 	fpinfo->lower_subquery_rels = bms_union(fpinfo_o->lower_subquery_rels,
 											fpinfo_i->lower_subquery_rels);
+	fpinfo->hidden_subquery_rels = bms_union(fpinfo_o->hidden_subquery_rels,
+											 fpinfo_i->hidden_subquery_rels);
 
 	/*
 	 * Pull the other remote conditions from the joining relations into join
@@ -3425,6 +5541,30 @@ sqlite_foreign_join_ok(PlannerInfo *root, RelOptInfo *joinrel, JoinType jointype
 											   fpinfo_o->remote_conds);
 			break;
 
+		case JOIN_SEMI:
+
+			/*
+			 * All clauses of a SEMI join and the clauses of the inner side
+			 * go to the EXISTS subquery.
+			 */
+			fpinfo->joinclauses = list_concat(fpinfo->joinclauses,
+											  fpinfo_i->remote_conds);
+			fpinfo->joinclauses = list_concat(fpinfo->joinclauses,
+											  fpinfo->remote_conds);
+			fpinfo->remote_conds = list_copy(fpinfo_o->remote_conds);
+			fpinfo->hidden_subquery_rels = bms_union(fpinfo->hidden_subquery_rels,
+													 innerrel->relids);
+			break;
+
+		case JOIN_ANTI:
+			fpinfo->joinclauses = list_concat(fpinfo->joinclauses,
+											  fpinfo_i->remote_conds);
+			fpinfo->remote_conds = list_concat(fpinfo->remote_conds,
+											   fpinfo_o->remote_conds);
+			fpinfo->hidden_subquery_rels = bms_union(fpinfo->hidden_subquery_rels,
+													 innerrel->relids);
+			break;
+
 		default:
 			/* Should not happen, we have just checked this above */
 			elog(ERROR, "unsupported join type %d", jointype);
@@ -3490,6 +5630,49 @@ sqlite_foreign_join_ok(PlannerInfo *root, RelOptInfo *joinrel, JoinType jointype
 	return true;
 }
 
+/*
+ * Check whether an expression refers to any of the given relations.
+ */
+static bool
+sqlite_refers_to_rels(Node *node, Relids relids)
+{
+	List	   *vars = pull_var_clause(node, PVC_RECURSE_PLACEHOLDERS);
+	ListCell   *lc;
+	bool		found = false;
+
+	foreach(lc, vars)
+	{
+		Var		   *var = (Var *) lfirst(lc);
+
+		if (bms_is_member(var->varno, relids))
+		{
+			found = true;
+			break;
+		}
+	}
+	list_free(vars);
+
+	return found;
+}
+
+/*
+ * Check whether any of a list of RestrictInfos refers to a relation in relids.
+ */
+static bool
+sqlite_conds_refer_to_rels(List *conds, Relids relids)
+{
+	ListCell   *lc;
+
+	foreach(lc, conds)
+	{
+		RestrictInfo *rinfo = lfirst_node(RestrictInfo, lc);
+
+		if (bms_overlap(rinfo->clause_relids, relids))
+			return true;
+	}
+	return false;
+}
+
 /*
  * Adjust the cost estimates of a foreign grouping path to include the cost
  * of generating properly-sorted output.
@@ -3745,6 +5928,7 @@ sqlite_merge_fdw_options(SqliteFdwRelationInfo * fpinfo,
 	fpinfo->shippable_extensions = fpinfo_o->shippable_extensions;
 	fpinfo->use_remote_estimate = fpinfo_o->use_remote_estimate;
 	fpinfo->fetch_size = fpinfo_o->fetch_size;
+	fpinfo->async_capable = fpinfo_o->async_capable;
 
 	/* Merge the table level options from either side of the join. */
 	if (fpinfo_i)
@@ -3766,6 +5950,13 @@ sqlite_merge_fdw_options(SqliteFdwRelationInfo * fpinfo,
 		 * relation sizes.
 		 */
 		fpinfo->fetch_size = Max(fpinfo_o->fetch_size, fpinfo_i->fetch_size);
+
+		/*
+		 * We'll prefer to consider this join async-capable if any table from
+		 * either side of the join is considered async-capable.
+		 */
+		fpinfo->async_capable = fpinfo_o->async_capable ||
+			fpinfo_i->async_capable;
 	}
 }
 
@@ -4574,8 +6765,11 @@ sqlite_estimate_path_cost_size(PlannerInfo *root,
 	 * number of rows selected by the restriction+join clauses. Otherwise,
 	 * estimate rows using whatever statistics we have locally, in a way
 	 * similar to ordinary tables.
+	 *
+	 * SQLite query plan doesn't estimate the number of groups, so grouping
+	 * is always costed locally using the remote estimates of its input.
 	 */
-	if (fpinfo->use_remote_estimate)
+	if (fpinfo->use_remote_estimate && !IS_UPPER_REL(foreignrel))
 	{
 		List	   *remote_param_join_conds;
 		List	   *local_param_join_conds;
@@ -4618,7 +6812,7 @@ sqlite_estimate_path_cost_size(PlannerInfo *root,
 		 * values, so don't request params_list.
 		 */
 		initStringInfo(&sql);
-		appendStringInfoString(&sql, "EXPLAIN ");
+		appendStringInfoString(&sql, "EXPLAIN QUERY PLAN ");
 		sqlite_deparse_select_stmt_for_rel(&sql, root, foreignrel, fdw_scan_tlist,
 										   remote_conds, pathkeys,
 										   fpextra ? fpextra->has_final_sort : false,
@@ -4628,9 +6822,17 @@ sqlite_estimate_path_cost_size(PlannerInfo *root,
 		/* Get the remote estimate */
 		conn = sqlite_get_connection(fpinfo->server, false);
 
-		sqlite_get_remote_estimate(sql.data, conn, &rows, &width,
+		sqlite_get_remote_estimate(sql.data, conn, root, foreignrel, &rows,
 								   &startup_cost, &total_cost);
 
+		/*
+		 * SQLite query plan doesn't account conditions which are not used by
+		 * indexes.  Use the local estimate of rows matching all remote
+		 * conditions if it is less.
+		 */
+		rows = Min(rows, clamp_row_est(foreignrel->rows / fpinfo->local_conds_sel));
+		width = foreignrel->reltarget->width;
+
 		retrieved_rows = rows;
 
 		/* Factor in the selectivity of the locally-checked quals */
@@ -4658,15 +6860,16 @@ sqlite_estimate_path_cost_size(PlannerInfo *root,
 		startup_cost += foreignrel->reltarget->cost.startup;
 		total_cost += foreignrel->reltarget->cost.startup;
 		total_cost += foreignrel->reltarget->cost.per_tuple * rows;
-		if (IS_UPPER_REL(foreignrel))
-		{
-			QualCost	tlist_cost;
 
-			cost_qual_eval(&tlist_cost, fdw_scan_tlist, root);
-			startup_cost -= tlist_cost.startup;
-			total_cost -= tlist_cost.startup;
-			total_cost -= tlist_cost.per_tuple * rows;
+#if PG_VERSION_NUM >= 120000
+		/* Adjust the cost estimates if we have LIMIT */
+		if (fpextra && fpextra->has_limit)
+		{
+			adjust_limit_rows_costs(&rows, &startup_cost, &total_cost,
+									fpextra->offset_est, fpextra->count_est);
+			retrieved_rows = rows;
 		}
+#endif
 	}
 	else
 	{
@@ -5287,7 +7490,6 @@ sqlite_execute_insert(EState *estate,
 	ListCell   *lc;
 	Datum		value = 0;
 	MemoryContext oldcontext;
-	int			rc = SQLITE_OK;
 	int			nestlevel;
 	int			bindnum = 0;
 	int			i;
@@ -5312,7 +7514,12 @@ sqlite_execute_insert(EState *estate,
 
 		fmstate->table = GetForeignTable(RelationGetRelid(fmstate->rel));
 		fmstate->server = GetForeignServer(fmstate->table->serverid);
+		sqlite_stat_store(fmstate->server, fmstate->stmt, fmstate->step_time,
+						  fmstate->rows_modified);
+		sqlite_release_stmt(fmstate->server, fmstate->stmt);
 		fmstate->stmt = NULL;
+		INSTR_TIME_SET_ZERO(fmstate->step_time);
+		fmstate->rows_modified = 0;
 
 		initStringInfo(&sql);
 		sqlite_rebuild_insert(&sql, fmstate->rel, fmstate->orig_query,
@@ -5322,15 +7529,15 @@ sqlite_execute_insert(EState *estate,
 		fmstate->num_slots = *numSlots;
 
 		sqlite_prepare_wrapper(fmstate->server, fmstate->conn, fmstate->query, &fmstate->stmt, NULL, true);
+		sqlite_stat_begin(fmstate->stmt);
 	}
 #endif
 
 	for (i = 0; i < *numSlots; i++)
 	{
-		foreach(lc, fmstate->retrieved_attrs)
+		foreach(lc, fmstate->target_attrs)
 		{
 			int			attnum = lfirst_int(lc) - 1;
-			Form_pg_attribute att = TupleDescAttr(slots[i]->tts_tupleDescriptor, attnum);
 			bool		isnull;
 #if PG_VERSION_NUM >= 140000
 			Form_pg_attribute attr = TupleDescAttr(tupdesc, attnum);
@@ -5341,22 +7548,23 @@ sqlite_execute_insert(EState *estate,
 #endif
 
 			value = slot_getattr(slots[i], attnum + 1, &isnull);
-			sqlite_bind_sql_var(att, bindnum, value, fmstate->stmt, &isnull, foreignTableId);
+			sqlite_bind_sql_var(&fmstate->column_binds[attnum], bindnum, value, fmstate->stmt, &isnull);
 			bindnum++;
-		}
-	}
-	sqlite_reset_transmission_modes(nestlevel);
-
-	/* Execute the query */
-	rc = sqlite3_step(fmstate->stmt);
-	if (rc != SQLITE_DONE)
-	{
-		sqlitefdw_report_error(ERROR, fmstate->stmt, fmstate->conn, NULL, rc);
+		}
 	}
-	sqlite3_reset(fmstate->stmt);
+	sqlite_reset_transmission_modes(nestlevel);
+
+	/*
+	 * The values are copied by SQLite when bound, so the row returned by
+	 * RETURNING can be stored outside of the temporary context.
+	 */
 	MemoryContextSwitchTo(oldcontext);
 	MemoryContextReset(fmstate->temp_cxt);
 
+	/* Execute the query, batches are never used with RETURNING */
+	if (sqlite_execute_foreign_modify(fmstate, slots[0]) == NULL)
+		return NULL;
+
 	return slots;
 }
 
@@ -5367,29 +7575,22 @@ static void
 sqlite_prepare_query_params(PlanState *node,
 							List *fdw_exprs,
 							int numParams,
-							FmgrInfo **param_flinfo,
 							List **param_exprs,
-							const char ***param_values,
-							Oid **param_types)
+							SqliteBindInfo **param_binds)
 {
 	int			i;
 	ListCell   *lc;
 
 	Assert(numParams > 0);
 
-	/* Prepare for output conversion of parameters used in remote query. */
-	*param_flinfo = (FmgrInfo *) palloc0(sizeof(FmgrInfo) * numParams);
-	*param_types = (Oid *) palloc0(sizeof(Oid) * numParams);
+	/* Prepare for binding of parameters used in remote query. */
+	*param_binds = (SqliteBindInfo *) palloc0(sizeof(SqliteBindInfo) * numParams);
 	i = 0;
 	foreach(lc, fdw_exprs)
 	{
 		Node	   *param_expr = (Node *) lfirst(lc);
-		Oid			typefnoid;
-		bool		isvarlena;
 
-		(*param_types)[i] = exprType(param_expr);
-		getTypeOutputInfo(exprType(param_expr), &typefnoid, &isvarlena);
-		fmgr_info(typefnoid, &(*param_flinfo)[i]);
+		sqlite_init_bind_info(&(*param_binds)[i], exprType(param_expr), NULL, InvalidOid);
 		i++;
 	}
 
@@ -5406,23 +7607,18 @@ sqlite_prepare_query_params(PlanState *node,
 #else
 	*param_exprs = (List *) ExecInitExpr((Expr *) fdw_exprs, node);
 #endif
-	/* Allocate buffer for text form of query parameters. */
-	*param_values = (const char **) palloc0(numParams * sizeof(char *));
 }
 
 /*
- * Construct array of query parameter values and bind parameters
- *
+ * Evaluate query parameters and bind them.  If key is not NULL, the values
+ * are also appended to it for the lookup cache of a scan.
  */
 static void
 sqlite_process_query_params(ExprContext *econtext,
-							FmgrInfo *param_flinfo,
 							List *param_exprs,
-							const char **param_values,
 							sqlite3_stmt * *stmt,
-							Oid *param_types,
-							Oid foreignTableId
-							)
+							SqliteBindInfo *param_binds,
+							StringInfo key)
 {
 	int			i;
 	ListCell   *lc;
@@ -5435,8 +7631,6 @@ sqlite_process_query_params(ExprContext *econtext,
 		ExprState  *expr_state = (ExprState *) lfirst(lc);
 		Datum		expr_value;
 		bool		isNull;
-		/* fake structure, bind function usually works with attribute, but just typid in our case */
-		Form_pg_attribute att = NULL;
 
 		/* Evaluate the parameter expression */
 #if PG_VERSION_NUM >= 100000
@@ -5444,20 +7638,11 @@ sqlite_process_query_params(ExprContext *econtext,
 #else
 		expr_value = ExecEvalExpr(expr_state, econtext, &isNull, NULL);
 #endif
+		if (key != NULL)
+			sqlite_append_lookup_key(key, &param_binds[i], expr_value, isNull);
+
 		/* Bind parameters */
-		att = palloc(sizeof(FormData_pg_attribute));
-		att->atttypid = param_types[i];
-		att->atttypmod = -1;
-		sqlite_bind_sql_var(att, i, expr_value, *stmt, &isNull, foreignTableId);
-		pfree(att);
-		/*
-		 * Get string sentation of each parameter value by invoking
-		 * type-specific output function, unless the value is null.
-		 */
-		if (isNull)
-			param_values[i] = NULL;
-		else
-			param_values[i] = OutputFunctionCall(&param_flinfo[i], expr_value);
+		sqlite_bind_sql_var(&param_binds[i], i, expr_value, *stmt, &isNull);
 		i++;
 	}
 	sqlite_reset_transmission_modes(nestlevel);
@@ -5472,35 +7657,364 @@ sqlite_create_cursor(ForeignScanState *node)
 	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
 	ExprContext *econtext = node->ss.ps.ps_ExprContext;
 	int			numParams = festate->numParams;
-	const char **values = festate->param_values;
 
 	/*
-	 * Construct array of query parameter values in text format.  We do the
-	 * conversions in the short-lived per-tuple context, so as not to cause a
-	 * memory leak over repeated scans.
+	 * Bind the values of query parameters.  We evaluate them in the
+	 * short-lived per-tuple context, so as not to cause a memory leak over
+	 * repeated scans.
 	 */
 	if (numParams > 0)
 	{
-		Oid			foreignTableId = (festate->rel != NULL) ? RelationGetRelid(festate->rel) : 0;
 		MemoryContext oldcontext;
+		StringInfoData key;
 
 		oldcontext = MemoryContextSwitchTo(econtext->ecxt_per_tuple_memory);
 
+		if (festate->lookup_cache != NULL)
+			initStringInfo(&key);
 		sqlite_process_query_params(econtext,
-									festate->param_flinfo,
 									festate->param_exprs,
-									values,
 									&festate->stmt,
-									festate->param_types,
-									foreignTableId);
+									festate->param_binds,
+									festate->lookup_cache != NULL ? &key : NULL);
 
 		MemoryContextSwitchTo(oldcontext);
+
+		/* Rows of the same values may have been fetched by an earlier scan */
+		if (festate->lookup_cache != NULL && sqlite_lookup_begin(festate, &key))
+		{
+			festate->cursor_exists = true;
+			return;
+		}
+	}
+
+	/*
+	 * Parallel scan starts with the first rowid range it can claim.  If no
+	 * workers could be launched, there is no shared state and the leader
+	 * scans the whole rowid space at once.
+	 */
+	if (festate->pscan != NULL)
+		(void) sqlite_next_rowid_range(festate);
+	else if (node->ss.ps.plan->parallel_aware)
+	{
+		int			rc;
+
+		rc = sqlite3_bind_int64(festate->stmt, numParams + 1, PG_INT64_MIN);
+		if (rc == SQLITE_OK)
+			rc = sqlite3_bind_int64(festate->stmt, numParams + 2, PG_INT64_MAX);
+		if (rc != SQLITE_OK)
+			sqlitefdw_report_error(ERROR, festate->stmt, festate->conn, NULL, rc);
 	}
 
 	/* Mark the cursor as created, and show no tuples have been retrieved */
 	festate->cursor_exists = true;
 }
 
+/*
+ * Append the value of a query parameter to the key of the lookup cache.
+ * Values are compared in binary, which is enough to find the rows of the
+ * same values again; equal values in different representations only miss.
+ */
+static void
+sqlite_append_lookup_key(StringInfo key, SqliteBindInfo *bind, Datum value,
+						 bool isnull)
+{
+	appendStringInfoChar(key, isnull ? 'n' : 'v');
+	if (isnull)
+		return;
+
+	if (bind->typbyval)
+		appendBinaryStringInfo(key, (char *) &value, sizeof(Datum));
+	else if (bind->typlen == -1)
+	{
+		struct varlena *v = PG_DETOAST_DATUM_PACKED(value);
+		int32		len = VARSIZE_ANY_EXHDR(v);
+
+		appendBinaryStringInfo(key, (char *) &len, sizeof(len));
+		appendBinaryStringInfo(key, VARDATA_ANY(v), len);
+	}
+	else if (bind->typlen == -2)
+		appendBinaryStringInfo(key, DatumGetCString(value),
+							   strlen(DatumGetCString(value)) + 1);
+	else
+		appendBinaryStringInfo(key, DatumGetPointer(value), bind->typlen);
+}
+
+/*
+ * Start caching the rows of a parameterized scan which is rescanned, like the
+ * inner side of a nested loop or a correlated subquery.  Each set of
+ * parameter values is then looked up in SQLite only once; the rows of a
+ * repeated set are returned from the cache.  Scans for update, parallel and
+ * asynchronous scans are not cached, nor are the scans which the planner
+ * leaves to Memoize, see sqliteGetForeignPlan.
+ */
+static void
+sqlite_lookup_init(ForeignScanState *node)
+{
+	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
+	HASHCTL		ctl;
+
+	if (festate->numParams == 0 || festate->lookup_cache != NULL ||
+		festate->lookup_disabled || festate->for_update ||
+		festate->snapshot_scan || festate->async_capable ||
+		node->ss.ps.plan->parallel_aware)
+		return;
+
+	festate->lookup_cxt = AllocSetContextCreate(node->ss.ps.state->es_query_cxt,
+												"sqlite_fdw lookup cache",
+												ALLOCSET_DEFAULT_SIZES);
+
+	MemSet(&ctl, 0, sizeof(ctl));
+	ctl.keysize = sizeof(SqliteLookupKey);
+	ctl.entrysize = sizeof(SqliteLookupEntry);
+	ctl.hash = sqlite_lookup_hash;
+	ctl.match = sqlite_lookup_match;
+	ctl.hcxt = festate->lookup_cxt;
+	festate->lookup_cache = hash_create("sqlite_fdw lookup cache", 256, &ctl,
+										HASH_ELEM | HASH_FUNCTION | HASH_COMPARE | HASH_CONTEXT);
+}
+
+/*
+ * Look up the rows of the parameter values in key.  Returns true if they
+ * are cached, then the scan returns them instead of executing the statement.
+ * Otherwise the scan adds the rows it fetches to a new entry, unless the
+ * cache has no room for it.
+ */
+static bool
+sqlite_lookup_begin(SqliteFdwExecState * festate, StringInfo key)
+{
+	SqliteLookupKey lookup_key;
+	SqliteLookupEntry *entry;
+	char	   *data;
+	bool		found;
+
+	lookup_key.len = key->len;
+	lookup_key.data = key->data;
+
+	entry = (SqliteLookupEntry *) hash_search(festate->lookup_cache, &lookup_key,
+											  HASH_FIND, NULL);
+	if (entry != NULL)
+	{
+		Assert(entry->complete);
+		festate->lookup_entry = entry;
+		festate->lookup_filling = false;
+		festate->lookup_pos = 0;
+		festate->lookup_hits++;
+		return true;
+	}
+
+	/* Keys are all different, the cache only costs time and memory */
+	if (++festate->lookup_misses >= SQLITE_LOOKUP_MIN_MISSES &&
+		festate->lookup_hits == 0)
+	{
+		elog(DEBUG1, "sqlite_fdw : no repeated parameter values, lookup cache is disabled");
+		sqlite_lookup_end(festate);
+		festate->lookup_disabled = true;
+		return false;
+	}
+
+	if (festate->lookup_disabled ||
+		festate->lookup_mem + key->len > (Size) work_mem * 1024L)
+		return false;
+
+	data = MemoryContextAlloc(festate->lookup_cxt, key->len);
+	memcpy(data, key->data, key->len);
+	entry = (SqliteLookupEntry *) hash_search(festate->lookup_cache, &lookup_key,
+											  HASH_ENTER, &found);
+	Assert(!found);
+	/* The key must not point to the short-lived copy of the values */
+	entry->key.data = data;
+	entry->rows = NULL;
+	entry->nrows = 0;
+	entry->maxrows = 0;
+	entry->complete = false;
+	festate->lookup_mem += key->len;
+
+	festate->lookup_entry = entry;
+	festate->lookup_filling = true;
+	return false;
+}
+
+/*
+ * Add a row fetched by the scan to the entry being filled.  If the cache
+ * outgrows work_mem, the entry is dropped and no more entries are added.
+ */
+static void
+sqlite_lookup_add_row(SqliteFdwExecState * festate, TupleTableSlot *slot)
+{
+	SqliteLookupEntry *entry = festate->lookup_entry;
+	MemoryContext oldcontext;
+	HeapTuple	tuple;
+
+	oldcontext = MemoryContextSwitchTo(festate->lookup_cxt);
+	if (entry->nrows == entry->maxrows)
+	{
+		entry->maxrows = Max(entry->maxrows * 2, 4);
+		if (entry->rows == NULL)
+			entry->rows = palloc(sizeof(HeapTuple) * entry->maxrows);
+		else
+			entry->rows = repalloc(entry->rows, sizeof(HeapTuple) * entry->maxrows);
+	}
+	tuple = heap_form_tuple(slot->tts_tupleDescriptor, slot->tts_values,
+							slot->tts_isnull);
+	tuple->t_self = slot->tts_tid;
+	entry->rows[entry->nrows++] = tuple;
+	MemoryContextSwitchTo(oldcontext);
+
+	festate->lookup_mem += GetMemoryChunkSpace(tuple);
+	if (festate->lookup_mem > (Size) work_mem * 1024L)
+	{
+		sqlite_lookup_discard(festate);
+		festate->lookup_disabled = true;
+	}
+}
+
+/*
+ * Drop the entry being filled, when the scan doesn't fetch all of its rows.
+ */
+static void
+sqlite_lookup_discard(SqliteFdwExecState * festate)
+{
+	SqliteLookupEntry *entry = festate->lookup_entry;
+	SqliteLookupKey lookup_key = entry->key;
+	int			i;
+
+	Assert(festate->lookup_filling);
+
+	for (i = 0; i < entry->nrows; i++)
+	{
+		festate->lookup_mem -= GetMemoryChunkSpace(entry->rows[i]);
+		heap_freetuple(entry->rows[i]);
+	}
+	if (entry->rows != NULL)
+		pfree(entry->rows);
+	festate->lookup_mem -= lookup_key.len;
+
+	hash_search(festate->lookup_cache, &lookup_key, HASH_REMOVE, NULL);
+	pfree((char *) lookup_key.data);
+
+	festate->lookup_entry = NULL;
+	festate->lookup_filling = false;
+}
+
+/*
+ * Release the lookup cache of a scan.
+ */
+static void
+sqlite_lookup_end(SqliteFdwExecState * festate)
+{
+	if (festate->lookup_cxt == NULL)
+		return;
+
+	MemoryContextDelete(festate->lookup_cxt);
+	festate->lookup_cxt = NULL;
+	festate->lookup_cache = NULL;
+	festate->lookup_entry = NULL;
+	festate->lookup_filling = false;
+	festate->lookup_mem = 0;
+}
+
+static uint32
+sqlite_lookup_hash(const void *key, Size keysize)
+{
+	const SqliteLookupKey *k = (const SqliteLookupKey *) key;
+
+	return tag_hash(k->data, k->len);
+}
+
+static int
+sqlite_lookup_match(const void *key1, const void *key2, Size keysize)
+{
+	const SqliteLookupKey *k1 = (const SqliteLookupKey *) key1;
+	const SqliteLookupKey *k2 = (const SqliteLookupKey *) key2;
+
+	if (k1->len != k2->len)
+		return 1;
+	return memcmp(k1->data, k2->data, k1->len);
+}
+
+/*
+ * Fetch all rows of a scan which is the target of UPDATE or DELETE into a
+ * tuplestore, which spills to a temporary file beyond work_mem.  The SQLite
+ * rowid, if fetched, is stored as an additional last column.
+ */
+static void
+sqlite_materialize_scan(ForeignScanState *node)
+{
+	SqliteFdwExecState *festate = (SqliteFdwExecState *) node->fdw_state;
+	EState	   *estate = node->ss.ps.state;
+	TupleDesc	tupdesc = node->ss.ss_ScanTupleSlot->tts_tupleDescriptor;
+	TupleDesc	rows_tupdesc;
+	int			natts = tupdesc->natts;
+	Datum	   *values;
+	bool	   *nulls;
+	MemoryContext oldcontext;
+	int			rc;
+
+	oldcontext = MemoryContextSwitchTo(estate->es_query_cxt);
+
+	if (festate->rows_slot == NULL)
+	{
+		int			i;
+
+		rows_tupdesc = CreateTemplateTupleDesc(natts + 1);
+		for (i = 1; i <= natts; i++)
+			TupleDescCopyEntry(rows_tupdesc, i, tupdesc, i);
+		TupleDescInitEntry(rows_tupdesc, natts + 1, "rowid", INT8OID, -1, 0);
+		festate->rows_slot = MakeSingleTupleTableSlot(rows_tupdesc,
+													  &TTSOpsMinimalTuple);
+		festate->temp_cxt = AllocSetContextCreate(estate->es_query_cxt,
+												  "sqlite_fdw temporary data",
+												  ALLOCSET_SMALL_SIZES);
+	}
+	rows_tupdesc = festate->rows_slot->tts_tupleDescriptor;
+
+	festate->rows = tuplestore_begin_heap(false, false, work_mem);
+	values = (Datum *) palloc(sizeof(Datum) * (natts + 1));
+	nulls = (bool *) palloc(sizeof(bool) * (natts + 1));
+
+	/* Values converted from a row are needed only until it is stored */
+	MemoryContextSwitchTo(festate->temp_cxt);
+
+	for (;;)
+	{
+		ItemPointerData ctid;
+		instr_time	start;
+
+		sqlite_timer_start(festate, &start);
+		rc = sqlite3_step(festate->stmt);
+		sqlite_timer_stop(festate, &festate->step_time, &start);
+		if (rc != SQLITE_ROW)
+			break;
+
+		ItemPointerSetInvalid(&ctid);
+		sqlite_timer_start(festate, &start);
+		make_tuple_from_result_row(festate->stmt, NULL,
+								   tupdesc, festate->retrieved_attrs,
+								   values, nulls, &ctid,
+								   festate->rel,
+								   festate->attinmeta,
+								   festate->converters,
+								   node);
+		sqlite_timer_stop(festate, &festate->convert_time, &start);
+		nulls[natts] = !BlockNumberIsValid(ItemPointerGetBlockNumberNoCheck(&ctid));
+		values[natts] = nulls[natts] ? (Datum) 0 :
+			Int64GetDatum(sqlite_tid_to_rowid(&ctid));
+
+		tuplestore_putvalues(festate->rows, rows_tupdesc, values, nulls);
+		MemoryContextReset(festate->temp_cxt);
+		festate->rows_fetched++;
+		if (festate->conn_stats)
+			festate->conn_stats->rows_fetched++;
+	}
+	if (rc != SQLITE_DONE)
+		sqlitefdw_report_error(ERROR, festate->stmt, festate->conn, NULL, rc);
+
+	MemoryContextSwitchTo(oldcontext);
+	pfree(values);
+	pfree(nulls);
+}
+
 /*
  * Execute a direct UPDATE/DELETE statement.
  */
@@ -5510,21 +8024,19 @@ sqlite_execute_dml_stmt(ForeignScanState *node)
 	SqliteFdwDirectModifyState *dmstate = (SqliteFdwDirectModifyState *) node->fdw_state;
 	ExprContext *econtext = node->ss.ps.ps_ExprContext;
 	int			numParams = dmstate->numParams;
-	const char **values = dmstate->param_values;
-	Oid			foreignTableId = RelationGetRelid(dmstate->rel);
+	instr_time	start;
+	instr_time	end;
 	int			rc;
 
 	/*
-	 * Construct array of query parameter values in text format.
+	 * Bind the values of query parameters.
 	 */
 	if (numParams > 0)
 		sqlite_process_query_params(econtext,
-									dmstate->param_flinfo,
 									dmstate->param_exprs,
-									values,
 									&dmstate->stmt,
-									dmstate->param_types,
-									foreignTableId);
+									dmstate->param_binds,
+									NULL);
 
 	/*
 	 * Notice that we pass NULL for paramTypes, thus forcing the remote server
@@ -5533,7 +8045,24 @@ sqlite_execute_dml_stmt(ForeignScanState *node)
 	 * the desired result.  This allows us to avoid assuming that the remote
 	 * server has the same OIDs we do for the parameters' types.
 	 */
+	INSTR_TIME_SET_CURRENT(start);
 	rc = sqlite3_step(dmstate->stmt);
+	INSTR_TIME_SET_CURRENT(end);
+	INSTR_TIME_ACCUM_DIFF(dmstate->step_time, end, start);
+
+	/*
+	 * SQLite makes all the changes in the first step, the rows of RETURNING
+	 * are fetched one at a time by sqlite_get_returning_data.
+	 */
+	if (dmstate->has_returning)
+	{
+		if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+			sqlitefdw_report_error(ERROR, dmstate->stmt, dmstate->conn, NULL, rc);
+		dmstate->num_tuples = 0;
+		dmstate->eof_reached = (rc == SQLITE_DONE);
+		return;
+	}
+
 	if (rc != SQLITE_DONE)
 	{
 		sqlitefdw_report_error(ERROR, dmstate->stmt, dmstate->conn, NULL, rc);
@@ -5543,6 +8072,63 @@ sqlite_execute_dml_stmt(ForeignScanState *node)
 	dmstate->num_tuples = sqlite3_changes(dmstate->conn);
 }
 
+/*
+ * Get the result of a RETURNING clause.
+ */
+static TupleTableSlot *
+sqlite_get_returning_data(ForeignScanState *node)
+{
+	SqliteFdwDirectModifyState *dmstate = (SqliteFdwDirectModifyState *) node->fdw_state;
+	EState	   *estate = node->ss.ps.state;
+	TupleTableSlot *slot = node->ss.ss_ScanTupleSlot;
+
+	if (!dmstate->has_returning)
+	{
+		/*
+		 * RETURNING needs no column of the foreign table, so return one empty
+		 * tuple per modified row.
+		 */
+		if (dmstate->next_tuple >= dmstate->num_tuples)
+			return ExecClearTuple(slot);
+		dmstate->next_tuple++;
+		ExecStoreAllNullTuple(slot);
+	}
+	else
+	{
+		int			rc;
+
+		/* All the rows of RETURNING have been returned */
+		if (dmstate->eof_reached)
+			return ExecClearTuple(slot);
+
+		ExecClearTuple(slot);
+		make_tuple_from_result_row(dmstate->stmt, NULL,
+								   slot->tts_tupleDescriptor,
+								   dmstate->retrieved_attrs,
+								   slot->tts_values,
+								   slot->tts_isnull,
+								   &slot->tts_tid,
+								   dmstate->rel,
+								   dmstate->attinmeta,
+								   dmstate->converters,
+								   node);
+		ExecStoreVirtualTuple(slot);
+		dmstate->num_tuples++;
+
+		/* Step to the next row, which is already computed by SQLite */
+		rc = sqlite3_step(dmstate->stmt);
+		if (rc != SQLITE_ROW && rc != SQLITE_DONE)
+			sqlitefdw_report_error(ERROR, dmstate->stmt, dmstate->conn, NULL, rc);
+		dmstate->eof_reached = (rc == SQLITE_DONE);
+	}
+
+	/* Increment the command es_processed count if necessary. */
+	if (dmstate->set_processed)
+		estate->es_processed += 1;
+
+	return slot;
+}
+
 /*
  * Given an EquivalenceClass and a foreign relation, find an EC member
  * that can be used to sort the relation remotely according to a pathkey
@@ -5649,7 +8235,6 @@ sqlite_find_em_for_rel_target(PlannerInfo *root, EquivalenceClass *ec,
 	return NULL;
 }
 
-#if PG_VERSION_NUM >= 140000
 /*
  * Determine batch size for a given foreign table. The option specified for
  * a table has precedence.
@@ -5691,7 +8276,162 @@ sqlite_get_batch_size_option(Relation rel)
 
 	return batch_size;
 }
-#endif
+
+/*
+ * Remember the key values of a row to be deleted by the next batch.
+ */
+static void
+sqlite_buffer_delete_keys(SqliteFdwExecState * fmstate, TupleTableSlot *planSlot)
+{
+	TupleDesc	tupdesc = RelationGetDescr(fmstate->rel);
+	int			idx = fmstate->num_pending * list_length(fmstate->key_attrs);
+	MemoryContext oldcontext;
+	ListCell   *lc;
+
+	oldcontext = MemoryContextSwitchTo(fmstate->batch_cxt);
+	foreach(lc, fmstate->key_attrs)
+	{
+		int			attnum = lfirst_int(lc);
+		bool		is_null;
+		Datum		value;
+
+		/* Get the id that was passed up as a resjunk column */
+		value = sqlite_get_junk_key_value(fmstate, planSlot, attnum, &is_null);
+		if (is_null)
+			value = (Datum) 0;
+		else if (attnum == SelfItemPointerAttributeNumber)
+			value = datumCopy(value, FLOAT8PASSBYVAL, sizeof(int64));
+		else
+		{
+			Form_pg_attribute attr = TupleDescAttr(tupdesc, attnum - 1);
+
+			value = datumCopy(value, attr->attbyval, attr->attlen);
+		}
+		fmstate->pending_values[idx] = value;
+		fmstate->pending_nulls[idx] = is_null;
+		idx++;
+	}
+	fmstate->num_pending++;
+	MemoryContextSwitchTo(oldcontext);
+}
+
+/*
+ * Delete the rows whose keys have been collected by
+ * sqlite_buffer_delete_keys.  The statement for a full batch is prepared
+ * once, only the last batch needs its own statement.
+ */
+static void
+sqlite_execute_batch_delete(SqliteFdwExecState * fmstate)
+{
+	sqlite3_stmt *stmt = NULL;
+	MemoryContext oldcontext;
+	instr_time	start;
+	instr_time	step_time;
+	int			bindnum = 0;
+	int			i;
+	int			rc;
+
+	elog(DEBUG1, "sqlite_fdw : %s %d rows", __func__, fmstate->num_pending);
+
+	if (fmstate->num_pending == fmstate->delete_batch_size)
+		stmt = fmstate->batch_stmt;
+	if (stmt == NULL)
+	{
+		StringInfoData sql;
+
+		initStringInfo(&sql);
+		sqlite_deparse_batch_delete(&sql, fmstate->rel, fmstate->key_attrs,
+									fmstate->num_pending);
+		sqlite_prepare_wrapper(fmstate->server, fmstate->conn, sql.data, &stmt, NULL, true);
+		sqlite_stat_begin(stmt);
+		if (fmstate->num_pending == fmstate->delete_batch_size)
+			fmstate->batch_stmt = stmt;
+	}
+
+	oldcontext = MemoryContextSwitchTo(fmstate->temp_cxt);
+	for (i = 0; i < fmstate->num_pending; i++)
+	{
+		ListCell   *lc;
+
+		foreach(lc, fmstate->key_attrs)
+		{
+			int			attnum = lfirst_int(lc);
+
+			sqlite_bind_sql_var(sqlite_key_bind_info(fmstate, attnum), bindnum,
+								fmstate->pending_values[bindnum], stmt,
+								&fmstate->pending_nulls[bindnum]);
+			bindnum++;
+		}
+	}
+
+	/* Execute the query */
+	INSTR_TIME_SET_ZERO(step_time);
+	sqlite_timer_start(fmstate, &start);
+	rc = sqlite3_step(stmt);
+	sqlite_timer_stop(fmstate, &step_time, &start);
+	if (rc != SQLITE_DONE)
+		sqlitefdw_report_error(ERROR, stmt, fmstate->conn, NULL, rc);
+	sqlite3_reset(stmt);
+
+	/* The statement for the last, smaller batch is used once */
+	if (stmt != fmstate->batch_stmt)
+	{
+		sqlite_stat_store(fmstate->server, stmt, step_time,
+						  sqlite3_changes(fmstate->conn));
+		sqlite_release_stmt(fmstate->server, stmt);
+	}
+	else
+	{
+		INSTR_TIME_ADD(fmstate->batch_time, step_time);
+		fmstate->batch_rows += sqlite3_changes(fmstate->conn);
+	}
+
+	MemoryContextSwitchTo(oldcontext);
+	MemoryContextReset(fmstate->temp_cxt);
+	MemoryContextReset(fmstate->batch_cxt);
+	fmstate->num_pending = 0;
+}
+
+/*
+ * Determine the number of parallel workers for a given foreign table.  The
+ * option specified for a table has precedence.
+ */
+static int
+sqlite_get_parallel_workers_option(Oid foreigntableid)
+{
+	ForeignTable *table;
+	ForeignServer *server;
+	List	   *options;
+	ListCell   *lc;
+
+	/* we use 0 by default, which means "no parallel scan" */
+	int			parallel_workers = 0;
+
+	/*
+	 * Load options for table and server. We append server options after table
+	 * options, because table options take precedence.
+	 */
+	table = GetForeignTable(foreigntableid);
+	server = GetForeignServer(table->serverid);
+
+	options = NIL;
+	options = list_concat(options, table->options);
+	options = list_concat(options, server->options);
+
+	/* See if either table or server specifies parallel_workers. */
+	foreach(lc, options)
+	{
+		DefElem	*def = (DefElem *) lfirst(lc);
+
+		if (strcmp(def->defname, "parallel_workers") == 0)
+		{
+			(void) parse_int(defGetString(def), &parallel_workers, 0, NULL);
+			break;
+		}
+	}
+
+	return parallel_workers;
+}
 
 /*
  * sqliteIsForeignRelUpdatable
@@ -29,7 +29,11 @@
 #include "fmgr.h"
 #include "foreign/foreign.h"
 #include "lib/stringinfo.h"
+#include "port/atomics.h"
+#include "portability/instr_time.h"
+#include "utils/hsearch.h"
 #include "utils/rel.h"
+#include "utils/tuplestore.h"
 #include "funcapi.h"
 
 #define SQLITE_PREFETCH_ROWS	100
@@ -122,6 +126,58 @@ typedef struct SqliteFdwPathExtraData
 }			SqliteFdwPathExtraData;
 
 
+/*
+ * Shared state of a parallel foreign scan, stored in dynamic shared memory.
+ * The rowid space of the foreign table is split into chunks of equal size,
+ * which are handed out to the participants one by one.
+ */
+typedef struct SqliteFdwParallelScanState
+{
+	pg_atomic_uint64 next_chunk;	/* index of the next chunk to scan */
+	uint64		nchunks;		/* number of chunks */
+	uint64		chunk_size;		/* number of rowids in a chunk */
+	int64		min_rowid;		/* smallest rowid of the foreign table */
+	int64		max_rowid;		/* largest rowid of the foreign table */
+	bool		leader_only;	/* only the leader can see all the rows */
+}			SqliteFdwParallelScanState;
+
+/* Converter of non-NULL SQLite values for one column, see sqlite_query.c */
+typedef NullableDatum (*SqliteValueConverter) (Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags);
+
+/*
+ * Information for binding values of a foreign table column or of a query
+ * parameter, collected once per statement by sqlite_init_bind_info
+ */
+typedef struct SqliteBindInfo
+{
+	Oid			type;			/* PostgreSQL data type of the values */
+	int32		typmod;			/* its type modifier */
+	Form_pg_attribute att;		/* column, NULL for a query parameter */
+	int16		typlen;			/* length of the data type */
+	bool		typbyval;		/* is it passed by value? */
+	FmgrInfo	outfunc;		/* output function, if the value is bound as text */
+	bool		uuid_as_blob;	/* uuid is bound as BLOB, not as text */
+	bool		is_postgis;		/* PostGIS data type supported by SpatiaLite */
+}			SqliteBindInfo;
+
+/* Background row fetcher of an asynchronous foreign scan, see sqlite_async.c */
+typedef struct SqliteAsyncFetcher SqliteAsyncFetcher;
+
+/* Rows fetched by a parameterized scan for one set of parameter values */
+typedef struct SqliteLookupEntry SqliteLookupEntry;
+
+/*
+ * Counters of the FDW for a connection to a foreign server since it was
+ * opened, see sqlite_fdw_connection_stats()
+ */
+typedef struct SqliteConnStats
+{
+	uint64		rows_fetched;	/* rows returned by foreign scans */
+	uint64		stmts_prepared;	/* statements prepared by SQLite */
+	pg_atomic_uint64 busy_retries;	/* waits for a lock of another
+									 * connection */
+}			SqliteConnStats;
+
 /*
  * FDW-specific information for ForeignScanState
  * fdw_state.
@@ -136,20 +192,29 @@ typedef struct SQLiteFdwExecState
 	Relation	rel;			/* relcache entry for the foreign table */
 	TupleDesc	tupdesc;		/* tuple descriptor of scan */
 	AttInMetadata *attinmeta;	/* attribute datatype conversion */
-	List	   *retrieved_attrs;	/* list of target attribute numbers */
+	SqliteValueConverter *converters;	/* converters of result columns */
+	List	   *retrieved_attrs;	/* attr numbers retrieved by SELECT or
+									 * RETURNING */
+	bool		has_returning;	/* is there a RETURNING clause? */
 
 	bool		cursor_exists;	/* have we created the cursor? */
 	int			numParams;		/* number of parameters passed to query */
-	FmgrInfo   *param_flinfo;	/* output conversion functions for them */
 	List	   *param_exprs;	/* executable expressions for param values */
-	const char **param_values;	/* textual values of query parameters */
-	Oid		   *param_types;	/* type of query parameters */
+	SqliteBindInfo *param_binds;	/* bind information of query parameters */
 
 	int			p_nums;			/* number of parameters to transmit */
-	FmgrInfo   *p_flinfo;		/* output conversion functions for them */
+	SqliteBindInfo *column_binds;	/* bind information of columns, by attnum */
 
 	/* batch operation stuff */
 	int			num_slots;		/* number of slots to insert */
+	int			delete_batch_size;	/* rows deleted at once, 0 if no batching */
+	int			num_pending;	/* number of rows collected for DELETE */
+	Datum	   *pending_values;	/* their key values */
+	bool	   *pending_nulls;	/* null flags of the key values */
+	sqlite3_stmt *batch_stmt;	/* DELETE of delete_batch_size rows */
+	instr_time	batch_time;		/* time spent in sqlite3_step() of it */
+	uint64		batch_rows;		/* rows deleted by it */
+	MemoryContext batch_cxt;	/* context for the collected key values */
 
 	char	   *orig_query;		/* original text of INSERT command */
 	List	   *target_attrs;	/* list of target attribute numbers */
@@ -160,16 +225,49 @@ typedef struct SQLiteFdwExecState
 	List	   *attr_list;		/* query attribute list */
 	List	   *column_list;	/* Column list of SQLite Column structures */
 
-	int64		row_nums;		/* number of rows */
-	Datum	  **rows;			/* all rows of scan */
-	int64		rowidx;			/* current index of rows */
-	bool	  **rows_isnull;	/* is null */
+	Tuplestorestate *rows;		/* all rows of scan, if for_update */
+	TupleTableSlot *rows_slot;	/* slot to read them, rowid is the last
+								 * column */
 	bool		for_update;		/* true if this scan is update target */
+	bool		snapshot_scan;	/* reading through the snapshot connection */
+	SqliteConnStats *conn_stats;	/* counters of the connection */
 	int			batch_size;		/* value of FDW option "batch_size" */
 
+	/* parallel scan stuff */
+	SqliteFdwParallelScanState *pscan;	/* shared state, NULL if not parallel */
+	bool		pscan_exhausted;	/* no more chunks for this participant */
+
+	/* asynchronous scan stuff */
+	bool		async_capable;	/* true if executed by an async Append */
+	SqliteAsyncFetcher *fetcher;	/* background row fetcher, if started */
+	bool		eof_reached;	/* true if the fetcher returned all rows */
+
+	/* cache of the rows of a parameterized scan, see sqlite_create_cursor */
+	HTAB	   *lookup_cache;	/* rows by parameter values, or NULL */
+	MemoryContext lookup_cxt;	/* context of the cache and its rows */
+	Size		lookup_mem;		/* memory used by the cached rows */
+	SqliteLookupEntry *lookup_entry;	/* entry being filled or returned */
+	bool		lookup_filling; /* true if the scan fills lookup_entry */
+	int			lookup_pos;		/* next cached row to return */
+	bool		lookup_disabled;	/* caching was given up for this scan */
+	uint64		lookup_misses;	/* scans which executed the statement */
+	uint64		lookup_hits;	/* scans which returned cached rows */
+
+	/* EXPLAIN ANALYZE and statement statistics stuff */
+	bool		instrument;		/* collect statistics of the scan */
+	bool		instrument_timer;	/* measure time of the statement */
+	uint64		rows_fetched;	/* rows fetched from SQLite */
+	uint64		rows_modified;	/* rows modified by the statement */
+	instr_time	step_time;		/* time spent in sqlite3_step() */
+	instr_time	convert_time;	/* time spent converting fetched rows */
+	int			cache_miss_start;	/* page cache misses before the scan */
+
 	/* working memory context */
 	MemoryContext temp_cxt;		/* context for per-tuple temporary data */
 	AttrNumber *junk_idx;
+	List	   *key_attrs;		/* attnums of key columns with junk values */
+	AttrNumber	rowid_junk_idx;	/* junk ctid carrying the SQLite rowid */
+	SqliteBindInfo rowid_bind;	/* bind information of the rowid */
 
 }			SqliteFdwExecState;
 
@@ -201,6 +299,9 @@ typedef struct SqliteFdwRelationInfo
 
 	/* Options extracted from catalogs. */
 	bool		use_remote_estimate;
+	double		estimated_rows; /* estimated_rows option, or -1 */
+	int			parallel_workers;	/* 0 means no parallel scan */
+	bool		async_capable;
 	Cost		fdw_startup_cost;
 	Cost		fdw_tuple_cost;
 	List	   *shippable_extensions;	/* OIDs of whitelisted extensions */
@@ -208,6 +309,9 @@ typedef struct SqliteFdwRelationInfo
 	/* Bitmap of attr numbers we need to fetch from the remote server. */
 	Bitmapset  *attrs_used;
 
+	/* True if the SQLite rowid identifies rows of UPDATE/DELETE as ctid */
+	bool		rowid_identity;
+
 	/* True means that the query_pathkeys is safe to push down */
 	bool		qp_is_pushdown_safe;
 
@@ -251,6 +355,10 @@ typedef struct SqliteFdwRelationInfo
 										 * subquery? */
 	Relids		lower_subquery_rels;	/* all relids appearing in lower
 										 * subqueries */
+	Relids		hidden_subquery_rels;	/* relids of the inner relations of
+										 * semi-joins and anti-joins, which
+										 * are deparsed as [NOT] EXISTS
+										 * subqueries */
 
 	/*
 	 * Index of the relation.  It is used to create an alias to a subquery
@@ -272,6 +380,7 @@ typedef struct SqliteFdwDirectModifyState
 
 	Relation	rel;			/* relcache entry for the foreign table */
 	AttInMetadata *attinmeta;	/* attribute datatype conversion metadata */
+	SqliteValueConverter *converters;	/* converters of RETURNING columns */
 
 	/* extracted fdw_private data */
 	char	   *query;			/* text of UPDATE/DELETE command */
@@ -283,14 +392,14 @@ typedef struct SqliteFdwDirectModifyState
 	sqlite3    *conn;			/* connection for the update */
 	sqlite3_stmt *stmt;			/* SQLite prepared stament handle */
 	int			numParams;		/* number of parameters passed to query */
-	FmgrInfo   *param_flinfo;	/* output conversion functions for them */
 	List	   *param_exprs;	/* executable expressions for param values */
-	const char **param_values;	/* textual values of query parameters */
-	Oid		   *param_types;	/* type of query parameters */
+	SqliteBindInfo *param_binds;	/* bind information of query parameters */
 
 	/* for storing result tuples */
 	int			num_tuples;		/* # of result tuples */
 	int			next_tuple;		/* index of next one to return */
+	instr_time	step_time;		/* time spent in sqlite3_step() */
+	bool		eof_reached;	/* all rows of RETURNING have been returned */
 	Relation	resultRel;		/* relcache entry for the target relation */
 	AttrNumber *attnoMap;		/* array of attnums of input user columns */
 	AttrNumber	ctidAttno;		/* attnum of input ctid column */
@@ -335,18 +444,21 @@ extern const int sqlite_affinity_code(char* t);
 
 /* option.c headers */
 extern sqlite_opt * sqlite_get_options(Oid foreigntableid);
+extern bool sqlite_column_is_strict(Oid relid, AttrNumber attnum);
 
 /* depare.c headers */
 extern void sqlite_deparse_select_stmt_for_rel(StringInfo buf, PlannerInfo *root, RelOptInfo *rel,
 											   List *tlist, List *remote_conds, List *pathkeys,
 											   bool has_final_sort, bool has_limit, bool is_subquery,
 											   List **retrieved_attrs, List **params_list);
-extern void sqlite_deparse_insert(StringInfo buf, PlannerInfo *root, Index rtindex, Relation rel, List *targetAttrs, bool doNothing, int *values_end_len);
+extern void sqlite_deparse_insert(StringInfo buf, PlannerInfo *root, Index rtindex, Relation rel, List *targetAttrs, bool doNothing,
+								  List *withCheckOptionList, List *returningList, List **retrieved_attrs, int *values_end_len);
 #if PG_VERSION_NUM >= 140000
 extern void sqlite_rebuild_insert(StringInfo buf, Relation rel, char *orig_query, List *target_attrs, int values_end_len, int num_params, int num_rows);
 extern void sqlite_deparse_truncate(StringInfo buf, List *rels);
 #endif
-extern void sqlite_deparse_update(StringInfo buf, PlannerInfo *root, Index rtindex, Relation rel, List *targetAttrs, List *attname);
+extern void sqlite_deparse_update(StringInfo buf, PlannerInfo *root, Index rtindex, Relation rel, List *targetAttrs, List *attname,
+								  List *withCheckOptionList, List *returningList, List **retrieved_attrs);
 extern void sqlite_deparse_direct_update_sql(StringInfo buf, PlannerInfo *root,
 											 Index rtindex, Relation rel,
 											 RelOptInfo *foreignrel,
@@ -354,17 +466,26 @@ extern void sqlite_deparse_direct_update_sql(StringInfo buf, PlannerInfo *root,
 											 List *targetAttrs,
 											 List *remote_conds,
 											 List **params_list,
+											 List *returningList,
 											 List **retrieved_attrs);
-extern void sqlite_deparse_delete(StringInfo buf, PlannerInfo *root, Index rtindex, Relation rel, List *name);
+extern void sqlite_deparse_delete(StringInfo buf, PlannerInfo *root, Index rtindex, Relation rel, List *name,
+								  List *returningList, List **retrieved_attrs);
+extern void sqlite_deparse_batch_delete(StringInfo buf, Relation rel, List *key_attrs, int num_rows);
 extern void sqlite_deparse_direct_delete_sql(StringInfo buf, PlannerInfo *root,
 											 Index rtindex, Relation rel,
 											 RelOptInfo *foreignrel,
 											 List *remote_conds,
 											 List **params_list,
+											 List *returningList,
 											 List **retrieved_attrs);
 extern void sqlite_append_where_clause(StringInfo buf, PlannerInfo *root, RelOptInfo *baserel, List *exprs,
 									   bool is_first, List **params);
-extern void sqlite_deparse_analyze(StringInfo buf, char *dbname, char *relname);
+extern void sqlite_deparse_analyze(StringInfo buf, Relation rel, List **retrieved_attrs);
+extern void sqlite_deparse_analyze_info_sql(StringInfo buf, Relation rel);
+extern void sqlite_deparse_analyze_size_sql(StringInfo buf, Relation rel);
+extern void sqlite_deparse_remote_tuples_sql(StringInfo buf, Relation rel);
+extern void sqlite_deparse_rowid_bound_sql(StringInfo buf, Relation rel, bool is_max);
+extern void sqlite_append_rowid_range_cond(StringInfo buf, bool is_first);
 extern void sqlite_deparse_string_literal(StringInfo buf, const char *val);
 extern List *sqlite_build_tlist_to_deparse(RelOptInfo *foreignrel);
 int			sqlite_set_transmission_modes(void);
@@ -378,6 +499,9 @@ extern void sqlite_classify_conditions(PlannerInfo *root,
 
 /* connection.c headers */
 sqlite3    *sqlite_get_connection(ForeignServer *server, bool truncatable);
+sqlite3    *sqlite_get_snapshot_connection(ForeignServer *server);
+SqliteConnStats *sqlite_get_connection_stats(ForeignServer *server);
+bool		sqlite_connection_has_writes(ForeignServer *server);
 sqlite3    *sqlite_connect(char *svr_address, char *svr_username, char *svr_password, char *svr_database,
 						   int svr_port, bool svr_sa, char *svr_init_command,
 						   char *ssl_key, char *ssl_cert, char *ssl_ca, char *ssl_capath,
@@ -385,11 +509,15 @@ sqlite3    *sqlite_connect(char *svr_address, char *svr_username, char *svr_pass
 void		sqlite_cleanup_connection(void);
 void		sqlite_rel_connection(sqlite3 * conn);
 void		sqlitefdw_report_error(int elevel, sqlite3_stmt * stmt, sqlite3 * conn, const char *sql, int rc);
-void		sqlite_cache_stmt(ForeignServer *server, sqlite3_stmt * *stmt);
+sqlite3_stmt *sqlite_get_cached_stmt(ForeignServer *server, sqlite3 * conn, const char *sql);
+void		sqlite_cache_stmt(ForeignServer *server, sqlite3 * conn, const char *sql, sqlite3_stmt * *stmt);
+void		sqlite_release_stmt(ForeignServer *server, sqlite3_stmt * stmt);
 
 NullableDatum sqlite_convert_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags);
+SqliteValueConverter *sqlite_get_value_converters(TupleDesc tupdesc, List *retrieved_attrs);
 
-void		sqlite_bind_sql_var(Form_pg_attribute att, int attnum, Datum value, sqlite3_stmt * stmt, bool *isnull, Oid relid);
+void		sqlite_init_bind_info(SqliteBindInfo *bind, Oid type, Form_pg_attribute att, Oid relid);
+void		sqlite_bind_sql_var(SqliteBindInfo *bind, int attnum, Datum value, sqlite3_stmt * stmt, bool *isnull);
 extern void sqlite_do_sql_command(sqlite3 * conn, const char *sql, int level, List **busy_connection);
 
 void sqlite_fdw_data_norm_functs_init(sqlite3* db);
@@ -399,6 +527,29 @@ sqlite3_int64 binstr2int64(const char *s);
 bool		listed_datatype (const char * tn, const char ** arr);
 blobOutput	sqlite_datum_to_blob (Datum value);
 bool		listed_datatype_oid (Oid atttypid, Oid atttypmod, const char **arr);
+void		sqlite_rowid_to_tid(sqlite3_int64 rowid, ItemPointer tid);
+sqlite3_int64 sqlite_tid_to_rowid(ItemPointer tid);
+
+/* sqlite_async.c headers */
+extern bool sqlite_async_is_supported(void);
+extern SqliteAsyncFetcher *sqlite_async_start(sqlite3_stmt * stmt, bool timing);
+extern bool sqlite_async_next_row(SqliteAsyncFetcher * fetcher, sqlite3_value * **row, int *rc,
+								  instr_time *step_time);
+extern void sqlite_async_release_row(SqliteAsyncFetcher * fetcher, sqlite3_value * *row);
+extern const char *sqlite_async_errmsg(SqliteAsyncFetcher * fetcher);
+extern pgsocket sqlite_async_wait_fd(SqliteAsyncFetcher * fetcher);
+extern void sqlite_async_clear_wakeup(SqliteAsyncFetcher * fetcher);
+extern void sqlite_async_stop(SqliteAsyncFetcher * fetcher);
+extern void sqlite_async_stop_all(void);
+extern void sqlite_async_stop_subxact(int nest_level);
+
+/* sqlite_stat.c headers */
+extern void sqlite_stat_init(void);
+extern bool sqlite_stat_enabled(void);
+extern bool sqlite_stat_timing_enabled(void);
+extern void sqlite_stat_begin(sqlite3_stmt * stmt);
+extern void sqlite_stat_store(ForeignServer *server, sqlite3_stmt * stmt,
+							  instr_time step_time, uint64 rows);
 
 /* sqlite_gis.c headers */
 extern const char *postGisSpecificTypes[];
@@ -406,7 +557,7 @@ extern const char *postGisSQLiteCompatibleTypes[];
 
 #ifdef SQLITE_FDW_GIS_ENABLE
 char*		SpatiaLiteAsPostGISgeom (blobOutput spatiaLiteBlob, Form_pg_attribute att);
-blobOutput	PostGISgeomAsSpatiaLite (Datum value, Form_pg_attribute att);
+blobOutput	PostGISgeomAsSpatiaLite (Datum value, FmgrInfo *outfunc, Form_pg_attribute att);
 void		sqlite_deparse_PostGIS_value(char *extval, StringInfo buf);
 #endif
 
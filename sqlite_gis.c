@@ -215,16 +215,14 @@ EWKB2SpatiaLiteBlobImage (char *hexEWKB, Form_pg_attribute att)
 /*
  * PostGISgeomAsSpatiaLite:
  * Gives PostGIS/GEOS BLOB, returns SpatiaLite BLOB
+ * outfunc is the output function of the PostGIS data type,
+ * att is NULL for query parameters
  */
 blobOutput
-PostGISgeomAsSpatiaLite (Datum d, Form_pg_attribute att)
+PostGISgeomAsSpatiaLite (Datum d, FmgrInfo *outfunc, Form_pg_attribute att)
 {
-	char	   *pgHexOutput = NULL;
-	Oid			outputFunctionId = InvalidOid;
-	bool		typeVarLength = false;
+	char	   *pgHexOutput = OutputFunctionCall(outfunc, d);
 
-	getTypeOutputInfo(att->atttypid, &outputFunctionId, &typeVarLength);
-	pgHexOutput = OidOutputFunctionCall(outputFunctionId, d);
 	return EWKB2SpatiaLiteBlobImage (pgHexOutput, att);
 }
 
@@ -236,10 +234,15 @@ PostGISgeomAsSpatiaLite (Datum d, Form_pg_attribute att)
 static void
 common_EWKB_error (Form_pg_attribute att, int len, const char* data, bool direction_to_pg)
 {
-	Oid			pgtyp = att->atttypid;
-	int32		pgtypmod = att->atttypmod;
-	NameData	pgColND = att->attname;
-	char	   *pg_dataTypeName = TypeNameToString(makeTypeNameFromOid(pgtyp, pgtypmod));
+	NameData	pgColND;
+	char	   *pg_dataTypeName = NULL;
+
+	/* there is no column for values of query parameters and constants */
+	if (att != NULL)
+	{
+		pgColND = att->attname;
+		pg_dataTypeName = TypeNameToString(makeTypeNameFromOid(att->atttypid, att->atttypmod));
+	}
 
 	if (direction_to_pg)
 		ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
@@ -19,12 +19,16 @@
 
 #include <sqlite3.h>
 
+#include "access/sysattr.h"
 #include "catalog/pg_type_d.h"
 #include "commands/defrem.h"
 #include "mb/pg_wchar.h"
+#include "miscadmin.h"
 #include "nodes/makefuncs.h"
 #include "parser/parse_type.h"
 #include "utils/builtins.h"
+#include "utils/date.h"
+#include "utils/datetime.h"
 #include "utils/lsyscache.h"
 #include "utils/timestamp.h"
 #include "utils/uuid.h"
@@ -36,6 +40,17 @@ static char *
 			sqlite_text_value_to_pg_db_encoding(sqlite3_value *val);
 static char *
 			int642binstr(sqlite3_int64 num, char *s, size_t len);
+static int	sqlite_parse_iso_date(const char *str, int len, DateADT *result);
+static int	sqlite_parse_iso_time(const char *str, int len, int32 typmod,
+								  TimeADT *result);
+static int	sqlite_parse_iso_timestamp(const char *str, int len, int32 typmod,
+									   Timestamp *result);
+static bool sqlite_parse_iso_timestamptz(const char *str, int len, int32 typmod,
+										 TimestampTz *result);
+static int	sqlite_format_iso_timestamp(Timestamp timestamp, char *buf);
+
+/* Buffer size for sqlite_format_iso_timestamp() */
+#define SQLITE_ISO_TIMESTAMP_BUF_SIZE	32
 
 /*
  * Human readable message about disallowed combination of PostgreSQL columnn
@@ -67,8 +82,13 @@ sqlite_convert_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *
 	Oid			pgtyp = att->atttypid;
 	Datum		value_datum = 0;
 	char	   *valstr = NULL;
-				/* Compute always, void text and void BLOB is special cases */
-	int		 	value_byte_size_blob_or_utf8 = sqlite3_value_bytes(val);
+	/*
+	 * Void text and void BLOB are special cases.  Only compute the size for
+	 * them, sqlite3_value_bytes() converts numeric values to text.
+	 */
+	int			value_byte_size_blob_or_utf8 =
+		(sqlite_value_affinity == SQLITE3_TEXT || sqlite_value_affinity == SQLITE_BLOB) ?
+		sqlite3_value_bytes(val) : 0;
 
 	switch (pgtyp)
 	{
@@ -224,6 +244,7 @@ sqlite_convert_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *
 			{
 				switch (sqlite_value_affinity)
 				{
+					case SQLITE_INTEGER: /* not normalized value of a strict column */
 					case SQLITE_FLOAT: /* <-- proper and recommended SQLite affinity of value for pgtyp */
 						{
 							double		value = sqlite3_value_double(val);
@@ -244,7 +265,6 @@ sqlite_convert_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *
 								pg_column_void_text_error();
 							break;
 						}
-					case SQLITE_INTEGER:
 					case SQLITE_BLOB:
 					default:
 						{
@@ -258,6 +278,7 @@ sqlite_convert_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *
 			{
 				switch (sqlite_value_affinity)
 				{
+					case SQLITE_INTEGER: /* not normalized value of a strict column */
 					case SQLITE_FLOAT: /* <-- proper and recommended SQLite affinity of value for pgtyp */
 						{
 							double		value = sqlite3_value_double(val);
@@ -277,7 +298,6 @@ sqlite_convert_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *
 								pg_column_void_text_error();
 							break;
 						}
-					case SQLITE_INTEGER:
 					case SQLITE_BLOB:
 					default:
 						{
@@ -528,6 +548,374 @@ sqlite_convert_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *
 	return (struct NullableDatum){value_datum, false};
 }
 
+/*
+ * Fast paths of sqlite_convert_to_pg() for the proper SQLite affinity of
+ * frequently used data types.  Values with other affinities take the common
+ * way, so the results and the errors are the same.
+ */
+static NullableDatum
+sqlite_convert_int2_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	if (sqlite_value_affinity == SQLITE_INTEGER)
+	{
+		sqlite3_int64 value = sqlite3_value_int64(val);
+
+		if (unlikely(value < PG_INT16_MIN || value > PG_INT16_MAX))
+			ereport(ERROR,
+					(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					 errmsg("smallint out of range")));
+		return (struct NullableDatum) {Int16GetDatum((int16) value), false};
+	}
+	return sqlite_convert_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+static NullableDatum
+sqlite_convert_int4_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	if (sqlite_value_affinity == SQLITE_INTEGER)
+	{
+		sqlite3_int64 value = sqlite3_value_int64(val);
+
+		if (unlikely(value < PG_INT32_MIN || value > PG_INT32_MAX))
+			ereport(ERROR,
+					(errcode(ERRCODE_NUMERIC_VALUE_OUT_OF_RANGE),
+					 errmsg("integer out of range")));
+		return (struct NullableDatum) {Int32GetDatum((int32) value), false};
+	}
+	return sqlite_convert_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+static NullableDatum
+sqlite_convert_int8_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	if (sqlite_value_affinity == SQLITE_INTEGER)
+		return (struct NullableDatum) {Int64GetDatum((int64) sqlite3_value_int64(val)), false};
+	return sqlite_convert_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+static NullableDatum
+sqlite_convert_float8_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	if (sqlite_value_affinity == SQLITE_FLOAT || sqlite_value_affinity == SQLITE_INTEGER)
+		return (struct NullableDatum) {Float8GetDatum((float8) sqlite3_value_double(val)), false};
+	return sqlite_convert_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+static NullableDatum
+sqlite_convert_bool_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	/* Other integers keep the conversion of sqlite_convert_to_pg */
+	if (sqlite_value_affinity == SQLITE_INTEGER)
+	{
+		sqlite3_int64 value = sqlite3_value_int64(val);
+
+		if (value == 0 || value == 1)
+			return (struct NullableDatum) {BoolGetDatum(value == 1), false};
+	}
+	return sqlite_convert_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+/*
+ * Build a text datum from SQLite text in a UTF-8 database with one allocation
+ * and copy.  SQLite knows the length of the text, but textin() stops at the
+ * first NUL byte, which SQLite text can contain, so the same is done here.
+ */
+static text *
+sqlite_utf8_text_to_varlena(sqlite3_value * val, int *len)
+{
+	/* sqlite3_value_bytes() must follow sqlite3_value_text() */
+	const char *str = (const char *) sqlite3_value_text(val);
+	const char *nul;
+	text	   *result;
+
+	*len = sqlite3_value_bytes(val);
+	nul = memchr(str, '\0', *len);
+	if (nul != NULL)
+		*len = nul - str;
+
+	result = (text *) palloc(*len + VARHDRSZ);
+	SET_VARSIZE(result, *len + VARHDRSZ);
+	memcpy(VARDATA(result), str, *len);
+	return result;
+}
+
+/*
+ * Text column in UTF-8 database: the same as textin() without a function call,
+ * any affinity is accepted as text.
+ */
+static NullableDatum
+sqlite_convert_utf8_text_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	int			len;
+	text	   *value = sqlite_utf8_text_to_varlena(val, &len);
+
+	return (struct NullableDatum) {PointerGetDatum(value), false};
+}
+
+/*
+ * varchar column in UTF-8 database: a value which has no more bytes than
+ * the length limit has no more characters either, so varcharin() would
+ * return it as it is.  Longer values are checked by the input function.
+ */
+static NullableDatum
+sqlite_convert_utf8_varchar_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	int			len;
+	text	   *value = sqlite_utf8_text_to_varlena(val, &len);
+
+	if (att->atttypmod >= (int32) VARHDRSZ && len > att->atttypmod - (int32) VARHDRSZ)
+	{
+		char	   *valstr = text_to_cstring(value);
+
+		pfree(value);
+		return (struct NullableDatum) {InputFunctionCall(&attinmeta->attinfuncs[attnum],
+														 valstr,
+														 attinmeta->attioparams[attnum],
+														 attinmeta->atttypmods[attnum]), false};
+	}
+	return (struct NullableDatum) {PointerGetDatum(value), false};
+}
+
+/*
+ * timestamp column: text in the layout of SQLite date and time functions is
+ * parsed here, other values take the common way through timestamp_in().
+ */
+static NullableDatum
+sqlite_convert_timestamp_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	if (sqlite_value_affinity == SQLITE3_TEXT)
+	{
+		/* sqlite3_value_bytes() must follow sqlite3_value_text() */
+		const char *str = (const char *) sqlite3_value_text(val);
+		int			len = sqlite3_value_bytes(val);
+		Timestamp	value;
+
+		if (sqlite_parse_iso_timestamp(str, len, att->atttypmod, &value) == len)
+			return (struct NullableDatum) {TimestampGetDatum(value), false};
+	}
+	return sqlite_convert_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+/*
+ * timestamptz column: only text with an explicit UTC offset is parsed here.
+ * Text without an offset is in the session time zone, whose rules are left
+ * to timestamptz_in() like all other values.
+ */
+static NullableDatum
+sqlite_convert_timestamptz_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	if (sqlite_value_affinity == SQLITE3_TEXT)
+	{
+		const char *str = (const char *) sqlite3_value_text(val);
+		int			len = sqlite3_value_bytes(val);
+		TimestampTz value;
+
+		if (sqlite_parse_iso_timestamptz(str, len, att->atttypmod, &value))
+			return (struct NullableDatum) {TimestampTzGetDatum(value), false};
+	}
+	return sqlite_convert_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+/*
+ * date column: text "YYYY-MM-DD" is parsed here, other values take the
+ * common way through date_in().
+ */
+static NullableDatum
+sqlite_convert_date_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	if (sqlite_value_affinity == SQLITE3_TEXT)
+	{
+		const char *str = (const char *) sqlite3_value_text(val);
+		int			len = sqlite3_value_bytes(val);
+		DateADT		value;
+
+		if (sqlite_parse_iso_date(str, len, &value) == len)
+			return (struct NullableDatum) {DateADTGetDatum(value), false};
+	}
+	return sqlite_convert_by_input_function_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+/*
+ * time column: text "HH:MM:SS[.ffffff]" is parsed here, other values take
+ * the common way through time_in().
+ */
+static NullableDatum
+sqlite_convert_time_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	if (sqlite_value_affinity == SQLITE3_TEXT)
+	{
+		const char *str = (const char *) sqlite3_value_text(val);
+		int			len = sqlite3_value_bytes(val);
+		TimeADT		value;
+
+		if (sqlite_parse_iso_time(str, len, att->atttypmod, &value) == len)
+			return (struct NullableDatum) {TimeADTGetDatum(value), false};
+	}
+	return sqlite_convert_by_input_function_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+/*
+ * bytea column: blob or text is copied into the varlena at once.
+ */
+static NullableDatum
+sqlite_convert_bytea_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	if (sqlite_value_affinity == SQLITE_BLOB || sqlite_value_affinity == SQLITE3_TEXT)
+	{
+		/* sqlite3_value_bytes() must follow sqlite3_value_blob() */
+		const void *blob = sqlite3_value_blob(val);
+		int			len = sqlite3_value_bytes(val);
+		bytea	   *value = (bytea *) palloc(len + VARHDRSZ);
+
+		SET_VARSIZE(value, len + VARHDRSZ);
+		if (len > 0)
+			memcpy(VARDATA(value), blob, len);
+		return (struct NullableDatum) {PointerGetDatum(value), false};
+	}
+	return sqlite_convert_to_pg(att, val, attinmeta, attnum, sqlite_value_affinity, AffinityBehaviourFlags);
+}
+
+/*
+ * Data types without special processing: text representation of any affinity
+ * is passed to the input function of the data type.
+ */
+static NullableDatum
+sqlite_convert_by_input_function_to_pg(Form_pg_attribute att, sqlite3_value * val, AttInMetadata *attinmeta, AttrNumber attnum, int sqlite_value_affinity, int AffinityBehaviourFlags)
+{
+	char	   *valstr = sqlite_text_value_to_pg_db_encoding(val);
+	Datum		value_datum;
+
+	value_datum = InputFunctionCall(&attinmeta->attinfuncs[attnum],
+									valstr,
+									attinmeta->attioparams[attnum],
+									attinmeta->atttypmods[attnum]);
+	return (struct NullableDatum) {value_datum, false};
+}
+
+/*
+ * sqlite_get_value_converter:
+ * Choose the converter of SQLite values for a PostgreSQL column.  The result
+ * is the same as of sqlite_convert_to_pg(), but the data type is examined only
+ * once, not for every value.
+ */
+static SqliteValueConverter
+sqlite_get_value_converter(Form_pg_attribute att)
+{
+	switch (att->atttypid)
+	{
+		case INT2OID:
+			return sqlite_convert_int2_to_pg;
+		case INT4OID:
+			return sqlite_convert_int4_to_pg;
+		case INT8OID:
+			return sqlite_convert_int8_to_pg;
+		case FLOAT8OID:
+			return sqlite_convert_float8_to_pg;
+		case TEXTOID:
+			/* Other database encodings need conversion of SQLite text */
+			if (GetDatabaseEncoding() == PG_UTF8)
+				return sqlite_convert_utf8_text_to_pg;
+			return sqlite_convert_by_input_function_to_pg;
+		case VARCHAROID:
+			if (GetDatabaseEncoding() == PG_UTF8)
+				return sqlite_convert_utf8_varchar_to_pg;
+			return sqlite_convert_by_input_function_to_pg;
+		case BPCHAROID:
+			/* Without a length, bpcharin() neither pads nor truncates */
+			if (GetDatabaseEncoding() == PG_UTF8 && att->atttypmod < (int32) VARHDRSZ)
+				return sqlite_convert_utf8_text_to_pg;
+			return sqlite_convert_by_input_function_to_pg;
+		case BYTEAOID:
+			return sqlite_convert_bytea_to_pg;
+		case CHAROID:
+		case JSONOID:
+		case JSONBOID:
+		case NAMEOID:
+			return sqlite_convert_by_input_function_to_pg;
+		case DATEOID:
+			return sqlite_convert_date_to_pg;
+		case TIMEOID:
+			return sqlite_convert_time_to_pg;
+		case TIMESTAMPOID:
+			return sqlite_convert_timestamp_to_pg;
+		case TIMESTAMPTZOID:
+			return sqlite_convert_timestamptz_to_pg;
+		case BOOLOID:
+			return sqlite_convert_bool_to_pg;
+		case FLOAT4OID:
+		case NUMERICOID:
+		case UUIDOID:
+		case VARBITOID:
+		case BITOID:
+			return sqlite_convert_to_pg;
+		default:
+			/* PostGIS data types are detected by name, see sqlite_convert_to_pg */
+			if (listed_datatype_oid(att->atttypid, att->atttypmod, postGisSpecificTypes) ||
+				listed_datatype_oid(att->atttypid, att->atttypmod, postGisSQLiteCompatibleTypes))
+				return sqlite_convert_to_pg;
+			return sqlite_convert_by_input_function_to_pg;
+	}
+}
+
+/*
+ * sqlite_get_value_converters:
+ * Conversion plan of a scan: converters of the result columns of a SQLite
+ * query, in the order of retrieved_attrs
+ */
+SqliteValueConverter *
+sqlite_get_value_converters(TupleDesc tupdesc, List *retrieved_attrs)
+{
+	SqliteValueConverter *converters;
+	ListCell   *lc;
+	int			i = 0;
+
+	converters = (SqliteValueConverter *) palloc(sizeof(SqliteValueConverter) * Max(list_length(retrieved_attrs), 1));
+	foreach(lc, retrieved_attrs)
+	{
+		int			attnum = lfirst_int(lc);
+
+		/* the rowid is stored as ctid of the row, not converted */
+		if (attnum == SelfItemPointerAttributeNumber)
+		{
+			converters[i++] = NULL;
+			continue;
+		}
+		converters[i++] = sqlite_get_value_converter(TupleDescAttr(tupdesc, attnum - 1));
+	}
+	return converters;
+}
+
+/*
+ * sqlite_rowid_to_tid:
+ * Store SQLite rowid into ctid, which identifies rows of UPDATE and DELETE
+ * of a foreign table without key columns.  ItemPointerData has 48 bits:
+ * the block number takes the high and the offset the low 16 bits.  Rowids
+ * which would have InvalidBlockNumber are rejected, so an invalid ctid is
+ * never taken for a row.
+ */
+void
+sqlite_rowid_to_tid(sqlite3_int64 rowid, ItemPointer tid)
+{
+	if (rowid < 0 || rowid >= ((sqlite3_int64) InvalidBlockNumber << 16))
+		ereport(ERROR,
+				(errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
+				 errmsg("SQLite rowid " INT64_FORMAT " can not identify a row", (int64) rowid),
+				 errhint("Set the option \"%s\" on the columns that belong to the primary key.", "key")));
+
+	ItemPointerSet(tid, (BlockNumber) (rowid >> 16), (OffsetNumber) (rowid & 0xFFFF));
+}
+
+/*
+ * sqlite_tid_to_rowid:
+ * SQLite rowid stored by sqlite_rowid_to_tid
+ */
+sqlite3_int64
+sqlite_tid_to_rowid(ItemPointer tid)
+{
+	return ((sqlite3_int64) ItemPointerGetBlockNumberNoCheck(tid) << 16) |
+		ItemPointerGetOffsetNumberNoCheck(tid);
+}
+
 /*
  * sqlite_datum_to_blob:
  * Common part of extracting and preparing PostgreSQL bytea data
@@ -573,18 +961,90 @@ get_column_option_string(Oid relid, int varattno, char *optionname)
 	return coloptionvalue;
 }
 
+/*
+ * sqlite_init_bind_info:
+ * Collect information for binding of values of the data type once per
+ * statement instead of for every value.  att and relid are given for
+ * foreign table columns, NULL and InvalidOid for query parameters.
+ */
+void
+sqlite_init_bind_info(SqliteBindInfo *bind, Oid type, Form_pg_attribute att, Oid relid)
+{
+	Oid			outputFunctionId = InvalidOid;
+	bool		typeVarLength = false;
+
+	memset(bind, 0, sizeof(SqliteBindInfo));
+	bind->type = (att != NULL) ? att->atttypid : type;
+	bind->typmod = (att != NULL) ? att->atttypmod : -1;
+	bind->att = att;
+	if (att != NULL)
+	{
+		bind->typlen = att->attlen;
+		bind->typbyval = att->attbyval;
+	}
+	else
+		get_typlenbyval(type, &bind->typlen, &bind->typbyval);
+
+	switch (bind->type)
+	{
+		case INT2OID:
+		case INT4OID:
+		case INT8OID:
+		case FLOAT4OID:
+		case FLOAT8OID:
+		case NUMERICOID:
+		case BOOLOID:
+		case BYTEAOID:
+			/* bound directly */
+			return;
+		case UUIDOID:
+			if (att != NULL && OidIsValid(relid))
+			{
+				char	   *optv = get_column_option_string(relid, att->attnum, "column_type");
+
+				elog(DEBUG3, "sqlite_fdw : col type %s ", optv);
+				if (optv != NULL && strcasecmp(optv, "BLOB") == 0)
+					bind->uuid_as_blob = true;
+			}
+			/* query parameters are bound as text */
+			if (bind->uuid_as_blob)
+				return;
+			break;
+		case BPCHAROID:
+		case VARCHAROID:
+		case TEXTOID:
+		case JSONOID:
+		case NAMEOID:
+		case TIMEOID:
+		case TIMESTAMPOID:
+		case TIMESTAMPTZOID:
+		case DATEOID:
+		case VARBITOID:
+		case BITOID:
+			break;
+		default:
+			/* PostGIS data types can be supported only by name */
+			bind->is_postgis = listed_datatype_oid(bind->type, bind->typmod, postGisSQLiteCompatibleTypes);
+			if (!bind->is_postgis)
+				return;
+			break;
+	}
+	getTypeOutputInfo(bind->type, &outputFunctionId, &typeVarLength);
+	fmgr_info(outputFunctionId, &bind->outfunc);
+}
+
 /*
  * bind_sql_var:
  * Bind the values provided as DatumBind the values and nulls to modify the target table (INSERT/UPDATE)
  */
 void
-sqlite_bind_sql_var(Form_pg_attribute att, int attnum, Datum value, sqlite3_stmt * stmt, bool *isnull, Oid relid)
+sqlite_bind_sql_var(SqliteBindInfo *bind, int attnum, Datum value, sqlite3_stmt * stmt, bool *isnull)
 {
 	int			ret = SQLITE_OK;
-	Oid			type = att->atttypid;
-	int32		pgtypmod = att->atttypmod;
+	Oid			type = bind->type;
+	int32		pgtypmod = bind->typmod;
 	attnum++;
-	elog(DEBUG2, "sqlite_fdw : %s %d type=%u relid=%u typmod=%d ", __func__, attnum, type, relid, pgtypmod);
+	elog(DEBUG2, "sqlite_fdw : %s %d type=%u typmod=%d ", __func__, attnum, type, pgtypmod);
 
 	if (*isnull)
 	{
@@ -650,25 +1110,35 @@ sqlite_bind_sql_var(Form_pg_attribute att, int attnum, Datum value, sqlite3_stmt
 				break;
 			}
 
+		case TIMESTAMPOID:
+			{
+				char		buf[SQLITE_ISO_TIMESTAMP_BUF_SIZE];
+				int			len;
+
+				/* The usual layout is formatted without the output function */
+				if (DateStyle == USE_ISO_DATES &&
+					(len = sqlite_format_iso_timestamp(DatumGetTimestamp(value), buf)) > 0)
+				{
+					ret = sqlite3_bind_text(stmt, attnum, buf, len, SQLITE_TRANSIENT);
+					break;
+				}
+			}
+			/* FALLTHROUGH */
 		case BPCHAROID:
 		case VARCHAROID:
 		case TEXTOID:
 		case JSONOID:
 		case NAMEOID:
 		case TIMEOID:
-		case TIMESTAMPOID:
 		case TIMESTAMPTZOID:
 		case DATEOID:
 			{
 				/* Bind as text because SQLite does not have these types */
 				char	   *outputString = NULL;
-				Oid			outputFunctionId = InvalidOid;
-				bool		typeVarLength = false;
 				int			pg_database_encoding = GetDatabaseEncoding(); /* very fast call, see PostgreSQL mbutils.c */
 				char	   *utf8_text_value = NULL;
 
-				getTypeOutputInfo(type, &outputFunctionId, &typeVarLength);
-				outputString = OidOutputFunctionCall(outputFunctionId, value);
+				outputString = OutputFunctionCall(&bind->outfunc, value);
 				if (pg_database_encoding == PG_UTF8)
 					utf8_text_value = outputString;
 				else
@@ -684,31 +1154,17 @@ sqlite_bind_sql_var(Form_pg_attribute att, int attnum, Datum value, sqlite3_stmt
 			}
 		case UUIDOID:
 			{
-				bool		uuid_as_blob = false;
-				if (relid)
+				if (bind->uuid_as_blob)
 				{
-					char * optv = get_column_option_string (relid, attnum, "column_type");
-					elog(DEBUG3, "sqlite_fdw : col type %s ", optv);
-					if (optv != NULL && strcasecmp(optv, "BLOB") == 0)
-						uuid_as_blob = true;
-				}
-
-				if (uuid_as_blob)
-				{
-					unsigned char *dat = palloc0(UUID_LEN);
 					pg_uuid_t* pg_uuid = DatumGetUUIDP(value);
 					elog(DEBUG2, "sqlite_fdw : bind uuid as blob");
-					memcpy(dat, pg_uuid->data, UUID_LEN);
-					ret = sqlite3_bind_blob(stmt, attnum, dat, UUID_LEN, SQLITE_TRANSIENT);
+					ret = sqlite3_bind_blob(stmt, attnum, pg_uuid->data, UUID_LEN, SQLITE_TRANSIENT);
 				}
 				else
 				{
 					/* uuid as text */
 					char	   *outputString = NULL;
-					Oid			outputFunctionId = InvalidOid;
-					bool		typeVarLength = false;
-					getTypeOutputInfo(type, &outputFunctionId, &typeVarLength);
-					outputString = OidOutputFunctionCall(outputFunctionId, value); /* uuid text belongs to ASCII subset, no need to translate encoding */
+					outputString = OutputFunctionCall(&bind->outfunc, value); /* uuid text belongs to ASCII subset, no need to translate encoding */
 					ret = sqlite3_bind_text(stmt, attnum, outputString, -1, SQLITE_TRANSIENT);
 				}
 				break;
@@ -718,11 +1174,8 @@ sqlite_bind_sql_var(Form_pg_attribute att, int attnum, Datum value, sqlite3_stmt
 			{
 				sqlite3_int64 dat;
 				char	   *outputString = NULL;
-				Oid			outputFunctionId = InvalidOid;
-				bool		typeVarLength = false;
 
-				getTypeOutputInfo(type, &outputFunctionId, &typeVarLength);
-				outputString = OidOutputFunctionCall(outputFunctionId, value);
+				outputString = OutputFunctionCall(&bind->outfunc, value);
 				elog(DEBUG4, "sqlite_fdw : BIT bind  %s", outputString);
 				if (strlen(outputString) > SQLITE_FDW_BIT_DATATYPE_BUF_SIZE - 1 )
 				{
@@ -736,33 +1189,33 @@ sqlite_bind_sql_var(Form_pg_attribute att, int attnum, Datum value, sqlite3_stmt
 			}
 		default:
 			{
-				NameData	pgColND = att->attname;
-				char	*pg_dataTypeName = TypeNameToString(makeTypeNameFromOid(type, pgtypmod));
+				/* This is very rare and not fast algorythm branch */
+				char	*pg_dataTypeName;
+				const char *colname = (bind->att != NULL) ? NameStr(bind->att->attname) : "";
 
-				/* PostGIS data types can be supported only by name
-				 * This is very rare and not fast algorythm branch
-				 */
-				if (listed_datatype(pg_dataTypeName, postGisSQLiteCompatibleTypes))
+				if (bind->is_postgis)
 				{
 #ifdef SQLITE_FDW_GIS_ENABLE
-					blobOutput b = PostGISgeomAsSpatiaLite(value, att);
+					blobOutput b = PostGISgeomAsSpatiaLite(value, &bind->outfunc, bind->att);
 					ret = sqlite3_bind_blob(stmt, attnum, b.dat, b.len, SQLITE_TRANSIENT);
 #else
+					pg_dataTypeName = TypeNameToString(makeTypeNameFromOid(type, pgtypmod));
 					ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
 									errmsg("This PostGIS data type is supported by SpatiaLite, but FDW compiled without GIS data support"),
-									errhint("Data type: \"%s\" in column \"%.*s\"", pg_dataTypeName, (int)sizeof(pgColND.data), pgColND.data)));
+									errhint("Data type: \"%s\" in column \"%s\"", pg_dataTypeName, colname)));
 #endif
 					break;
 				}
 
+				pg_dataTypeName = TypeNameToString(makeTypeNameFromOid(type, pgtypmod));
 				if (listed_datatype(pg_dataTypeName, postGisSpecificTypes))
 					ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
 									errmsg("This data type is PostGIS specific and have not any SpatiaLite value"),
-									errhint("Data type: \"%s\" in column \"%.*s\"", pg_dataTypeName, (int)sizeof(pgColND.data), pgColND.data)));
+									errhint("Data type: \"%s\" in column \"%s\"", pg_dataTypeName, colname)));
 
 				ereport(ERROR, (errcode(ERRCODE_FDW_INVALID_DATA_TYPE),
 								errmsg("cannot convert constant value to SQLite value"),
-								errhint("Constant value data type: \"%s\" in column \"%.*s\"", pg_dataTypeName, (int)sizeof(pgColND.data), pgColND.data)));
+								errhint("Constant value data type: \"%s\" in column \"%s\"", pg_dataTypeName, colname)));
 				break;
 			}
 	}
@@ -799,6 +1252,238 @@ sqlite_text_value_to_pg_db_encoding(sqlite3_value *val)
 	}
 }
 
+#define SQLITE_ISO_DIGIT(c) ((unsigned) ((c) - '0') <= 9)
+#define SQLITE_ISO_2DIGITS(p) (((p)[0] - '0') * 10 + ((p)[1] - '0'))
+
+/*
+ * sqlite_parse_iso_date:
+ * Parse a date "YYYY-MM-DD" at the start of str, the layout of SQLite date
+ * and time functions.  Returns the length of the date, or 0 if str does not
+ * start with one in the range of years 1..9999.
+ */
+static int
+sqlite_parse_iso_date(const char *str, int len, DateADT *result)
+{
+	static const char layout[] = "dddd-dd-dd";
+	int			year,
+				mon,
+				mday;
+	int			i;
+
+	if (len < 10)
+		return 0;
+	for (i = 0; i < 10; i++)
+	{
+		if (layout[i] == 'd' ? !SQLITE_ISO_DIGIT(str[i]) : str[i] != layout[i])
+			return 0;
+	}
+
+	year = SQLITE_ISO_2DIGITS(str) * 100 + SQLITE_ISO_2DIGITS(str + 2);
+	mon = SQLITE_ISO_2DIGITS(str + 5);
+	mday = SQLITE_ISO_2DIGITS(str + 8);
+	if (year < 1 || mon < 1 || mon > 12 || mday < 1 ||
+		mday > day_tab[isleap(year)][mon - 1])
+		return 0;
+
+	*result = date2j(year, mon, mday) - POSTGRES_EPOCH_JDATE;
+	return 10;
+}
+
+/*
+ * sqlite_parse_iso_time:
+ * Parse a time "HH:MM:SS[.ffffff]" at the start of str.  Returns the length
+ * of the time, or 0 if str does not start with one.  Times which time_in()
+ * would round to the typmod, or with more than 6 fractional digits, are left
+ * to it as well, so that the result is always the same.
+ */
+static int
+sqlite_parse_iso_time(const char *str, int len, int32 typmod, TimeADT *result)
+{
+	static const char layout[] = "dd:dd:dd";
+	int			hour,
+				min,
+				sec;
+	int64		fsec = 0;
+	int			fdigits = 0;
+	int			i;
+	int			n;
+
+	if (len < 8)
+		return 0;
+	for (i = 0; i < 8; i++)
+	{
+		if (layout[i] == 'd' ? !SQLITE_ISO_DIGIT(str[i]) : str[i] != layout[i])
+			return 0;
+	}
+
+	hour = SQLITE_ISO_2DIGITS(str);
+	min = SQLITE_ISO_2DIGITS(str + 3);
+	sec = SQLITE_ISO_2DIGITS(str + 6);
+	if (hour > 23 || min > 59 || sec > 59)
+		return 0;
+
+	i = 8;
+	if (i < len && str[i] == '.')
+	{
+		for (i++; i < len && SQLITE_ISO_DIGIT(str[i]); i++)
+		{
+			if (++fdigits > 6)
+				return 0;
+			fsec = fsec * 10 + (str[i] - '0');
+		}
+		if (fdigits == 0)
+			return 0;
+	}
+	if (typmod >= 0 && fdigits > typmod)
+		return 0;
+	for (n = fdigits; n < 6; n++)
+		fsec *= 10;
+
+	*result = ((hour * MINS_PER_HOUR + min) * SECS_PER_MINUTE + sec) * USECS_PER_SEC + fsec;
+	return i;
+}
+
+/*
+ * sqlite_parse_iso_timestamp:
+ * Parse text in the layout "YYYY-MM-DD[ HH:MM:SS[.ffffff]]", which SQLite
+ * date and time functions produce, at the start of str into a timestamp.
+ * Returns the length of the parsed text, or 0 if str does not start with
+ * such a value.  The callers leave any other text to the input functions.
+ */
+static int
+sqlite_parse_iso_timestamp(const char *str, int len, int32 typmod,
+						   Timestamp *result)
+{
+	DateADT		date;
+	TimeADT		time = 0;
+	int			n;
+	int			tlen;
+
+	n = sqlite_parse_iso_date(str, len, &date);
+	if (n == 0)
+		return 0;
+
+	/* ISO 8601 'T' between date and time is accepted by timestamp_in() */
+	if (n < len && (str[n] == ' ' || str[n] == 'T'))
+	{
+		tlen = sqlite_parse_iso_time(str + n + 1, len - n - 1, typmod, &time);
+		if (tlen == 0)
+			return 0;
+		n += 1 + tlen;
+	}
+
+	*result = (Timestamp) date * USECS_PER_DAY + time;
+	return n;
+}
+
+/*
+ * sqlite_parse_iso_timestamptz:
+ * Parse a timestamp "YYYY-MM-DD HH:MM:SS[.ffffff]" followed by an explicit
+ * UTC offset "Z", "+HH", "+HH:MM" or "+HHMM" (or with '-'), which must be all
+ * of str.  Returns false for anything else, including timestamps without an
+ * offset, which are in the session time zone.
+ */
+static bool
+sqlite_parse_iso_timestamptz(const char *str, int len, int32 typmod,
+							 TimestampTz *result)
+{
+	Timestamp	timestamp;
+	int			n;
+	int			offset = 0;
+
+	n = sqlite_parse_iso_timestamp(str, len, typmod, &timestamp);
+	/* A date alone has no time for the offset */
+	if (n <= 10 || n == len)
+		return false;
+
+	str += n;
+	len -= n;
+	if (len == 1 && str[0] == 'Z')
+		offset = 0;
+	else if ((str[0] == '+' || str[0] == '-') &&
+			 len >= 3 && SQLITE_ISO_DIGIT(str[1]) && SQLITE_ISO_DIGIT(str[2]))
+	{
+		int			hours = SQLITE_ISO_2DIGITS(str + 1);
+		int			mins = 0;
+
+		if (len == 6 && str[3] == ':' &&
+			SQLITE_ISO_DIGIT(str[4]) && SQLITE_ISO_DIGIT(str[5]))
+			mins = SQLITE_ISO_2DIGITS(str + 4);
+		else if (len == 5 && SQLITE_ISO_DIGIT(str[3]) && SQLITE_ISO_DIGIT(str[4]))
+			mins = SQLITE_ISO_2DIGITS(str + 3);
+		else if (len != 3)
+			return false;
+		if (hours > 15 || mins > 59)
+			return false;
+
+		offset = (hours * MINS_PER_HOUR + mins) * SECS_PER_MINUTE;
+		if (str[0] == '-')
+			offset = -offset;
+	}
+	else
+		return false;
+
+	/* Local time minus the offset is UTC */
+	*result = timestamp - (int64) offset * USECS_PER_SEC;
+	return true;
+}
+
+#undef SQLITE_ISO_DIGIT
+#undef SQLITE_ISO_2DIGITS
+
+/*
+ * sqlite_format_iso_timestamp:
+ * Format a timestamp into buf the same way as timestamp_out() does with
+ * DateStyle ISO.  Returns the length of the text, or 0 for infinite values
+ * and years out of 1..9999, which are left to the output function.
+ */
+static int
+sqlite_format_iso_timestamp(Timestamp timestamp, char *buf)
+{
+	struct pg_tm tm;
+	fsec_t		fsec;
+	char	   *p = buf;
+	int			i;
+
+#define SQLITE_ISO_PUT_2DIGITS(p, n) ((p)[0] = '0' + (n) / 10, (p)[1] = '0' + (n) % 10, (p) += 2)
+
+	if (TIMESTAMP_NOT_FINITE(timestamp) ||
+		timestamp2tm(timestamp, NULL, &tm, &fsec, NULL, NULL) != 0 ||
+		tm.tm_year < 1 || tm.tm_year > 9999)
+		return 0;
+
+	SQLITE_ISO_PUT_2DIGITS(p, tm.tm_year / 100);
+	SQLITE_ISO_PUT_2DIGITS(p, tm.tm_year % 100);
+	*p++ = '-';
+	SQLITE_ISO_PUT_2DIGITS(p, tm.tm_mon);
+	*p++ = '-';
+	SQLITE_ISO_PUT_2DIGITS(p, tm.tm_mday);
+	*p++ = ' ';
+	SQLITE_ISO_PUT_2DIGITS(p, tm.tm_hour);
+	*p++ = ':';
+	SQLITE_ISO_PUT_2DIGITS(p, tm.tm_min);
+	*p++ = ':';
+	SQLITE_ISO_PUT_2DIGITS(p, tm.tm_sec);
+	if (fsec != 0)
+	{
+		/* Fractional digits without trailing zeros */
+		*p++ = '.';
+		for (i = 5; i >= 0; i--)
+		{
+			p[i] = '0' + fsec % 10;
+			fsec /= 10;
+		}
+		p += 6;
+		while (p[-1] == '0')
+			p--;
+	}
+	*p = '\0';
+
+#undef SQLITE_ISO_PUT_2DIGITS
+
+	return p - buf;
+}
+
 /*
  * int642binstr:
  * Converts int64 from SQLite to PostgreSQL string from 0 and 1 only
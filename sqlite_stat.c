@@ -0,0 +1,613 @@
+/*-------------------------------------------------------------------------
+ *
+ * SQLite Foreign Data Wrapper for PostgreSQL
+ *
+ * Cumulative statistics of remote SQLite statements
+ *
+ * When the library is loaded through shared_preload_libraries, a hash table
+ * in shared memory accumulates the usage of every remote statement executed
+ * by foreign scans and modifications, in the manner of pg_stat_statements.
+ * Entries are keyed by user, database, foreign server and the hash of the
+ * remote SQL with its literals replaced by '?', so that queries differing
+ * only in constants share an entry.  The statistics are not kept over a
+ * server restart.
+ *
+ * IDENTIFICATION
+ * 		sqlite_stat.c
+ *
+ *-------------------------------------------------------------------------
+ */
+
+#include "postgres.h"
+#include "sqlite_fdw.h"
+
+#include "access/hash.h"
+#include "catalog/pg_authid.h"
+#if PG_VERSION_NUM >= 130000
+	#include "common/hashfn.h"
+#endif
+#include "mb/pg_wchar.h"
+#include "miscadmin.h"
+#include "storage/ipc.h"
+#include "storage/lwlock.h"
+#include "storage/shmem.h"
+#include "storage/spin.h"
+#include "utils/acl.h"
+#include "utils/builtins.h"
+#include "utils/guc.h"
+#include "utils/hsearch.h"
+
+#if PG_VERSION_NUM < 140000
+#define ROLE_PG_READ_ALL_STATS	DEFAULT_ROLE_READ_ALL_STATS
+#endif
+
+/* Maximum number of statements tracked */
+#define SQLITE_STAT_MAX_ENTRIES		1000
+
+/* Percentage of entries discarded at once when the table is full */
+#define SQLITE_STAT_DEALLOC_PERCENT	5
+
+/* Maximum length of the stored text of a statement, in bytes */
+#define SQLITE_STAT_QUERY_SIZE		1024
+
+#define SQLITE_STAT_STATEMENTS_COLS	15
+
+/*
+ * Hash table key
+ */
+typedef struct SqliteStatKey
+{
+	Oid			userid;			/* user OID */
+	Oid			dbid;			/* database OID */
+	Oid			serverid;		/* foreign server OID */
+	uint64		queryid;		/* hash of the normalized remote SQL */
+} SqliteStatKey;
+
+/*
+ * Statistics of a statement
+ */
+typedef struct SqliteStatEntry
+{
+	SqliteStatKey key;			/* hash key (must be first) */
+	slock_t		mutex;			/* protects the counters */
+	int64		calls;			/* number of queries using the statement */
+	double		total_time;		/* time spent in sqlite3_step(), in msec */
+	double		min_time;		/* minimum time of a call, in msec */
+	double		max_time;		/* maximum time of a call, in msec */
+	int64		rows;			/* rows fetched or modified */
+	int64		vm_steps;		/* SQLITE_STMTSTATUS_VM_STEP */
+	int64		fullscan_steps; /* SQLITE_STMTSTATUS_FULLSCAN_STEP */
+	int64		sorts;			/* SQLITE_STMTSTATUS_SORT */
+	int64		autoindex;		/* SQLITE_STMTSTATUS_AUTOINDEX */
+	char		query[SQLITE_STAT_QUERY_SIZE];	/* normalized remote SQL */
+} SqliteStatEntry;
+
+/*
+ * Global shared state
+ */
+typedef struct SqliteStatSharedState
+{
+	LWLock	   *lock;			/* protects the hash table */
+} SqliteStatSharedState;
+
+/* GUC sqlite_fdw.stat_track_timing */
+static bool sqlite_stat_track_timing = false;
+
+static SqliteStatSharedState *sqlite_stat_state = NULL;
+static HTAB *sqlite_stat_hash = NULL;
+
+#if PG_VERSION_NUM >= 150000
+static shmem_request_hook_type prev_shmem_request_hook = NULL;
+#endif
+static shmem_startup_hook_type prev_shmem_startup_hook = NULL;
+
+PG_FUNCTION_INFO_V1(sqlite_fdw_stat_statements);
+PG_FUNCTION_INFO_V1(sqlite_fdw_stat_statements_reset);
+
+#if PG_VERSION_NUM >= 150000
+static void sqlite_stat_shmem_request(void);
+#endif
+static void sqlite_stat_shmem_startup(void);
+static Size sqlite_stat_memsize(void);
+static char *sqlite_stat_normalize_query(const char *query);
+static SqliteStatEntry *sqlite_stat_alloc_entry(SqliteStatKey * key,
+												const char *query);
+static void sqlite_stat_dealloc(void);
+static int	sqlite_stat_calls_cmp(const void *lhs, const void *rhs);
+
+/*
+ * Define the GUC of the statistics and request their shared memory.  Called
+ * from _PG_init, shared memory is requested only if the library is being
+ * preloaded by the postmaster.
+ */
+void
+sqlite_stat_init(void)
+{
+	DefineCustomBoolVariable("sqlite_fdw.stat_track_timing",
+							 "Measures the time of remote statements for sqlite_fdw_stat_statements.",
+							 NULL,
+							 &sqlite_stat_track_timing,
+							 false,
+							 PGC_SUSET,
+							 0,
+							 NULL,
+							 NULL,
+							 NULL);
+#if PG_VERSION_NUM >= 150000
+	MarkGUCPrefixReserved("sqlite_fdw");
+#else
+	EmitWarningsOnPlaceholders("sqlite_fdw");
+#endif
+
+	if (!process_shared_preload_libraries_in_progress)
+		return;
+
+#if PG_VERSION_NUM >= 150000
+	prev_shmem_request_hook = shmem_request_hook;
+	shmem_request_hook = sqlite_stat_shmem_request;
+#else
+	RequestAddinShmemSpace(sqlite_stat_memsize());
+	RequestNamedLWLockTranche("sqlite_fdw", 1);
+#endif
+	prev_shmem_startup_hook = shmem_startup_hook;
+	shmem_startup_hook = sqlite_stat_shmem_startup;
+}
+
+#if PG_VERSION_NUM >= 150000
+static void
+sqlite_stat_shmem_request(void)
+{
+	if (prev_shmem_request_hook)
+		prev_shmem_request_hook();
+
+	RequestAddinShmemSpace(sqlite_stat_memsize());
+	RequestNamedLWLockTranche("sqlite_fdw", 1);
+}
+#endif
+
+/*
+ * Allocate or attach to the shared memory of the statistics.
+ */
+static void
+sqlite_stat_shmem_startup(void)
+{
+	HASHCTL		info;
+	bool		found;
+
+	if (prev_shmem_startup_hook)
+		prev_shmem_startup_hook();
+
+	LWLockAcquire(AddinShmemInitLock, LW_EXCLUSIVE);
+
+	sqlite_stat_state = ShmemInitStruct("sqlite_fdw statistics",
+										sizeof(SqliteStatSharedState),
+										&found);
+	if (!found)
+		sqlite_stat_state->lock = &(GetNamedLWLockTranche("sqlite_fdw"))->lock;
+
+	memset(&info, 0, sizeof(info));
+	info.keysize = sizeof(SqliteStatKey);
+	info.entrysize = sizeof(SqliteStatEntry);
+	sqlite_stat_hash = ShmemInitHash("sqlite_fdw statement hash",
+									 SQLITE_STAT_MAX_ENTRIES,
+									 SQLITE_STAT_MAX_ENTRIES,
+									 &info,
+									 HASH_ELEM | HASH_BLOBS);
+
+	LWLockRelease(AddinShmemInitLock);
+}
+
+static Size
+sqlite_stat_memsize(void)
+{
+	return add_size(MAXALIGN(sizeof(SqliteStatSharedState)),
+					hash_estimate_size(SQLITE_STAT_MAX_ENTRIES,
+									   sizeof(SqliteStatEntry)));
+}
+
+/*
+ * Are statement statistics collected?
+ */
+bool
+sqlite_stat_enabled(void)
+{
+	return sqlite_stat_state != NULL && sqlite_stat_hash != NULL;
+}
+
+/*
+ * Is the time of statements measured for the statistics?  Reading the clock
+ * around every sqlite3_step() is not free, so it must be asked for.
+ */
+bool
+sqlite_stat_timing_enabled(void)
+{
+	return sqlite_stat_track_timing && sqlite_stat_enabled();
+}
+
+/*
+ * Reset the sqlite3_stmt_status() counters of a statement, so that the
+ * next sqlite_stat_store() sees only the current query.
+ */
+void
+sqlite_stat_begin(sqlite3_stmt * stmt)
+{
+	if (!sqlite_stat_enabled() || stmt == NULL)
+		return;
+
+	sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+	sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+	sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+	sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+}
+
+/*
+ * Add one call of a statement by a query to the statistics.  step_time is
+ * the time spent in sqlite3_step() and rows are the rows fetched or
+ * modified.  The counters of the statement are read and reset.
+ */
+void
+sqlite_stat_store(ForeignServer *server, sqlite3_stmt * stmt,
+				  instr_time step_time, uint64 rows)
+{
+	SqliteStatKey key;
+	SqliteStatEntry *entry;
+	const char *sql;
+	char	   *query;
+	double		time_ms = INSTR_TIME_GET_MILLISEC(step_time);
+	int64		vm_steps;
+	int64		fullscan_steps;
+	int64		sorts;
+	int64		autoindex;
+
+	if (!sqlite_stat_enabled() || stmt == NULL)
+		return;
+
+	sql = sqlite3_sql(stmt);
+	if (sql == NULL)
+		return;
+
+	vm_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_VM_STEP, 1);
+	fullscan_steps = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_FULLSCAN_STEP, 1);
+	sorts = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_SORT, 1);
+	autoindex = sqlite3_stmt_status(stmt, SQLITE_STMTSTATUS_AUTOINDEX, 1);
+
+	query = sqlite_stat_normalize_query(sql);
+
+	memset(&key, 0, sizeof(key));
+	key.userid = GetUserId();
+	key.dbid = MyDatabaseId;
+	key.serverid = server->serverid;
+	key.queryid = DatumGetUInt64(hash_any_extended((const unsigned char *) query,
+												   strlen(query), 0));
+
+	LWLockAcquire(sqlite_stat_state->lock, LW_SHARED);
+
+	entry = (SqliteStatEntry *) hash_search(sqlite_stat_hash, &key, HASH_FIND, NULL);
+	if (entry == NULL)
+	{
+		/* A new entry needs the exclusive lock */
+		LWLockRelease(sqlite_stat_state->lock);
+		LWLockAcquire(sqlite_stat_state->lock, LW_EXCLUSIVE);
+		entry = sqlite_stat_alloc_entry(&key, query);
+	}
+
+	SpinLockAcquire(&entry->mutex);
+	if (entry->calls == 0 || entry->min_time > time_ms)
+		entry->min_time = time_ms;
+	if (entry->calls == 0 || entry->max_time < time_ms)
+		entry->max_time = time_ms;
+	entry->calls++;
+	entry->total_time += time_ms;
+	entry->rows += rows;
+	entry->vm_steps += vm_steps;
+	entry->fullscan_steps += fullscan_steps;
+	entry->sorts += sorts;
+	entry->autoindex += autoindex;
+	SpinLockRelease(&entry->mutex);
+
+	LWLockRelease(sqlite_stat_state->lock);
+
+	pfree(query);
+}
+
+/*
+ * Find or create an entry.  If the table is full, the entries with the least
+ * calls are discarded first.  Caller must hold the lock exclusively.
+ */
+static SqliteStatEntry *
+sqlite_stat_alloc_entry(SqliteStatKey * key, const char *query)
+{
+	SqliteStatEntry *entry;
+	bool		found;
+
+	entry = (SqliteStatEntry *) hash_search(sqlite_stat_hash, key, HASH_FIND, NULL);
+	if (entry != NULL)
+		return entry;
+
+	if (hash_get_num_entries(sqlite_stat_hash) >= SQLITE_STAT_MAX_ENTRIES)
+		sqlite_stat_dealloc();
+
+	entry = (SqliteStatEntry *) hash_search(sqlite_stat_hash, key, HASH_ENTER, &found);
+	Assert(!found);
+
+	SpinLockInit(&entry->mutex);
+	entry->calls = 0;
+	entry->total_time = 0;
+	entry->min_time = 0;
+	entry->max_time = 0;
+	entry->rows = 0;
+	entry->vm_steps = 0;
+	entry->fullscan_steps = 0;
+	entry->sorts = 0;
+	entry->autoindex = 0;
+	strlcpy(entry->query, query,
+			pg_mbcliplen(query, strlen(query), SQLITE_STAT_QUERY_SIZE - 1) + 1);
+
+	return entry;
+}
+
+/*
+ * Discard SQLITE_STAT_DEALLOC_PERCENT of the entries, those with the least
+ * calls, so that the table is not scanned for every new statement.  Caller
+ * must hold the lock exclusively.
+ */
+static void
+sqlite_stat_dealloc(void)
+{
+	HASH_SEQ_STATUS scan;
+	SqliteStatEntry **entries;
+	SqliteStatEntry *entry;
+	int			nentries = 0;
+	int			nvictims;
+	int			i;
+
+	entries = palloc(hash_get_num_entries(sqlite_stat_hash) * sizeof(SqliteStatEntry *));
+
+	hash_seq_init(&scan, sqlite_stat_hash);
+	while ((entry = (SqliteStatEntry *) hash_seq_search(&scan)) != NULL)
+		entries[nentries++] = entry;
+
+	qsort(entries, nentries, sizeof(SqliteStatEntry *), sqlite_stat_calls_cmp);
+
+	nvictims = Max(10, nentries * SQLITE_STAT_DEALLOC_PERCENT / 100);
+	nvictims = Min(nvictims, nentries);
+
+	for (i = 0; i < nvictims; i++)
+		hash_search(sqlite_stat_hash, &entries[i]->key, HASH_REMOVE, NULL);
+
+	pfree(entries);
+}
+
+/*
+ * qsort comparator for sorting into increasing number of calls
+ */
+static int
+sqlite_stat_calls_cmp(const void *lhs, const void *rhs)
+{
+	int64		l_calls = (*(SqliteStatEntry * const *) lhs)->calls;
+	int64		r_calls = (*(SqliteStatEntry * const *) rhs)->calls;
+
+	if (l_calls < r_calls)
+		return -1;
+	else if (l_calls > r_calls)
+		return +1;
+	else
+		return 0;
+}
+
+/*
+ * Replace the string, numeric and blob literals of a remote SQL statement
+ * with '?', the placeholder of query parameters.  Quoted identifiers are
+ * kept as they are.
+ */
+static char *
+sqlite_stat_normalize_query(const char *query)
+{
+	StringInfoData buf;
+	const char *p = query;
+
+	initStringInfo(&buf);
+	while (*p)
+	{
+		if (*p == '\'' ||
+			((*p == 'x' || *p == 'X') && p[1] == '\'' &&
+			 (p == query || !(isalnum((unsigned char) p[-1]) || p[-1] == '_'))))
+		{
+			/* String or blob literal, quotes are escaped by doubling */
+			if (*p != '\'')
+				p++;
+			for (p++; *p; p++)
+			{
+				if (*p == '\'')
+				{
+					if (p[1] != '\'')
+					{
+						p++;
+						break;
+					}
+					p++;
+				}
+			}
+			appendStringInfoChar(&buf, '?');
+		}
+		else if (*p == '"' || *p == '`')
+		{
+			/* Quoted identifier */
+			char		quote = *p;
+
+			appendStringInfoChar(&buf, *p++);
+			while (*p)
+			{
+				if (*p == quote)
+				{
+					appendStringInfoChar(&buf, *p++);
+					if (*p != quote)
+						break;
+				}
+				appendStringInfoChar(&buf, *p++);
+			}
+		}
+		else if (isdigit((unsigned char) *p) &&
+				 (p == query || !(isalnum((unsigned char) p[-1]) || p[-1] == '_')))
+		{
+			/* Numeric literal */
+			while (isalnum((unsigned char) *p) || *p == '.' ||
+				   ((*p == '+' || *p == '-') && (p[-1] == 'e' || p[-1] == 'E')))
+				p++;
+			appendStringInfoChar(&buf, '?');
+		}
+		else
+			appendStringInfoChar(&buf, *p++);
+	}
+
+	return buf.data;
+}
+
+/*
+ * sqlite_fdw_stat_statements
+ *
+ * Returns the statistics of all tracked remote statements.  Like
+ * pg_stat_statements, the text of statements executed by other users is
+ * shown only to superusers and members of pg_read_all_stats.
+ */
+Datum
+sqlite_fdw_stat_statements(PG_FUNCTION_ARGS)
+{
+	ReturnSetInfo *rsinfo = (ReturnSetInfo *) fcinfo->resultinfo;
+	HASH_SEQ_STATUS scan;
+	SqliteStatEntry *entry;
+	Oid			userid = GetUserId();
+	bool		is_allowed_role;
+#if PG_VERSION_NUM < 150000
+	TupleDesc	tupdesc;
+	Tuplestorestate *tupstore;
+	MemoryContext per_query_ctx;
+	MemoryContext oldcontext;
+#endif
+
+	if (!sqlite_stat_enabled())
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("sqlite_fdw must be loaded via shared_preload_libraries")));
+
+	is_allowed_role = is_member_of_role(userid, ROLE_PG_READ_ALL_STATS);
+
+#if PG_VERSION_NUM >= 160000
+	InitMaterializedSRF(fcinfo, 0);
+#elif PG_VERSION_NUM >= 150000
+	SetSingleFuncCall(fcinfo, 0);
+#else
+	/* check to see if caller supports us returning a tuplestore */
+	if (rsinfo == NULL || !IsA(rsinfo, ReturnSetInfo))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("set-valued function called in context that cannot accept a set")));
+	if (!(rsinfo->allowedModes & SFRM_Materialize))
+		ereport(ERROR,
+				(errcode(ERRCODE_FEATURE_NOT_SUPPORTED),
+				 errmsg("materialize mode required, but it is not allowed in this context")));
+
+	/* Build a tuple descriptor for our result type */
+	if (get_call_result_type(fcinfo, NULL, &tupdesc) != TYPEFUNC_COMPOSITE)
+		elog(ERROR, "return type must be a row type");
+
+	/* Build tuplestore to hold the result rows */
+	per_query_ctx = rsinfo->econtext->ecxt_per_query_memory;
+	oldcontext = MemoryContextSwitchTo(per_query_ctx);
+
+	tupstore = tuplestore_begin_heap(true, false, work_mem);
+	rsinfo->returnMode = SFRM_Materialize;
+	rsinfo->setResult = tupstore;
+	rsinfo->setDesc = tupdesc;
+
+	MemoryContextSwitchTo(oldcontext);
+#endif
+
+	LWLockAcquire(sqlite_stat_state->lock, LW_SHARED);
+
+	hash_seq_init(&scan, sqlite_stat_hash);
+	while ((entry = (SqliteStatEntry *) hash_seq_search(&scan)) != NULL)
+	{
+		Datum		values[SQLITE_STAT_STATEMENTS_COLS] = {0};
+		bool		nulls[SQLITE_STAT_STATEMENTS_COLS] = {0};
+		SqliteStatEntry tmp;
+		int			i = 0;
+
+		/* Copy the counters, so that the spinlock is not held for long */
+		SpinLockAcquire(&entry->mutex);
+		memcpy(&tmp, entry, offsetof(SqliteStatEntry, query));
+		SpinLockRelease(&entry->mutex);
+
+		if (tmp.calls == 0)
+			continue;
+
+		values[i++] = ObjectIdGetDatum(tmp.key.userid);
+		values[i++] = ObjectIdGetDatum(tmp.key.dbid);
+		values[i++] = ObjectIdGetDatum(tmp.key.serverid);
+		if (is_allowed_role || tmp.key.userid == userid)
+		{
+			values[i++] = Int64GetDatum((int64) tmp.key.queryid);
+			values[i++] = CStringGetTextDatum(entry->query);
+		}
+		else
+		{
+			/* Don't show the statement of another user */
+			nulls[i++] = true;
+			values[i++] = CStringGetTextDatum("<insufficient privilege>");
+		}
+		values[i++] = Int64GetDatum(tmp.calls);
+		values[i++] = Float8GetDatum(tmp.total_time);
+		values[i++] = Float8GetDatum(tmp.min_time);
+		values[i++] = Float8GetDatum(tmp.max_time);
+		values[i++] = Float8GetDatum(tmp.total_time / tmp.calls);
+		values[i++] = Int64GetDatum(tmp.rows);
+		values[i++] = Int64GetDatum(tmp.vm_steps);
+		values[i++] = Int64GetDatum(tmp.fullscan_steps);
+		values[i++] = Int64GetDatum(tmp.sorts);
+		values[i++] = Int64GetDatum(tmp.autoindex);
+
+		Assert(i == SQLITE_STAT_STATEMENTS_COLS);
+
+#if PG_VERSION_NUM >= 150000
+		tuplestore_putvalues(rsinfo->setResult, rsinfo->setDesc, values, nulls);
+#else
+		tuplestore_putvalues(tupstore, tupdesc, values, nulls);
+#endif
+	}
+
+	LWLockRelease(sqlite_stat_state->lock);
+
+#if PG_VERSION_NUM < 150000
+	/* clean up and return the tuplestore */
+	tuplestore_donestoring(tupstore);
+#endif
+
+	PG_RETURN_VOID();
+}
+
+/*
+ * sqlite_fdw_stat_statements_reset
+ *
+ * Discard the statistics of all remote statements.
+ */
+Datum
+sqlite_fdw_stat_statements_reset(PG_FUNCTION_ARGS)
+{
+	HASH_SEQ_STATUS scan;
+	SqliteStatEntry *entry;
+
+	if (!sqlite_stat_enabled())
+		ereport(ERROR,
+				(errcode(ERRCODE_OBJECT_NOT_IN_PREREQUISITE_STATE),
+				 errmsg("sqlite_fdw must be loaded via shared_preload_libraries")));
+
+	LWLockAcquire(sqlite_stat_state->lock, LW_EXCLUSIVE);
+
+	hash_seq_init(&scan, sqlite_stat_hash);
+	while ((entry = (SqliteStatEntry *) hash_seq_search(&scan)) != NULL)
+		hash_search(sqlite_stat_hash, &entry->key, HASH_REMOVE, NULL);
+
+	LWLockRelease(sqlite_stat_state->lock);
+
+	PG_RETURN_VOID();
+}
@@ -8,6 +8,8 @@ sqlite3 "$testdir/post.db" < sql/init_data/init_post.sql;
 sqlite3 "$testdir/core.db" < sql/init_data/init_core.sql;
 sqlite3 "$testdir/common.db" < sql/init_data/init.sql;
 sqlite3 "$testdir/selectfunc.db" < sql/init_data/init_selectfunc.sql;
+sqlite3 "$testdir/wal.db" < sql/init_data/init_wal.sql;
+sqlite3 "$testdir/analyzed.db" < sql/init_data/init_analyzed.sql;
 
 while (( "$#" )); do
   export "$1";